@@ -0,0 +1,87 @@
+#ifndef OTA_ENGINE_H
+#define OTA_ENGINE_H
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "config.h"
+#include "peripheral.h"
+#include "OTA_service.h"
+#include "signature.h"
+
+// the protocol engine: control point opcodes, object handling and firmware validation.
+// it knows nothing about BLE or the chip, everything it needs from the target goes through the port functions below.
+// on the chip the port is src/peripheral.c. on Linux it is the simulated device in tools/sim.
+
+// a control point request that waits for a flash job before it can be answered.
+// this is not a response code on the air, it only tells the engine not to respond yet.
+#define OTA_RSP_DEFERRED                0xFF
+
+typedef struct
+{
+#if STREAM_WRITE
+    // data packets are programmed as they arrive, through this window since the flash wants dword aligned data.
+    // only the bytes short of a flash word stay in it until the next packet. the init packet goes to cmdObj.
+    __attribute__((aligned(4))) uint8_t streamBuffer[OTA_STREAM_WINDOW];
+    uint16_t streamFill; // bytes in the window that are not programmed yet.
+    uint8_t streamStatus; // the first flash error since SELECT, the next EXECUTE fails with it.
+#else
+    // since we need to write this buffer to flash, it has to be dword aligned, and the size is the max object size.
+    __attribute__((aligned(4))) uint8_t objectBuffer[OTA_OBJECT_BUFFER_SIZE];
+#endif
+    uint16_t objectBufferOffset; // this is the offset within the object, so that multiple packets can be stored.
+    uint8_t currentObject; // 0 is invalid object, 1 is command, 2 is data.
+    uint8_t busy; // a flash job is in flight. the object buffer belongs to it until the deferred request is answered.
+    uint8_t abortPending; // ABORT came during a flash job, the engine starts over once the job is answered.
+    uint16_t receiptPRN;
+    uint16_t receiptPRNCounter;
+    uint32_t cmdObjectOffset;
+    uint32_t cmdObjectSize;
+    uint32_t cmdObjectCRC;
+    uint32_t dataObjectOffset;
+    uint32_t dataObjectSize;
+    uint32_t dataObjectCRC;
+    CmdObject_t cmdObj;
+    uint8_t deferredOpcode;
+    OTA_CtrlPointRsp_t deferredRsp;
+    // the CAPABILITIES descriptor is built here, with a byte in front for its total length. the stack has no room for it.
+    uint8_t caps[1 + OTA_CAPS_MAX_LEN];
+    CryptoArena_t crypto;
+    void* port; // belongs to the port, the engine never touches it.
+} OTA_Engine_t;
+
+// -- Engine -- //
+void OTA_Engine_Init(OTA_Engine_t* eng, void* port);
+void OTA_Engine_CtrlPoint(OTA_Engine_t* eng, uint8_t* pValue, uint16_t len);
+void OTA_Engine_Packet(OTA_Engine_t* eng, uint8_t* pValue, uint16_t len);
+void OTA_Engine_FlashDone(OTA_Engine_t* eng, uint8_t status);
+void OTA_Engine_Dropped(OTA_Engine_t* eng, uint8_t opcode);
+uint16_t OTA_GetRspContent(uint8_t opcode, OtaRspCode_t rspCode, OTA_CtrlPointRsp_t* rsp, uint8_t** ppContent);
+
+// -- Port -- //
+// implemented exactly once per target and bound at link time, so there is no function pointer on the way.
+uint16_t OTA_Port_GetMTU(OTA_Engine_t* eng);
+// deliver a control point response. rsp is only valid during the call.
+void OTA_Port_SendRsp(OTA_Engine_t* eng, uint8_t opcode, OTA_CtrlPointRsp_t* rsp, OtaRspCode_t rspCode);
+// start a flash job. returns !0 if it could not be started, otherwise OTA_Engine_FlashDone must follow, possibly from within the call.
+bStatus_t OTA_Port_FlashErase(OTA_Engine_t* eng, uint32_t addr, uint32_t len);
+bStatus_t OTA_Port_FlashProgram(OTA_Engine_t* eng, uint32_t addr, uint8_t* pBuf, uint32_t len);
+#if STREAM_WRITE
+// program right away from the packet path, the cpu stalls until it is done. addr and len are whole flash words.
+bStatus_t OTA_Port_FlashWrite(OTA_Engine_t* eng, uint32_t addr, uint8_t* pBuf, uint32_t len);
+#endif
+void OTA_Port_ReadKey(OTA_Engine_t* eng, uint8_t* pKey);
+void OTA_Port_ReadData(OTA_Engine_t* eng, EEPROM_Data_t* pData);
+// the installed application, returns !0 when none was installed.
+uint8_t OTA_Port_ReadImageInfo(OTA_Engine_t* eng, ImageInfo_t* pInfo);
+uint32_t OTA_Port_LibVersion(OTA_Engine_t* eng);
+// the new image is written and verified, hand over to it. an application is also recorded, see image_info.h.
+void OTA_Port_Finish(OTA_Engine_t* eng);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OTA_ENGINE_H */
@@ -9,6 +9,10 @@
 #define OTA_SERVICE_H
 
 #include "config.h"
+#include "image_info.h"
+#include "perf_counter.h"
+#include "session_log.h"
+#include "trace.h"
 
 
 #define CTRL_POINT_BUFFER_SIZE              8
@@ -41,6 +45,13 @@
 #define OTA_CTRL_POINT_OPCODE_HW_VERSION             0x0A
 #define OTA_CTRL_POINT_OPCODE_FW_VERSION             0x0B
 #define OTA_CTRL_POINT_OPCODE_ABORT                  0x0C
+// vendor opcodes, not part of Nordic's protocol.
+#define OTA_CTRL_POINT_OPCODE_PERF_STATS             0x80
+#define OTA_CTRL_POINT_OPCODE_TRACE_DUMP             0x81
+#define OTA_CTRL_POINT_OPCODE_MEM_USAGE              0x82
+#define OTA_CTRL_POINT_OPCODE_SESSION_LOG            0x83
+#define OTA_CTRL_POINT_OPCODE_IMAGE_DIGEST           0x84
+#define OTA_CTRL_POINT_OPCODE_CAPABILITIES           0x85
 #define OTA_CTRL_POINT_OPCODE_RSP                    0x60
 /*********************************************************************
  * Control Point Response Code.
@@ -55,6 +66,11 @@
 #define OTA_RSP_OP_NOT_PERMITTED                     0x08
 #define OTA_RSP_OP_FAILED                            0x0A
 #define OTA_RSP_EXT_ERROR                            0x0B
+/*********************************************************************
+ * Extended error codes, the first byte of an OTA_RSP_EXT_ERROR response. vendor codes, Nordic's are not used.
+ */
+#define OTA_EXT_FLASH_ERROR                          0x80 // erasing or programming the flash failed.
+#define OTA_EXT_DATA_DROPPED                         0x81 // writes were dropped, the request was not handled. see OTA_Engine_Dropped.
 /*********************************************************************
  * Control Point Object Type.
  */
@@ -119,6 +135,97 @@ typedef struct
     uint32_t len;
 } OTA_CtrlPointRsp_Firmware_t;
 
+// the content of every OTA_RSP_EXT_ERROR response: what went wrong and where the current object stands,
+// as a CRC request would answer. the host resumes from there after OTA_EXT_DATA_DROPPED.
+typedef struct
+{
+    uint8_t padding[2]; // left out, like the firmware's.
+    uint8_t code; // OTA_EXT_*.
+    uint8_t type; // of the current object, OTA_CONTROL_POINT_OBJ_TYPE_INVALID before the first CREATE.
+    uint32_t offset;
+    uint32_t crc;
+} OTA_CtrlPointRsp_Ext_t;
+
+// counters of one PERF_STAGE_*. only answered when built with PERF_COUNTERS.
+typedef PerfStage_t OTA_CtrlPointRsp_Perf_t;
+// a window of the trace ring. only answered when built with TRACE_RING.
+// records past head are zeroed, so the host knows how many are valid from head and seq.
+#define OTA_TRACE_RSP_RECORDS                        2
+typedef struct
+{
+    uint16_t head;
+    uint16_t seq;
+    TraceRecord_t records[OTA_TRACE_RSP_RECORDS];
+} OTA_CtrlPointRsp_Trace_t;
+
+// stack and BLE heap high water marks, in bytes. only answered when built with MEM_WATERMARK.
+typedef struct
+{
+    uint32_t stack_size;
+    uint32_t stack_used;
+    uint32_t heap_size;
+    uint32_t heap_used;
+} OTA_CtrlPointRsp_Mem_t;
+
+// a stored session record, the request is its index with 0 the newest. only answered when built with SESSION_LOG.
+typedef SessionRecord_t OTA_CtrlPointRsp_Session_t;
+
+// the installed application's version and part of its digest, from the byte offset in the request.
+// two requests, at 0 and OTA_DIGEST_RSP_LEN, get all of it. see image_info.h.
+#define OTA_DIGEST_RSP_LEN                           16
+typedef struct
+{
+    uint32_t version;
+    uint8_t digest[OTA_DIGEST_RSP_LEN];
+} OTA_CtrlPointRsp_Digest_t;
+
+// everything a host needs before starting a session, in one request instead of VERSION, HW_VERSION, FW_VERSION per type,
+// GET_MTU and SELECT. tag, length and value records, values little endian, unknown tags are skipped by their length.
+// the request is the byte offset to start from. the response is the total length of the records followed by as many
+// bytes from the offset as the MTU allows, so below an MTU of about 115 the host asks again from where it got to.
+#define OTA_CAP_PROTOCOL                             0x01 // uint8_t, as VERSION.
+#define OTA_CAP_HARDWARE                             0x02 // OTA_CtrlPointRsp_Hardware_t.
+#define OTA_CAP_FIRMWARE                             0x03 // OTA_CtrlPointRsp_Firmware_t without the paddings, one per type.
+#define OTA_CAP_MAX_OBJECT                           0x04 // uint32_t, the max_size of SELECT.
+#define OTA_CAP_MTU                                  0x05 // uint16_t, as GET_MTU.
+#define OTA_CAP_MODES                                0x06 // OTA_Cap_Modes_t.
+#define OTA_CAP_OBJECT                               0x07 // OTA_Cap_Object_t, one per object type.
+// transports, bits of OTA_Cap_Modes_t.transports.
+#define OTA_CAP_TRANSPORT_GATT                       0x01
+#define OTA_CAP_TRANSPORT_UART                       0x02
+#define OTA_CAP_TRANSPORT_L2CAP                      0x04
+// optional features built in, bits of OTA_Cap_Modes_t.features.
+#define OTA_CAP_FEATURE_STREAM_WRITE                 0x01
+#define OTA_CAP_FEATURE_SESSION_LOG                  0x02
+#define OTA_CAP_FEATURE_PERF_COUNTERS                0x04
+#define OTA_CAP_FEATURE_TRACE_RING                   0x08
+#define OTA_CAP_FEATURE_MEM_WATERMARK                0x10
+typedef struct
+{
+    uint8_t signature; // SIG_* of signature.h.
+    uint8_t compression; // 0, images are sent as they are.
+    uint8_t transports;
+    uint8_t features;
+} OTA_Cap_Modes_t;
+typedef struct
+{
+    uint8_t padding[3]; // left out of the record, like the firmware's.
+    uint8_t type;
+    uint32_t offset;
+    uint32_t crc;
+} OTA_Cap_Object_t; // what SELECT would answer, without selecting.
+#define OTA_CAPS_MAX_LEN                             (2 + 1 + 2 + sizeof(OTA_CtrlPointRsp_Hardware_t) + 3 * (2 + sizeof(OTA_CtrlPointRsp_Firmware_t) - 3) + \
+                                                      2 + sizeof(uint32_t) + 2 + sizeof(uint16_t) + 2 + sizeof(OTA_Cap_Modes_t) + 2 * (2 + sizeof(OTA_Cap_Object_t) - 3))
+// the descriptor does not fit the union, the response points at the one built for it instead.
+// packed so the 64 bit pointer of the host tools does not grow the union, and the MTU it needs, past 20 bytes.
+typedef struct __attribute__((packed, aligned(4)))
+{
+    uint8_t* pData;
+    uint16_t len;
+} OTA_CtrlPointRsp_Caps_t;
+// the largest response content, for the transports that frame responses in a buffer of their own.
+#define OTA_RSP_CONTENT_MAX_LEN                      (1 + OTA_CAPS_MAX_LEN)
+
 typedef union
 {
     OTA_CtrlPointRsp_Version_t version;
@@ -128,22 +235,31 @@ typedef union
     OTA_CtrlPointRsp_Ping_t ping;
     OTA_CtrlPointRsp_Hardware_t hardware;
     OTA_CtrlPointRsp_Firmware_t firmware;
-    
+    OTA_CtrlPointRsp_Perf_t perf;
+    OTA_CtrlPointRsp_Trace_t trace;
+    OTA_CtrlPointRsp_Mem_t mem;
+    OTA_CtrlPointRsp_Session_t session;
+    OTA_CtrlPointRsp_Digest_t digest;
+    OTA_CtrlPointRsp_Caps_t caps;
+    OTA_CtrlPointRsp_Ext_t ext;
+
 } OTA_CtrlPointRsp_t;
 
 // the application callback function types.
 typedef void (*OTA_HandleCtrlPointCB)(uint16_t connHandle, uint16_t attrHandle, uint8_t *pValue, uint16_t len);
-typedef void (*OTA_HandlePacketCB)(uint16_t connHandle, uint16_t attrHandle, uint8_t* pValue, uint16_t len);
 typedef struct
 {
     OTA_HandleCtrlPointCB ctrlPointCb;
-    OTA_HandlePacketCB packetCb;
 
 } OTA_WriteCharCBs_t;
+// the packet sink gets the payload of every packet characteristic write, straight from the stack's buffer.
+// it must consume the data before returning because the buffer is freed afterwards.
+typedef void (*OTA_PacketSink_t)(uint16_t connHandle, uint8_t* pValue, uint16_t len);
 
 // public apis.
 bStatus_t OTA_AddService();
 void OTA_RegisterWriteCharCBs(OTA_WriteCharCBs_t* cbs);
+void OTA_RegisterPacketSink(OTA_PacketSink_t sink);
 void OTA_SetupCtrlPointRsp(uint16_t connHandle, uint16_t attrHandle, uint8_t opcode, OTA_CtrlPointRsp_t* rsp, OtaRspCode_t rspCode);
 bStatus_t OTA_DispatchCtrlPointRsp();
 
@@ -0,0 +1,37 @@
+#ifndef BOOT_MAILBOX_H
+#define BOOT_MAILBOX_H
+
+
+// a few bytes at the end of RAM that survive a software reset, for the application and the bootloader to hand over
+// without writing the data flash. the application links src/boot_mailbox.c and src/crc.c to use it.
+// both linker scripts have to keep these bytes out of the stack and everything else, see __mailbox_size in link.ld.
+// on power on the RAM holds garbage, the magic and the crc keep it from looking like a message.
+#include <stdint.h>
+
+#define BOOT_MAILBOX_SIZE            16
+#ifndef BOOT_MAILBOX_ADDR
+#define BOOT_MAILBOX_ADDR            (0x20008000 - BOOT_MAILBOX_SIZE) // the end of RAM on CH571 and CH573.
+#endif
+#define BOOT_MAILBOX_MAGIC           0x4D424F58
+
+// commands.
+#define BOOT_MAILBOX_ENTER_DFU       0x01 // application to bootloader: stay in DFU, the boot flag is left as it is.
+#define BOOT_MAILBOX_BOOT_APP        0x02 // bootloader to application: DFU is over, after an update or without one.
+// peer_addr_type when no peer is passed along.
+#define BOOT_MAILBOX_NO_PEER         0xFF
+
+typedef struct
+{
+    uint32_t magic;
+    uint8_t command;
+    // the central the link was with, so the other side can advertise to it directly and it reconnects at once.
+    uint8_t peer_addr_type;
+    uint8_t peer_addr[6];
+    uint32_t crc; // of the fields above.
+} BootMailbox_t;
+
+void BootMailbox_Post(uint8_t command, uint8_t peerAddrType, const uint8_t* pPeerAddr);
+uint8_t BootMailbox_Take(uint8_t command, BootMailbox_t* pMailbox);
+void BootMailbox_EnterDfu(uint8_t peerAddrType, const uint8_t* pPeerAddr);
+
+#endif /* BOOT_MAILBOX_H */
@@ -10,6 +10,9 @@
 
 #include "config.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 #define CRC_INITIAL_VALUE           0
 #define CRC_XOROT                   0xFFFFFFFF
@@ -21,5 +24,10 @@
 
 uint32_t update_CRC32 (uint32_t crc32, void *pStart, uint32_t uSize);
 uint32_t calculate_CRC32 (void *pStart, uint32_t uSize);
+uint32_t update_CRC32_copy (uint32_t crc32, void *pDst, void *pSrc, uint32_t uSize);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif /* CRC_H */
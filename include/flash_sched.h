@@ -0,0 +1,44 @@
+#ifndef FLASH_SCHED_H
+#define FLASH_SCHED_H
+
+
+#include "config.h"
+
+// the cpu stalls while flash is erased or programmed, and so does the radio.
+// these estimates are used to decide whether an operation fits in the idle gap after a connection event.
+// they are conservative defaults, override them per product after measuring.
+#ifndef FLASH_SCHED_ERASE_BLOCK_US
+#define FLASH_SCHED_ERASE_BLOCK_US      3000 // erasing one EEPROM_BLOCK_SIZE block.
+#endif
+#ifndef FLASH_SCHED_PROGRAM_WORD_US
+#define FLASH_SCHED_PROGRAM_WORD_US     10 // programming one FLASH_MIN_WR_SIZE word.
+#endif
+// time reserved before the next connection event for the radio to get ready.
+#ifndef FLASH_SCHED_GUARD_US
+#define FLASH_SCHED_GUARD_US            1250
+#endif
+// smallest program chunk worth issuing. anything smaller waits for a better gap.
+#ifndef FLASH_SCHED_MIN_CHUNK
+#define FLASH_SCHED_MIN_CHUNK           32
+#endif
+// after this many deferrals in a row, the operation is executed anyway and we accept missing an event.
+#ifndef FLASH_SCHED_MAX_DEFERRALS
+#define FLASH_SCHED_MAX_DEFERRALS       4
+#endif
+
+#define FLASH_SCHED_OP_NONE             0x00
+#define FLASH_SCHED_OP_ERASE            0x01
+#define FLASH_SCHED_OP_PROGRAM          0x02
+
+// called once the whole job is committed. status is 0 on success, the flash driver's error otherwise.
+typedef void (*FlashSched_DoneCB_t)(uint8_t status);
+
+void FlashSched_Init(uint8_t taskID, uint16_t event);
+void FlashSched_SetConnInterval(uint16_t connInterval);
+void FlashSched_MarkConnEvent();
+bStatus_t FlashSched_Erase(uint32_t addr, uint32_t len, FlashSched_DoneCB_t cb);
+bStatus_t FlashSched_Program(uint32_t addr, uint8_t *pBuf, uint32_t len, FlashSched_DoneCB_t cb);
+BOOL FlashSched_Busy();
+void FlashSched_ProcessEvent();
+
+#endif /* FLASH_SCHED_H */
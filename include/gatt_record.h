@@ -0,0 +1,47 @@
+#ifndef GATT_RECORD_H
+#define GATT_RECORD_H
+
+
+// this header is shared with the host tools, so it must not depend on the SDK.
+#include <stdint.h>
+
+// a recording of the DFU traffic as the device saw it, replayable on Linux (tools/sim/gatt_replay).
+// every record is one SLIP frame (slip.h): a GattRecordHeader_t followed by the attribute value.
+// a recording file is just the frames back to back, so a capture of the device's UART is already one,
+// and tools/gatt_import writes the same format from a btsnoop log.
+
+// what a record is.
+#define GATT_RECORD_KIND_CTRL_POINT  0x01 // control point write.
+#define GATT_RECORD_KIND_PACKET      0x02 // packet characteristic write.
+#define GATT_RECORD_KIND_RSP         0x03 // control point notification sent back.
+
+// 12 bytes, little endian.
+typedef struct
+{
+    uint32_t time; // microseconds, free running and wrapping. only differences between records mean something.
+    uint16_t seq; // incremented for every record, a gap means records were lost.
+    uint16_t connHandle;
+    uint16_t mtu; // ATT MTU of the connection when the record was taken.
+    uint8_t kind;
+    uint8_t reserved;
+} GattRecordHeader_t;
+
+#if GATT_RECORD
+// the records are streamed out of UART1 TXD (PA9), 8N1.
+#ifndef GATT_RECORD_BAUD
+#define GATT_RECORD_BAUD             1500000
+#endif
+// encoded bytes buffered for the UART, must be a power of 2.
+// a record that does not fit is dropped, which shows up as a gap in seq.
+#ifndef GATT_RECORD_TX_RING
+#define GATT_RECORD_TX_RING          1024
+#endif
+
+void GattRecord_Init();
+void GattRecord_Write(uint16_t connHandle, uint8_t kind, const uint8_t* pValue, uint16_t len);
+#define GATT_RECORD_WRITE(connHandle, kind, pValue, len)  GattRecord_Write(connHandle, kind, pValue, len)
+#else
+#define GATT_RECORD_WRITE(connHandle, kind, pValue, len)
+#endif
+
+#endif /* GATT_RECORD_H */
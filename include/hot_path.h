@@ -0,0 +1,18 @@
+#ifndef HOT_PATH_H
+#define HOT_PATH_H
+
+
+// the DFU hot path can be copied to RAM (.highcode in link.ld) to run without flash wait states.
+// it costs RAM, so it is a build option. third party kernels (the SHA-256 compressor) are placed by the linker,
+// see highcode_hot.ld generated by CMakeLists.txt.
+// what it saves can only be measured on the chip: compare the CRC, HASH and WRITE_CB stages of a PERF_COUNTERS
+// build with the option on and off. the host benchmarks have no flash wait states to save.
+#if HIGHCODE_HOT_PATH
+#define OTA_HOT_CODE                 __attribute__((section(".highcode")))
+#define OTA_HOT_DATA                 __attribute__((section(".highcode.data")))
+#else
+#define OTA_HOT_CODE
+#define OTA_HOT_DATA
+#endif
+
+#endif /* HOT_PATH_H */
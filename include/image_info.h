@@ -0,0 +1,53 @@
+#ifndef IMAGE_INFO_H
+#define IMAGE_INFO_H
+
+
+// this header is shared with the host tools, so it must not depend on the SDK.
+// the application can link src/image_info.c and src/crc.c to read the record and advertise it as well.
+#include <stdint.h>
+
+// the installed application, written by the bootloader once an update is verified.
+// it has a data flash page of its own, next to the boot data. the application must leave it alone.
+#ifndef IMAGE_INFO_ADDR
+#define IMAGE_INFO_ADDR              (0x00077100 - FLASH_ROM_MAX_SIZE)
+#endif
+#define IMAGE_INFO_DIGEST_LEN        32 // the SHA-256 of the image, fw_hash of its init packet.
+
+typedef struct
+{
+    uint32_t app_version;
+    uint8_t app_digest[IMAGE_INFO_DIGEST_LEN];
+    uint32_t crc; // of the fields above, so an erased or torn record never looks valid.
+} ImageInfo_t;
+
+// service data for the scan response: length, type, service uuid, version and the start of the digest, all little endian.
+// a host can tell from a passive scan whether a device already runs its image, without connecting.
+#define IMAGE_INFO_AD_TYPE           0x16 // service data with a 16-bit uuid.
+#define IMAGE_INFO_AD_DIGEST_LEN     8
+#define IMAGE_INFO_AD_LEN            (8 + IMAGE_INFO_AD_DIGEST_LEN)
+
+/**
+ * @brief build the service data AD structure.
+ *
+ * @param uuid the service the data belongs to.
+ * @param version the installed application's version.
+ * @param pDigest its digest, IMAGE_INFO_AD_DIGEST_LEN bytes are used.
+ * @param pAd where to build it, IMAGE_INFO_AD_LEN bytes.
+ * @return uint8_t bytes written.
+ */
+static inline uint8_t ImageInfo_ServiceData(uint16_t uuid, uint32_t version, const uint8_t* pDigest, uint8_t* pAd)
+{
+    pAd[0] = IMAGE_INFO_AD_LEN - 1; // the length byte does not count itself.
+    pAd[1] = IMAGE_INFO_AD_TYPE;
+    pAd[2] = uuid & 0xFF;
+    pAd[3] = uuid >> 8;
+    for(uint8_t i = 0; i < 4; i++) pAd[4 + i] = version >> (8 * i);
+    for(uint8_t i = 0; i < IMAGE_INFO_AD_DIGEST_LEN; i++) pAd[8 + i] = pDigest[i];
+    return IMAGE_INFO_AD_LEN;
+}
+
+uint8_t ImageInfo_Read(ImageInfo_t* pInfo);
+void ImageInfo_Write(uint32_t version, const uint8_t* pDigest);
+void ImageInfo_Erase();
+
+#endif /* IMAGE_INFO_H */
@@ -0,0 +1,36 @@
+#ifndef L2CAP_TRANSPORT_H
+#define L2CAP_TRANSPORT_H
+
+
+#include "config.h"
+#include "peripheral.h"
+#include "OTA_service.h"
+
+// an LE credit based channel for object data, next to the packet characteristic.
+// the control point stays on GATT. every SDU on the channel is handled exactly like a packet write,
+// without the per packet ATT header, and the credits we hand out throttle the peer while flash is busy.
+
+// dynamic LE PSM the central connects to.
+#ifndef L2CAP_TRANSPORT_PSM
+#define L2CAP_TRANSPORT_PSM              0x0081
+#endif
+// largest SDU we accept. one object buffer, so a whole object fits in one SDU.
+#define L2CAP_TRANSPORT_MTU              OTA_OBJECT_BUFFER_SIZE
+// credits the peer starts with. one credit is one LE frame, not one SDU.
+#ifndef L2CAP_TRANSPORT_CREDITS
+#define L2CAP_TRANSPORT_CREDITS          8
+#endif
+// once the peer is down to this many credits, it is topped up to L2CAP_TRANSPORT_CREDITS again,
+// unless a flash job is in flight. then it has to wait until the job is committed.
+#ifndef L2CAP_TRANSPORT_CREDIT_THRESHOLD
+#define L2CAP_TRANSPORT_CREDIT_THRESHOLD 2
+#endif
+
+#if L2CAP_TRANSPORT
+void L2capTransport_Init(uint8_t taskID, OTA_PacketSink_t sink);
+void L2capTransport_ProcessMsg(tmos_event_hdr_t* pMsg);
+void L2capTransport_Hold();
+void L2capTransport_Release();
+#endif
+
+#endif /* L2CAP_TRANSPORT_H */
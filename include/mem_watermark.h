@@ -0,0 +1,28 @@
+#ifndef MEM_WATERMARK_H
+#define MEM_WATERMARK_H
+
+
+#include "config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// unused memory is painted with this pattern at boot. the first word that differs marks the high water.
+#define MEM_PAINT_PATTERN            0xA5A5A5A5
+
+// the BLE heap handed to the stack, defined in main.c.
+extern uint32_t MEM_BUF[BLE_MEMHEAP_SIZE / 4];
+
+#if MEM_WATERMARK
+void MemWatermark_Init();
+uint32_t MemWatermark_StackSize();
+uint32_t MemWatermark_StackUsed();
+uint32_t MemWatermark_HeapUsed();
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MEM_WATERMARK_H */
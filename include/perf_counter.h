@@ -0,0 +1,60 @@
+#ifndef PERF_COUNTER_H
+#define PERF_COUNTER_H
+
+
+#include "config.h"
+
+// stages of the DFU path we measure.
+#define PERF_STAGE_WRITE_CB          0 // whole GATT write callback, from entry to return.
+#define PERF_STAGE_CRC               1 // packet ingestion, the copy into the object buffer is fused with the crc.
+#define PERF_STAGE_MEMCPY            2 // the remaining copies: command object and response content.
+#define PERF_STAGE_HASH              3
+#define PERF_STAGE_ERASE             4
+#define PERF_STAGE_PROGRAM           5
+#define PERF_STAGE_SIGNATURE         6
+#define PERF_STAGE_NOTIFY            7
+#define PERF_STAGE_COUNT             8
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint32_t total_lo; // total is 64 bits, split so that the struct stays dword aligned on the air.
+    uint32_t total_hi;
+} PerfStage_t;
+
+#if PERF_COUNTERS
+#ifdef __riscv
+// cycles since reset, from the machine cycle counter.
+static inline uint32_t Perf_Cycles()
+{
+    uint32_t cycles;
+    __asm__ volatile ("csrr %0, mcycle" : "=r"(cycles));
+    return cycles;
+}
+#else
+#include <time.h>
+// host builds have no cycle counter we can rely on, so the unit is nanoseconds there.
+static inline uint32_t Perf_Cycles()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000000000ull + ts.tv_nsec);
+}
+#endif
+
+void Perf_Record(uint8_t stage, uint32_t cycles);
+bStatus_t Perf_Get(uint8_t stage, PerfStage_t* pStage);
+void Perf_Reset();
+
+// the begin and end of a stage must be in the same scope.
+#define PERF_BEGIN(stage)   uint32_t perf_start_##stage = Perf_Cycles()
+#define PERF_END(stage)     Perf_Record(stage, Perf_Cycles() - perf_start_##stage)
+#else
+// compiled out, nothing is left behind.
+#define PERF_BEGIN(stage)
+#define PERF_END(stage)
+#endif
+
+#endif /* PERF_COUNTER_H */
@@ -3,6 +3,7 @@
 
 
 #include "signature.h"
+#include "boot_mailbox.h"
 
 // -- Defines -- //
 // Chip info.
@@ -34,6 +35,26 @@
 #define APPLICATION_START_ADDR       0x00004000
 #define APPLICATION_MAX_SIZE         0x0000C000
 
+// object buffer size, which is also the max object size reported by SELECT.
+// must be a multiple of EEPROM_PAGE_SIZE. larger objects mean fewer CREATE/CRC/EXECUTE round trips.
+#ifndef OTA_OBJECT_BUFFER_SIZE
+#define OTA_OBJECT_BUFFER_SIZE       EEPROM_PAGE_SIZE
+#endif
+// with STREAM_WRITE there is no object buffer, OTA_OBJECT_BUFFER_SIZE then only limits the object size.
+// packets are copied to flash through a window of this many bytes, a multiple of FLASH_MIN_WR_SIZE.
+#ifndef OTA_STREAM_WINDOW
+#define OTA_STREAM_WINDOW            64
+#endif
+// CMake passes the same values to the linker as __stack_size and __highcode_budget.
+#ifndef OTA_STACK_SIZE
+#define OTA_STACK_SIZE               512
+#endif
+#ifndef HIGHCODE_BUDGET
+#define HIGHCODE_BUDGET              0x800
+#endif
+// .dalign in link.ld keeps at least 0x800 bytes of RAM for .highcode, more if the budget allows it.
+#define OTA_HIGHCODE_RAM             (HIGHCODE_BUDGET > 0x800 ? HIGHCODE_BUDGET : 0x800)
+
 // data storage info.
 #define EEPROM_DATA_ADDR             0x00077000 - FLASH_ROM_MAX_SIZE
 
@@ -45,12 +66,22 @@
 #define MAIN_TASK_TIMEOUT_EVENT      0x02
 #define MAIN_TASK_WRITERSP_EVENT     0x04
 #define MAIN_TASK_RESET_EVENT        0x08
+#define MAIN_TASK_FLASH_EVENT        0x10
+#define MAIN_TASK_UART_EVENT         0x20
+#define MAIN_TASK_ADV_EVENT          0x40
+#define MAIN_TASK_QUEUE_EVENT        0x80
+#define MAIN_TASK_WIRED_EVENT        0x100
 
 // ADV parameters.
-#define DEFAULT_ADVERTISING_INTERVAL    80 // in multiples of 625us.
+// a burst of fast advertising after power on or a lost link, so a central that is already scanning connects at once,
+// then the default interval for the rest of the timeout.
+#define FAST_ADVERTISING_INTERVAL       32 // in multiples of 625us, 20ms is the fastest allowed for connectable advertising.
+#define FAST_ADVERTISING_TIME           4800 // in multiples of 625us.
+#define DEFAULT_ADVERTISING_INTERVAL    244 // in multiples of 625us.
 
 // TASK intervals.
 #define MAIN_TASK_ADV_TIMEOUT 48000 // also in multiples of 625us. 1600 is 1 second, 4800 is 30 secs.
+#define MAIN_TASK_WIRED_TIMEOUT 16000 // a wired host that sends nothing for this long is gone, in multiples of 625us.
 
 // connection parameters.
 // Minimum connection interval (units of 1.25ms, 6=7.5ms) if automatic parameter update request is enabled
@@ -91,7 +122,7 @@ typedef struct
 
 
 // -- Function Declarations -- //
-void OTA_Init();
+void OTA_Init(const BootMailbox_t* pMailbox);
 uint16_t Main_Task_ProcessEvent(uint8_t task_id, uint16_t events);
 
 
@@ -0,0 +1,65 @@
+#ifndef SESSION_LOG_H
+#define SESSION_LOG_H
+
+
+// this header is shared with the host tools, so it must not depend on the SDK.
+#include <stdint.h>
+
+// the records are kept in a ring of data flash pages, under the boot data and the key.
+// the application must leave this range alone.
+#ifndef SESSION_LOG_ADDR
+#define SESSION_LOG_ADDR             (0x00076000 - FLASH_ROM_MAX_SIZE)
+#endif
+#ifndef SESSION_LOG_SIZE
+#define SESSION_LOG_SIZE             0x1000 // a multiple of EEPROM_PAGE_SIZE, at least 2 pages.
+#endif
+// a record and its crc per slot, slots never cross a page.
+#define SESSION_LOG_SLOT_SIZE        32
+
+// how a session ended.
+#define SESSION_OUTCOME_NONE         0x00 // no init packet was accepted.
+#define SESSION_OUTCOME_INTERRUPTED  0x01 // the link went away after the init packet was accepted.
+#define SESSION_OUTCOME_UPDATED      0x02 // the image was verified and handed over to.
+#define SESSION_OUTCOME_REJECTED     0x03 // the init packet failed validation.
+#define SESSION_OUTCOME_HASH_FAILED  0x04 // the image did not match the init packet.
+#define SESSION_OUTCOME_FLASH_ERROR  0x05
+
+// what the engine and the port report while a session runs. arg depends on the event.
+#define SESSION_LOG_EV_REQUEST       0x01 // a control point request. arg = MTU.
+#define SESSION_LOG_EV_PACKET        0x02 // object data accepted. arg = length.
+#define SESSION_LOG_EV_DROP          0x03 // a packet dropped, the host's next CRC check fails.
+#define SESSION_LOG_EV_CREATE        0x04 // a data object created. created again before it is executed is a retry.
+#define SESSION_LOG_EV_EXECUTE       0x05 // a data object executed.
+#define SESSION_LOG_EV_FLASH_START   0x06 // a flash job started. arg = OTA_CTRL_POINT_OPCODE_SELECT for erase, EXECUTE for program.
+#define SESSION_LOG_EV_FLASH_DONE    0x07
+#define SESSION_LOG_EV_OUTCOME       0x08 // arg = SESSION_OUTCOME_*.
+#define SESSION_LOG_EV_INTERVAL      0x09 // connection interval negotiated. arg = interval in 1.25ms units.
+#define SESSION_LOG_EV_PHY           0x0A // PHY changed. arg = the stack's PHY bits.
+
+// 20 bytes, little endian on the air. it is also the control point response, which must stay this small.
+typedef struct
+{
+    uint16_t seq; // counts sessions, across reboots.
+    uint8_t outcome;
+    uint8_t phy; // the stack's PHY bits, 1 is 1M. 0 for a wired session.
+    uint32_t bytes; // object data accepted, the init packet included.
+    uint16_t duration; // from the first request to the end of the session, in 100ms units.
+    uint16_t mtu;
+    uint16_t conn_interval; // the last one negotiated, in 1.25ms units. 0 for a wired session.
+    uint8_t object_retries; // saturates at 255, like packet_drops.
+    uint8_t packet_drops;
+    uint16_t erase_ms; // from the start of a flash job to its commit, including waiting for radio gaps.
+    uint16_t program_ms;
+} SessionRecord_t;
+
+#if SESSION_LOG
+void SessionLog_Init();
+void SessionLog_Event(uint8_t event, uint16_t arg);
+void SessionLog_End();
+uint8_t SessionLog_Read(uint8_t index, SessionRecord_t* pRecord);
+#define SESSION_LOG_EVENT(event, arg)    SessionLog_Event(event, arg)
+#else
+#define SESSION_LOG_EVENT(event, arg)
+#endif
+
+#endif /* SESSION_LOG_H */
@@ -22,9 +22,42 @@
 
 #define SIGNATURE_KEY_ADDR        0x00077F00 - FLASH_ROM_MAX_SIZE
 
-bStatus_t VerifySignature(uint8_t *pData, uint8_t len, uint8_t *pSignature, uint8_t *pKey);
-void InitHash();
-void UpdateHash(const void *data, size_t length);
-bStatus_t VerifyHash(const void *hash);
+// the crypto contexts live in one arena, statically allocated by its owner. its regions are reused by the DFU phases,
+// which never overlap: the init packet is verified first, then the firmware is hashed while streaming, then the hash is verified.
+#define CRYPTO_PHASE_NONE         0x00
+#define CRYPTO_PHASE_VERIFY       0x01 // init packet signature verification.
+#define CRYPTO_PHASE_HASH         0x02 // streaming hash and final hash verification.
+typedef struct
+{
+    uint8_t phase;
+    union
+    {
+        struct
+        {
+            uint8_t key[SIGNATURE_KEY_LEN];
+            uint8_t mac[SIGNATURE_LEN];
+#if SIGNATURE_ALGO == SIG_HMAC256
+            HmacContext context;
+#elif SIGNATURE_ALGO == SIG_CMACAES
+            CmacContext context;
+#endif
+        } verify;
+        struct
+        {
+            Sha256Context context;
+            uint8_t digest[SHA256_DIGEST_SIZE];
+        } hash;
+    };
+} CryptoArena_t;
+// the arena's share of the 14K RAM map, checked at compile time.
+#ifndef CRYPTO_ARENA_BUDGET
+#define CRYPTO_ARENA_BUDGET       1024
+#endif
+
+uint8_t* GetSignatureKeyBuffer(CryptoArena_t *arena);
+bStatus_t VerifySignature(CryptoArena_t *arena, uint8_t *pData, uint8_t len, uint8_t *pSignature, uint8_t *pKey);
+void InitHash(CryptoArena_t *arena);
+void UpdateHash(CryptoArena_t *arena, const void *data, size_t length);
+bStatus_t VerifyHash(CryptoArena_t *arena, const void *hash);
 
 #endif /* SIGNATURE_H */
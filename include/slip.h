@@ -0,0 +1,38 @@
+#ifndef SLIP_H
+#define SLIP_H
+
+
+// this header is shared with the host tools, so it must not depend on the SDK.
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// SLIP framing (RFC 1055) for the wired transports, like Nordic's serial DFU.
+#define SLIP_END                     0xC0
+#define SLIP_ESC                     0xDB
+#define SLIP_ESC_END                 0xDC
+#define SLIP_ESC_ESC                 0xDD
+
+// worst case size of an encoded frame: every byte escaped, plus the END delimiters on both ends.
+#define SLIP_ENCODED_MAX(len)        (2 * (len) + 2)
+
+typedef struct
+{
+    uint8_t* pBuf;
+    uint16_t size;
+    uint16_t len;
+    uint8_t escaped;
+    uint8_t overflow; // the frame did not fit, it is dropped at its END.
+} Slip_Decoder_t;
+
+void Slip_DecoderInit(Slip_Decoder_t* dec, uint8_t* pBuf, uint16_t size);
+uint16_t Slip_Decode(Slip_Decoder_t* dec, uint8_t byte);
+uint16_t Slip_Encode(uint8_t* pDst, const uint8_t* pSrc, uint16_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SLIP_H */
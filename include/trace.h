@@ -0,0 +1,42 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+
+// this header is shared with the host tools, so it must not depend on the SDK.
+#include <stdint.h>
+
+// number of records kept, must be a power of 2. older records are overwritten.
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE              32
+#endif
+
+// trace events. arg8 and arg16 meaning depends on the event.
+#define TRACE_EV_CTRL_POINT          0x01 // control point write. arg8 = opcode, arg16 = length.
+#define TRACE_EV_CTRL_RSP            0x02 // response prepared. arg8 = opcode, arg16 = response code.
+#define TRACE_EV_NOTIFY              0x03 // GATT_Notification returned. arg8 = status, arg16 = length.
+#define TRACE_EV_OBJECT_START        0x04 // first packet of an object. arg8 = object type, arg16 = length.
+#define TRACE_EV_OBJECT_FULL         0x05 // packet completing an object. arg8 = object type, arg16 = object size.
+#define TRACE_EV_PACKET_DROP         0x06 // packet out of bounds or while busy. arg8 = object type, arg16 = length.
+#define TRACE_EV_GAP_STATE           0x07 // GAP role state change. arg8 = new state, arg16 = gap event opcode.
+#define TRACE_EV_TASK                0x08 // main task woken up. arg16 = events.
+#define TRACE_EV_FLASH_DONE          0x09 // flash job committed. arg8 = status, arg16 = opcode of the deferred request.
+#define TRACE_EV_QUEUE_FULL          0x0A // no room in the write queue, or an earlier write had none until the host pinged. the write is dropped. arg8 = kind, arg16 = length.
+
+// 8 bytes, little endian on the air and in dump files.
+typedef struct
+{
+    uint32_t time; // TMOS system clock, in 625us ticks.
+    uint8_t event;
+    uint8_t arg8;
+    uint16_t arg16;
+} TraceRecord_t;
+
+#if TRACE_RING
+void Trace_Record(uint8_t event, uint8_t arg8, uint16_t arg16);
+uint16_t Trace_Read(uint16_t seq, TraceRecord_t* pRecords, uint8_t count, uint16_t* pHead);
+#define TRACE(event, arg8, arg16)    Trace_Record(event, arg8, arg16)
+#else
+#define TRACE(event, arg8, arg16)
+#endif
+
+#endif /* TRACE_H */
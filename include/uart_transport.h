@@ -0,0 +1,38 @@
+#ifndef UART_TRANSPORT_H
+#define UART_TRANSPORT_H
+
+
+#include "config.h"
+#include "peripheral.h"
+#include "OTA_service.h"
+
+// a wired transport for factory programming and bench recovery, on UART1 (PA8 RXD, PA9 TXD).
+// every frame is SLIP encoded and carries exactly what a control point write carries.
+// object data goes in OTA_CTRL_POINT_OPCODE_WRITE frames, which are not answered, like packet writes.
+
+// the divider is Fsys/8/DL, so pick a baud rate that divides 60MHz/8 to be exact. 7.5M/5 = 1.5Mbps.
+#ifndef UART_TRANSPORT_BAUD
+#define UART_TRANSPORT_BAUD          1500000
+#endif
+// largest decoded frame, opcode included. reported by GET_MTU. a WRITE frame of this size carries MTU-1 bytes of data.
+#ifndef UART_TRANSPORT_MTU
+#define UART_TRANSPORT_MTU           (OTA_OBJECT_BUFFER_SIZE + 1)
+#endif
+// bytes buffered between the interrupt and the task, must be a power of 2.
+// at 1.5Mbps this is about 6ms of traffic, way more than one poll period.
+#ifndef UART_TRANSPORT_RX_RING
+#define UART_TRANSPORT_RX_RING       1024
+#endif
+// how often the task drains the ring, in 625us ticks.
+#ifndef UART_TRANSPORT_POLL_TICKS
+#define UART_TRANSPORT_POLL_TICKS    1
+#endif
+
+// called from the TMOS context with every complete frame. the frame is only valid during the call.
+typedef void (*UartTransport_FrameCB_t)(uint8_t* pFrame, uint16_t len);
+
+void UartTransport_Init(uint8_t taskID, uint16_t event, UartTransport_FrameCB_t cb);
+void UartTransport_ProcessEvent();
+void UartTransport_SendRsp(uint8_t opcode, OTA_CtrlPointRsp_t* rsp, OtaRspCode_t rspCode);
+
+#endif /* UART_TRANSPORT_H */
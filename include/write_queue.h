@@ -0,0 +1,59 @@
+#ifndef WRITE_QUEUE_H
+#define WRITE_QUEUE_H
+
+
+#include "config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// GATT writes to the DFU service, copied by the write callback and handled by the main task later.
+// the stack gets its callback back after a copy and goes on with the next packets of the connection event,
+// the CRC, the hash, the flash jobs and the crypto of the control point all run from the task.
+// the write callback is the only one to move head and the task the only one to move tail, like the UART ring,
+// so no locking is needed. an entry is a header and its payload, never split around the end of the ring.
+
+// bytes of the ring, a multiple of 4. 4 packets at the largest MTU, or many more small ones.
+// an entry of more than half the ring may find no room even when it is empty, since it is never split.
+#ifndef WRITE_QUEUE_SIZE
+#define WRITE_QUEUE_SIZE             1024
+#endif
+
+// bytes packets leave free, so the control point writes that follow them still find room.
+#ifndef WRITE_QUEUE_CTRL_RESERVE
+#define WRITE_QUEUE_CTRL_RESERVE     64
+#endif
+
+// entry kinds.
+#define WRITE_QUEUE_WRAP             0x00 // the rest of the ring is unused, the next entry is at 0.
+#define WRITE_QUEUE_PACKET           0x01
+#define WRITE_QUEUE_CTRL_POINT       0x02
+
+// entry flags.
+#define WRITE_QUEUE_FLAG_OVERFLOW    0x01 // writes before this one were dropped, it is answered instead of handled.
+
+typedef struct
+{
+    uint16_t len; // of the payload right after the header.
+    uint8_t kind;
+    uint8_t flags;
+    uint16_t connHandle;
+    uint16_t attrHandle;
+} WriteQueue_Entry_t;
+
+#if WRITE_QUEUE
+#define WRITE_QUEUE_RAM              WRITE_QUEUE_SIZE
+void WriteQueue_Init();
+bStatus_t WriteQueue_Push(uint8_t kind, uint8_t flags, uint16_t connHandle, uint16_t attrHandle, const uint8_t* pValue, uint16_t len);
+WriteQueue_Entry_t* WriteQueue_Peek();
+void WriteQueue_Pop();
+#else
+#define WRITE_QUEUE_RAM              0
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* WRITE_QUEUE_H */
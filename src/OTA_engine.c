@@ -0,0 +1,768 @@
+#include "OTA_engine.h"
+#include "crc.h"
+#include "trace.h"
+#include "mem_watermark.h"
+#include "session_log.h"
+#include "hot_path.h"
+
+
+static bStatus_t OTA_PreValidateCmdObject(OTA_Engine_t* eng, CmdObject_t* obj);
+static OtaRspCode_t OTA_PostValidateImage(OTA_Engine_t* eng);
+static void OTA_HardwareInfo(OTA_CtrlPointRsp_Hardware_t* pHardware);
+static void OTA_ExtError(OTA_Engine_t* eng, uint8_t code, OTA_CtrlPointRsp_Ext_t* pExt);
+static bStatus_t OTA_FirmwareInfo(OTA_Engine_t* eng, uint8_t type, OTA_CtrlPointRsp_Firmware_t* pFirmware);
+static void OTA_SendCapabilities(OTA_Engine_t* eng, uint8_t offset, uint16_t mtu);
+static OtaRspCode_t OTA_ImageDigest(OTA_Engine_t* eng, uint8_t offset, OTA_CtrlPointRsp_Digest_t* pDigest);
+#if STREAM_WRITE
+static uint32_t OTA_StreamFlush(OTA_Engine_t* eng, uint32_t addr, BOOL last);
+
+_Static_assert(OTA_STREAM_WINDOW % FLASH_MIN_WR_SIZE == 0 && OTA_STREAM_WINDOW > FLASH_MIN_WR_SIZE,
+               "the window holds whole flash words and the bytes short of one");
+#endif
+_Static_assert(OTA_CAPS_MAX_LEN <= 0xFF && OTA_RSP_CONTENT_MAX_LEN >= sizeof(OTA_CtrlPointRsp_t),
+               "the descriptor's length and offsets are a byte, and it is the largest response");
+
+void OTA_Engine_Init(OTA_Engine_t* eng, void* port)
+{
+    tmos_memset(eng, 0, sizeof(OTA_Engine_t));
+    eng->currentObject = OTA_CONTROL_POINT_OBJ_TYPE_INVALID;
+    eng->cmdObjectCRC = CRC_INITIAL_VALUE;
+    eng->dataObjectCRC = CRC_INITIAL_VALUE;
+    eng->port = port;
+}
+
+/**
+ * @brief get the part of a response that goes on the air after the 3 header bytes.
+ *
+ * @param opcode the request opcode.
+ * @param rsp the response filled by the engine.
+ * @param ppContent set to the first byte to send.
+ * @return uint16_t length of the content. 0 for opcodes that only return the header.
+ */
+uint16_t OTA_GetRspContent(uint8_t opcode, OtaRspCode_t rspCode, OTA_CtrlPointRsp_t* rsp, uint8_t** ppContent)
+{
+    uint16_t content_len = 0;
+    *ppContent = (uint8_t*)rsp;
+    // an extended error carries its code, any other error only the 3 required bytes.
+    if(rspCode == OTA_RSP_EXT_ERROR)
+    {
+        *ppContent += 2; // skip the 2 paddings
+        return sizeof(OTA_CtrlPointRsp_Ext_t) - 2;
+    }
+    if(rspCode != OTA_RSP_SUCCESS) return 0;
+    switch(opcode)
+    {
+        case OTA_CTRL_POINT_OPCODE_VERSION:
+            content_len = sizeof(OTA_CtrlPointRsp_Version_t);
+            break;
+        case OTA_CTRL_POINT_OPCODE_CRC:
+            content_len = sizeof(OTA_CtrlPointRsp_CRC_t);
+            break;
+        case OTA_CTRL_POINT_OPCODE_SELECT:
+            content_len = sizeof(OTA_CtrlPointRsp_Select_t);
+            break;
+        case OTA_CTRL_POINT_OPCODE_GET_MTU:
+            content_len = sizeof(OTA_CtrlPointRsp_MTU_t);
+            break;
+        case OTA_CTRL_POINT_OPCODE_PING:
+            content_len = sizeof(OTA_CtrlPointRsp_Ping_t);
+            break;
+        case OTA_CTRL_POINT_OPCODE_HW_VERSION:
+            content_len = sizeof(OTA_CtrlPointRsp_Hardware_t);
+            break;
+        case OTA_CTRL_POINT_OPCODE_FW_VERSION:
+            content_len = sizeof(OTA_CtrlPointRsp_Firmware_t) - 3; // we don't need the paddings.
+            *ppContent += 3; // skip the 3 paddings
+            break;
+        case OTA_CTRL_POINT_OPCODE_PERF_STATS:
+            content_len = sizeof(OTA_CtrlPointRsp_Perf_t);
+            break;
+        case OTA_CTRL_POINT_OPCODE_TRACE_DUMP:
+            content_len = sizeof(OTA_CtrlPointRsp_Trace_t);
+            break;
+        case OTA_CTRL_POINT_OPCODE_MEM_USAGE:
+            content_len = sizeof(OTA_CtrlPointRsp_Mem_t);
+            break;
+        case OTA_CTRL_POINT_OPCODE_SESSION_LOG:
+            content_len = sizeof(OTA_CtrlPointRsp_Session_t);
+            break;
+        case OTA_CTRL_POINT_OPCODE_IMAGE_DIGEST:
+            content_len = sizeof(OTA_CtrlPointRsp_Digest_t);
+            break;
+        case OTA_CTRL_POINT_OPCODE_CAPABILITIES:
+            content_len = rsp->caps.len;
+            *ppContent = rsp->caps.pData;
+            break;
+        default:
+            // any other opcode will only return 3 required bytes, no content, so the len is not modified.
+            break;
+    }
+    return content_len;
+}
+
+void OTA_Engine_CtrlPoint(OTA_Engine_t* eng, uint8_t* pValue, uint16_t len)
+{
+    OtaRspCode_t rspCode = OTA_RSP_INSUFFICIENT_RESOURCES;
+    if(len <= 0) return; // guard.
+    uint8_t opcode = pValue[0];
+    uint8_t* pContent = pValue+1;
+    uint32_t size;
+    OTA_CtrlPointRsp_t rsp;
+    uint16_t mtu = OTA_Port_GetMTU(eng);
+    // object data sent as a request, for the transports that only have one channel, like Nordic's serial DFU.
+    // it is handled and left unanswered exactly like a packet characteristic write.
+    if (opcode == OTA_CTRL_POINT_OPCODE_WRITE)
+    {
+        OTA_Engine_Packet(eng, pContent, len - 1);
+        return;
+    }
+    if (opcode != OTA_CTRL_POINT_OPCODE_TRACE_DUMP)
+    {
+        TRACE(TRACE_EV_CTRL_POINT, opcode, len);
+    }
+    if (opcode != OTA_CTRL_POINT_OPCODE_SESSION_LOG)
+    {
+        // reading the log back is not a session of its own.
+        SESSION_LOG_EVENT(SESSION_LOG_EV_REQUEST, mtu);
+    }
+    if (opcode == OTA_CTRL_POINT_OPCODE_ABORT && eng->busy && !eng->abortPending)
+    {
+        // the flash job keeps the object buffer, ABORT is carried out and answered by OTA_Engine_FlashDone.
+        eng->abortPending = TRUE;
+        return;
+    }
+    if (eng->busy)
+    {
+        // the object buffer and the flash are in use until the pending request is answered.
+        rspCode = OTA_RSP_OP_NOT_PERMITTED;
+    }
+    else if (mtu >= sizeof(OTA_CtrlPointRsp_t) + 6)
+    {
+        switch(opcode)
+        {
+            case OTA_CTRL_POINT_OPCODE_VERSION:
+                rsp.version.version = OTA_PROTOCOL_VER;
+                rspCode = OTA_RSP_SUCCESS;
+                break;
+            case OTA_CTRL_POINT_OPCODE_CREATE:
+                eng->currentObject = pContent[0];
+                tmos_memcpy(&size, pContent+1, sizeof(uint32_t));
+                if(size == 0)
+                {
+                    rspCode = OTA_RSP_INV_PARAM;
+                }
+                else if(size > OTA_OBJECT_BUFFER_SIZE)
+                {
+                    // an object can be at most the size of our object buffer, as reported by SELECT.
+                    rspCode = OTA_RSP_INSUFFICIENT_RESOURCES;
+                }
+#if STREAM_WRITE
+                else if(eng->currentObject == OTA_CONTROL_POINT_OBJ_TYPE_CMD && size > sizeof(CmdObject_t))
+                {
+                    // the init packet is received straight into cmdObj.
+                    rspCode = OTA_RSP_INSUFFICIENT_RESOURCES;
+                }
+#endif
+                else if(eng->currentObject == OTA_CONTROL_POINT_OBJ_TYPE_CMD)
+                {
+                    eng->cmdObjectSize = size;
+                    eng->objectBufferOffset = 0; // when creating a new object, we reset the buffer offset because old data is executed (dumped somewhere else.)
+                    rspCode = OTA_RSP_SUCCESS;
+                }
+                else if(eng->currentObject == OTA_CONTROL_POINT_OBJ_TYPE_DATA)
+                {
+                    eng->dataObjectSize = size;
+                    eng->objectBufferOffset = 0;
+                    SESSION_LOG_EVENT(SESSION_LOG_EV_CREATE, 0);
+                    rspCode = OTA_RSP_SUCCESS;
+                }
+                else
+                {
+                    rspCode = OTA_RSP_UNSUPPORTED_TYPE;
+                }
+                break;
+            case OTA_CTRL_POINT_OPCODE_SET_RCPT_NOTI:
+                tmos_memcpy(&eng->receiptPRN, pContent, sizeof(uint16_t));
+                eng->receiptPRNCounter = 0; // we need to reset the counter everytime we update the PRN.
+                rspCode = OTA_RSP_SUCCESS;
+                break;
+            case OTA_CTRL_POINT_OPCODE_CRC:
+                if(eng->currentObject == OTA_CONTROL_POINT_OBJ_TYPE_CMD)
+                {
+                    rsp.crc.offset = eng->cmdObjectOffset;
+                    rsp.crc.crc = eng->cmdObjectCRC;
+                    rspCode = OTA_RSP_SUCCESS;
+                }
+                else if(eng->currentObject == OTA_CONTROL_POINT_OBJ_TYPE_DATA)
+                {
+                    rsp.crc.offset = eng->dataObjectOffset;
+                    rsp.crc.crc = eng->dataObjectCRC;
+                    rspCode = OTA_RSP_SUCCESS;
+                }
+                else
+                {
+                    rspCode = OTA_RSP_INV_OBJECT;
+                }
+
+                break;
+            case OTA_CTRL_POINT_OPCODE_EXECUTE:
+                if (eng->currentObject == OTA_CONTROL_POINT_OBJ_TYPE_CMD)
+                {
+                    // when executing the command object, we finalize and validate it.
+#if !STREAM_WRITE
+                    PERF_BEGIN(PERF_STAGE_MEMCPY);
+                    tmos_memcpy(&eng->cmdObj, eng->objectBuffer, sizeof(CmdObject_t));
+                    PERF_END(PERF_STAGE_MEMCPY);
+#endif
+                    rspCode = OTA_PreValidateCmdObject(eng, &eng->cmdObj);
+                    SESSION_LOG_EVENT(SESSION_LOG_EV_OUTCOME, rspCode == OTA_RSP_SUCCESS ? SESSION_OUTCOME_INTERRUPTED : SESSION_OUTCOME_REJECTED);
+                }
+                else if (eng->currentObject == OTA_CONTROL_POINT_OBJ_TYPE_DATA)
+                {
+#if STREAM_WRITE
+                    // the object is programmed and hashed already, except for the bytes short of a flash word.
+                    // the last object of the image takes those along, so there is nothing to wait for.
+                    SESSION_LOG_EVENT(SESSION_LOG_EV_EXECUTE, 0);
+                    if(eng->dataObjectOffset == eng->cmdObj.bin_size)
+                    {
+                        OTA_StreamFlush(eng, APPLICATION_START_ADDR+eng->dataObjectOffset-eng->streamFill, TRUE);
+                    }
+                    rspCode = eng->streamStatus ? OTA_RSP_EXT_ERROR : OTA_PostValidateImage(eng);
+#else
+                    PERF_BEGIN(PERF_STAGE_HASH);
+                    UpdateHash(&eng->crypto, eng->objectBuffer, eng->objectBufferOffset);
+                    PERF_END(PERF_STAGE_HASH);
+                    // the write to flash is done by the port, we answer once it is committed.
+                    eng->busy = TRUE;
+                    eng->deferredOpcode = opcode;
+                    SESSION_LOG_EVENT(SESSION_LOG_EV_EXECUTE, 0);
+                    SESSION_LOG_EVENT(SESSION_LOG_EV_FLASH_START, opcode);
+                    if(OTA_Port_FlashProgram(eng, APPLICATION_START_ADDR+eng->dataObjectOffset-eng->objectBufferOffset, eng->objectBuffer, eng->objectBufferOffset))
+                    {
+                        eng->busy = FALSE;
+                        rspCode = OTA_RSP_EXT_ERROR;
+                    }
+                    else
+                    {
+                        rspCode = OTA_RSP_DEFERRED;
+                    }
+#endif
+                }
+                else
+                {
+                    rspCode = OTA_RSP_INV_OBJECT;
+                }
+                break;
+            case OTA_CTRL_POINT_OPCODE_SELECT:
+                if(pContent[0] == OTA_CONTROL_POINT_OBJ_TYPE_CMD)
+                {
+                    rsp.select.offset = eng->cmdObjectOffset;
+                    eng->cmdObjectCRC = CRC_INITIAL_VALUE; // we initialize CRC when we select.
+                    rsp.select.crc = eng->cmdObjectCRC;
+                    rsp.select.max_size = OTA_OBJECT_BUFFER_SIZE; // each object can be at max the length of our object buffer.
+                    rspCode = OTA_RSP_SUCCESS;
+                }
+                else if(pContent[0] == OTA_CONTROL_POINT_OBJ_TYPE_DATA)
+                {
+                    rsp.select.offset = eng->dataObjectOffset;
+                    eng->dataObjectCRC = CRC_INITIAL_VALUE;
+                    rsp.select.crc = eng->dataObjectCRC;
+                    rsp.select.max_size = OTA_OBJECT_BUFFER_SIZE;
+                    InitHash(&eng->crypto);
+#if STREAM_WRITE
+                    eng->streamFill = 0;
+                    eng->streamStatus = SUCCESS;
+#endif
+                    // we need to erase the corresponding flash region to prepare for the write.
+                    // the response is kept until the port is done with it.
+                    eng->busy = TRUE;
+                    eng->deferredOpcode = opcode;
+                    tmos_memcpy(&eng->deferredRsp, &rsp, sizeof(OTA_CtrlPointRsp_t));
+                    SESSION_LOG_EVENT(SESSION_LOG_EV_FLASH_START, opcode);
+                    if(OTA_Port_FlashErase(eng, APPLICATION_START_ADDR, APPLICATION_MAX_SIZE))
+                    {
+                        eng->busy = FALSE;
+                        rspCode = OTA_RSP_EXT_ERROR;
+                    }
+                    else
+                    {
+                        rspCode = OTA_RSP_DEFERRED;
+                    }
+                }
+                else
+                {
+                    rspCode = OTA_RSP_UNSUPPORTED_TYPE;
+                }
+                break;
+            case OTA_CTRL_POINT_OPCODE_GET_MTU:
+                rsp.mtu.size = mtu;
+                rspCode = OTA_RSP_SUCCESS;
+                break;
+            case OTA_CTRL_POINT_OPCODE_PING:
+                rsp.ping.id = pContent[0];
+                rspCode = OTA_RSP_SUCCESS;
+                break;
+            case OTA_CTRL_POINT_OPCODE_HW_VERSION:
+                OTA_HardwareInfo(&rsp.hardware);
+                rspCode = OTA_RSP_SUCCESS;
+                break;
+            case OTA_CTRL_POINT_OPCODE_FW_VERSION:
+                rspCode = OTA_FirmwareInfo(eng, pContent[0], &rsp.firmware) ? OTA_RSP_INV_PARAM : OTA_RSP_SUCCESS;
+                break;
+            case OTA_CTRL_POINT_OPCODE_CAPABILITIES:
+                // request is the byte offset into the descriptor. it is answered from its own buffer.
+                OTA_SendCapabilities(eng, pContent[0], mtu);
+                return;
+            case OTA_CTRL_POINT_OPCODE_ABORT:
+                // drop the session, the host starts over with SELECT like on a new connection.
+                OTA_Engine_Init(eng, eng->port);
+                rspCode = OTA_RSP_SUCCESS;
+                break;
+            case OTA_CTRL_POINT_OPCODE_IMAGE_DIGEST:
+                // request is the offset into the digest.
+                rspCode = OTA_ImageDigest(eng, pContent[0], &rsp.digest);
+                break;
+#if PERF_COUNTERS
+            case OTA_CTRL_POINT_OPCODE_PERF_STATS:
+                // request is the stage index, optionally followed by a non zero byte to reset all counters after reading.
+                if(Perf_Get(pContent[0], &rsp.perf))
+                {
+                    rspCode = OTA_RSP_INV_PARAM;
+                }
+                else
+                {
+                    if(len > 2 && pContent[1]) Perf_Reset();
+                    rspCode = OTA_RSP_SUCCESS;
+                }
+                break;
+#endif
+#if TRACE_RING
+            case OTA_CTRL_POINT_OPCODE_TRACE_DUMP:
+                // request is the sequence number of the first record wanted.
+                tmos_memcpy(&rsp.trace.seq, pContent, sizeof(uint16_t));
+                rsp.trace.seq = Trace_Read(rsp.trace.seq, rsp.trace.records, OTA_TRACE_RSP_RECORDS, &rsp.trace.head);
+                rspCode = OTA_RSP_SUCCESS;
+                break;
+#endif
+#if MEM_WATERMARK
+            case OTA_CTRL_POINT_OPCODE_MEM_USAGE:
+                rsp.mem.stack_size = MemWatermark_StackSize();
+                rsp.mem.stack_used = MemWatermark_StackUsed();
+                rsp.mem.heap_size = BLE_MEMHEAP_SIZE;
+                rsp.mem.heap_used = MemWatermark_HeapUsed();
+                rspCode = OTA_RSP_SUCCESS;
+                break;
+#endif
+#if SESSION_LOG
+            case OTA_CTRL_POINT_OPCODE_SESSION_LOG:
+                // request is the index of the record wanted, 0 is the newest.
+                rspCode = SessionLog_Read(pContent[0], &rsp.session) ? OTA_RSP_INV_PARAM : OTA_RSP_SUCCESS;
+                break;
+#endif
+            default:
+                rspCode = OTA_RSP_INV_CODE;
+                break;
+        }
+    }
+
+    // every extended error of a request is a flash error.
+    if (rspCode == OTA_RSP_EXT_ERROR)
+    {
+        OTA_ExtError(eng, OTA_EXT_FLASH_ERROR, &rsp.ext);
+    }
+    // deferred requests are answered from OTA_Engine_FlashDone.
+    if (rspCode != OTA_RSP_DEFERRED)
+    {
+        OTA_Port_SendRsp(eng, opcode, &rsp, rspCode);
+    }
+}
+
+/**
+ * @brief called by the port once the flash job started by a deferred request is committed.
+ *
+ * @param eng the engine.
+ * @param status 0 on success, the flash driver's error otherwise.
+ */
+void OTA_Engine_FlashDone(OTA_Engine_t* eng, uint8_t status)
+{
+    OtaRspCode_t rspCode = status ? OTA_RSP_EXT_ERROR : OTA_RSP_SUCCESS;
+    TRACE(TRACE_EV_FLASH_DONE, status, eng->deferredOpcode);
+    SESSION_LOG_EVENT(SESSION_LOG_EV_FLASH_DONE, status);
+    if(status)
+    {
+        SESSION_LOG_EVENT(SESSION_LOG_EV_OUTCOME, SESSION_OUTCOME_FLASH_ERROR);
+    }
+    eng->busy = FALSE;
+    // do post validation, unless the object never made it to the flash.
+    if(rspCode == OTA_RSP_SUCCESS && eng->deferredOpcode == OTA_CTRL_POINT_OPCODE_EXECUTE)
+    {
+        rspCode = OTA_PostValidateImage(eng);
+    }
+    if(rspCode == OTA_RSP_EXT_ERROR) OTA_ExtError(eng, OTA_EXT_FLASH_ERROR, &eng->deferredRsp.ext);
+    OTA_Port_SendRsp(eng, eng->deferredOpcode, &eng->deferredRsp, rspCode);
+    if(eng->abortPending)
+    {
+        // answered after the job, in the order the host asked.
+        OTA_CtrlPointRsp_t rsp;
+        OTA_Engine_Init(eng, eng->port);
+        OTA_Port_SendRsp(eng, OTA_CTRL_POINT_OPCODE_ABORT, &rsp, OTA_RSP_SUCCESS);
+    }
+}
+
+/**
+ * @brief answer a control point request without handling it, because writes before it were dropped by the port.
+ *        the host learns where the current object stands and sends the rest of it again from there.
+ *        the port keeps dropping writes until the host has seen this, see the port's write queue.
+ *
+ * @param eng the engine.
+ * @param opcode the request's opcode.
+ */
+void OTA_Engine_Dropped(OTA_Engine_t* eng, uint8_t opcode)
+{
+    OTA_CtrlPointRsp_t rsp;
+    OTA_ExtError(eng, OTA_EXT_DATA_DROPPED, &rsp.ext);
+    OTA_Port_SendRsp(eng, opcode, &rsp, OTA_RSP_EXT_ERROR);
+}
+
+/**
+ * @brief fill in an extended error, with the current object's offset and crc.
+ *
+ * @param eng the engine.
+ * @param code OTA_EXT_*.
+ * @param pExt where to fill it in.
+ */
+static void OTA_ExtError(OTA_Engine_t* eng, uint8_t code, OTA_CtrlPointRsp_Ext_t* pExt)
+{
+    pExt->code = code;
+    pExt->type = eng->currentObject;
+    pExt->offset = 0;
+    pExt->crc = CRC_INITIAL_VALUE;
+    if(eng->currentObject == OTA_CONTROL_POINT_OBJ_TYPE_CMD)
+    {
+        pExt->offset = eng->cmdObjectOffset;
+        pExt->crc = eng->cmdObjectCRC;
+    }
+    else if(eng->currentObject == OTA_CONTROL_POINT_OBJ_TYPE_DATA)
+    {
+        pExt->offset = eng->dataObjectOffset;
+        pExt->crc = eng->dataObjectCRC;
+    }
+}
+
+/**
+ * @brief fill in the HW_VERSION report.
+ *
+ * @param pHardware where to fill it in.
+ */
+static void OTA_HardwareInfo(OTA_CtrlPointRsp_Hardware_t* pHardware)
+{
+    pHardware->part = HARDWARE_VERSION;
+    pHardware->variant = HARDWARE_VARIANT;
+    pHardware->memory.rom_size = CH571_ROM_SIZE;
+    pHardware->memory.ram_size = CH57x_RAM_SIZE;
+    pHardware->memory.rom_page_size = EEPROM_PAGE_SIZE;
+}
+
+/**
+ * @brief fill in the FW_VERSION report of one firmware.
+ *
+ * @param eng the engine.
+ * @param type one of OTA_FW_TYPE_*.
+ * @param pFirmware where to fill it in.
+ * @return bStatus_t 0 = success. !0 = unknown type.
+ */
+static bStatus_t OTA_FirmwareInfo(OTA_Engine_t* eng, uint8_t type, OTA_CtrlPointRsp_Firmware_t* pFirmware)
+{
+    __attribute__((aligned(4))) ImageInfo_t info;
+    pFirmware->type = type;
+    switch(type)
+    {
+        case OTA_FW_TYPE_BLE_LIB:
+        pFirmware->version = OTA_Port_LibVersion(eng);
+        pFirmware->addr = LIB_FLASH_BASE_ADDRESSS;
+        pFirmware->len = LIB_FLASH_MAX_SIZE;
+        break;
+        case OTA_FW_TYPE_APPLICATION:
+        // 0 until the bootloader has installed an application.
+        pFirmware->version = OTA_Port_ReadImageInfo(eng, &info) ? 0 : info.app_version;
+        pFirmware->addr = APPLICATION_START_ADDR;
+        pFirmware->len = APPLICATION_MAX_SIZE;
+        break;
+        case OTA_FW_TYPE_BOOTLOADER:
+        pFirmware->version = BOOTLOADER_VERSION;
+        pFirmware->addr = BOOTLOADER_START_ADDR;
+        pFirmware->len = BOOTLOADER_MAX_SIZE;
+        break;
+        default:
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief fill in the IMAGE_DIGEST report. kept out of line, so the image info is only on the stack for this request
+ *        and not in the frame of every control point write.
+ *
+ * @param eng the engine.
+ * @param offset into the digest.
+ * @param pDigest where to fill it in.
+ * @return OtaRspCode_t the response code.
+ */
+static __attribute__((noinline)) OtaRspCode_t OTA_ImageDigest(OTA_Engine_t* eng, uint8_t offset, OTA_CtrlPointRsp_Digest_t* pDigest)
+{
+    __attribute__((aligned(4))) ImageInfo_t info;
+    if(offset > IMAGE_INFO_DIGEST_LEN - OTA_DIGEST_RSP_LEN) return OTA_RSP_INV_PARAM;
+    if(OTA_Port_ReadImageInfo(eng, &info)) return OTA_RSP_INV_OBJECT;
+    pDigest->version = info.app_version;
+    tmos_memcpy(pDigest->digest, info.app_digest + offset, OTA_DIGEST_RSP_LEN);
+    return OTA_RSP_SUCCESS;
+}
+
+/**
+ * @brief append one record to the capability descriptor.
+ *
+ * @return uint8_t* where the next record goes.
+ */
+static uint8_t* OTA_CapRecord(uint8_t* p, uint8_t tag, void* pValue, uint8_t len)
+{
+    p[0] = tag;
+    p[1] = len;
+    tmos_memcpy(p + 2, pValue, len);
+    return p + 2 + len;
+}
+
+/**
+ * @brief answer CAPABILITIES. the descriptor is built on every request, so the object state in it is current.
+ *
+ * @param eng the engine.
+ * @param offset the byte offset into the descriptor the host asks for.
+ * @param mtu the response is cut to fit it.
+ */
+static void OTA_SendCapabilities(OTA_Engine_t* eng, uint8_t offset, uint16_t mtu)
+{
+    // the total length goes right before the part sent.
+    uint8_t* caps = eng->caps;
+    uint8_t* p = caps + 1;
+    OTA_CtrlPointRsp_t rsp;
+    OTA_Cap_Modes_t modes;
+    OTA_Cap_Object_t object;
+    uint32_t maxObject = OTA_OBJECT_BUFFER_SIZE;
+    uint8_t version = OTA_PROTOCOL_VER;
+    uint8_t total;
+
+    p = OTA_CapRecord(p, OTA_CAP_PROTOCOL, &version, sizeof(version));
+    OTA_HardwareInfo(&rsp.hardware);
+    p = OTA_CapRecord(p, OTA_CAP_HARDWARE, &rsp.hardware, sizeof(OTA_CtrlPointRsp_Hardware_t));
+    for(uint8_t type = OTA_FW_TYPE_BLE_LIB; type <= OTA_FW_TYPE_BOOTLOADER; type++)
+    {
+        OTA_FirmwareInfo(eng, type, &rsp.firmware);
+        p = OTA_CapRecord(p, OTA_CAP_FIRMWARE, &rsp.firmware.type, sizeof(OTA_CtrlPointRsp_Firmware_t) - 3);
+    }
+    p = OTA_CapRecord(p, OTA_CAP_MAX_OBJECT, &maxObject, sizeof(maxObject));
+    p = OTA_CapRecord(p, OTA_CAP_MTU, &mtu, sizeof(mtu));
+
+    modes.signature = SIGNATURE_ALGO;
+    modes.compression = 0;
+    modes.transports = OTA_CAP_TRANSPORT_GATT;
+#if UART_TRANSPORT
+    modes.transports |= OTA_CAP_TRANSPORT_UART;
+#endif
+#if L2CAP_TRANSPORT
+    modes.transports |= OTA_CAP_TRANSPORT_L2CAP;
+#endif
+    modes.features = 0;
+#if STREAM_WRITE
+    modes.features |= OTA_CAP_FEATURE_STREAM_WRITE;
+#endif
+#if SESSION_LOG
+    modes.features |= OTA_CAP_FEATURE_SESSION_LOG;
+#endif
+#if PERF_COUNTERS
+    modes.features |= OTA_CAP_FEATURE_PERF_COUNTERS;
+#endif
+#if TRACE_RING
+    modes.features |= OTA_CAP_FEATURE_TRACE_RING;
+#endif
+#if MEM_WATERMARK
+    modes.features |= OTA_CAP_FEATURE_MEM_WATERMARK;
+#endif
+    p = OTA_CapRecord(p, OTA_CAP_MODES, &modes, sizeof(modes));
+
+    // the crc is the running one, unlike SELECT nothing is reset. a host that finds it untouched can skip SELECT.
+    object.type = OTA_CONTROL_POINT_OBJ_TYPE_CMD;
+    object.offset = eng->cmdObjectOffset;
+    object.crc = eng->cmdObjectCRC;
+    p = OTA_CapRecord(p, OTA_CAP_OBJECT, &object.type, sizeof(OTA_Cap_Object_t) - 3);
+    object.type = OTA_CONTROL_POINT_OBJ_TYPE_DATA;
+    object.offset = eng->dataObjectOffset;
+    object.crc = eng->dataObjectCRC;
+    p = OTA_CapRecord(p, OTA_CAP_OBJECT, &object.type, sizeof(OTA_Cap_Object_t) - 3);
+
+    total = p - (caps + 1);
+    if(offset > total)
+    {
+        OTA_Port_SendRsp(eng, OTA_CTRL_POINT_OPCODE_CAPABILITIES, &rsp, OTA_RSP_INV_PARAM);
+        return;
+    }
+    caps[offset] = total;
+    rsp.caps.pData = caps + offset;
+    // 3 bytes of notification header, 3 of response header and the total.
+    rsp.caps.len = 1 + (total - offset < mtu - 7 ? total - offset : mtu - 7);
+    OTA_Port_SendRsp(eng, OTA_CTRL_POINT_OPCODE_CAPABILITIES, &rsp, OTA_RSP_SUCCESS);
+}
+
+/**
+ * @brief once a data object is in flash, check the image if it was the last one and hand over to it.
+ *
+ * @return OtaRspCode_t the response to the EXECUTE.
+ */
+static OtaRspCode_t OTA_PostValidateImage(OTA_Engine_t* eng)
+{
+    if(eng->dataObjectOffset != eng->cmdObj.bin_size) return OTA_RSP_SUCCESS;
+    PERF_BEGIN(PERF_STAGE_HASH);
+    bStatus_t hashStatus = VerifyHash(&eng->crypto, eng->cmdObj.fw_hash);
+    PERF_END(PERF_STAGE_HASH);
+    if(hashStatus != SUCCESS)
+    {
+        SESSION_LOG_EVENT(SESSION_LOG_EV_OUTCOME, SESSION_OUTCOME_HASH_FAILED);
+        return OTA_RSP_OP_FAILED;
+    }
+    // before the port hands over, it closes the session.
+    SESSION_LOG_EVENT(SESSION_LOG_EV_OUTCOME, SESSION_OUTCOME_UPDATED);
+    OTA_Port_Finish(eng);
+    return OTA_RSP_SUCCESS;
+}
+
+#if STREAM_WRITE
+/**
+ * @brief hash and program the whole flash words in the stream window, the bytes short of a word move to its front.
+ *
+ * @param eng the engine.
+ * @param addr flash address of the first byte in the window.
+ * @param last the end of the image. the bytes short of a word are padded as erased and programmed as well.
+ * @return uint32_t flash address of the first byte left in the window.
+ */
+OTA_HOT_CODE static uint32_t OTA_StreamFlush(OTA_Engine_t* eng, uint32_t addr, BOOL last)
+{
+    uint16_t fill = eng->streamFill;
+    uint16_t len = fill & ~(FLASH_MIN_WR_SIZE - 1);
+    if(last && len < fill)
+    {
+        len += FLASH_MIN_WR_SIZE;
+        tmos_memset(eng->streamBuffer + fill, 0xFF, len - fill);
+    }
+    if(len == 0) return addr;
+    // the padding is not part of the image. the hash sees the same bytes in the same order as with an object buffer.
+    uint16_t data = len < fill ? len : fill;
+    PERF_BEGIN(PERF_STAGE_HASH);
+    UpdateHash(&eng->crypto, eng->streamBuffer, data);
+    PERF_END(PERF_STAGE_HASH);
+    // after a flash error nothing more is programmed, the host only learns about it from the next EXECUTE.
+    if(eng->streamStatus == SUCCESS)
+    {
+        PERF_BEGIN(PERF_STAGE_PROGRAM);
+        eng->streamStatus = OTA_Port_FlashWrite(eng, addr, eng->streamBuffer, len);
+        PERF_END(PERF_STAGE_PROGRAM);
+        if(eng->streamStatus)
+        {
+            TRACE(TRACE_EV_FLASH_DONE, eng->streamStatus, OTA_CTRL_POINT_OPCODE_WRITE);
+            SESSION_LOG_EVENT(SESSION_LOG_EV_OUTCOME, SESSION_OUTCOME_FLASH_ERROR);
+        }
+    }
+    // less than a word is left, and a word or more was just taken from the front, so the copy never overlaps.
+    eng->streamFill = fill - data;
+    tmos_memcpy(eng->streamBuffer, eng->streamBuffer + data, eng->streamFill);
+    return addr + len;
+}
+
+/**
+ * @brief take a data packet through the stream window to the flash.
+ */
+OTA_HOT_CODE static void OTA_StreamPacket(OTA_Engine_t* eng, uint8_t* pValue, uint16_t len)
+{
+    uint32_t addr = APPLICATION_START_ADDR + eng->dataObjectOffset - eng->streamFill;
+    while(len)
+    {
+        uint16_t n = OTA_STREAM_WINDOW - eng->streamFill;
+        if(n > len) n = len;
+        PERF_BEGIN(PERF_STAGE_CRC);
+        eng->dataObjectCRC = update_CRC32_copy(eng->dataObjectCRC, eng->streamBuffer+eng->streamFill, pValue, n);
+        PERF_END(PERF_STAGE_CRC);
+        eng->streamFill += n;
+        pValue += n;
+        len -= n;
+        addr = OTA_StreamFlush(eng, addr, FALSE);
+    }
+}
+#endif
+
+OTA_HOT_CODE void OTA_Engine_Packet(OTA_Engine_t* eng, uint8_t* pValue, uint16_t len)
+{
+    // the object buffer belongs to the flash job until the pending request is answered.
+    // the packet must also fit both the object announced by CREATE and the buffer, otherwise it is dropped.
+    // the host will notice the offset mismatch on the next CRC request.
+    uint32_t end = eng->objectBufferOffset + len;
+    uint32_t size = 0; // nothing is accepted without a valid object.
+    if(eng->currentObject == OTA_CONTROL_POINT_OBJ_TYPE_CMD) size = eng->cmdObjectSize;
+    else if(eng->currentObject == OTA_CONTROL_POINT_OBJ_TYPE_DATA) size = eng->dataObjectSize;
+    if(eng->busy || end > OTA_OBJECT_BUFFER_SIZE || end > size)
+    {
+        TRACE(TRACE_EV_PACKET_DROP, eng->currentObject, len);
+        SESSION_LOG_EVENT(SESSION_LOG_EV_DROP, len);
+        return;
+    }
+    if(eng->objectBufferOffset == 0)
+    {
+        TRACE(TRACE_EV_OBJECT_START, eng->currentObject, len);
+    }
+    if(end == size)
+    {
+        TRACE(TRACE_EV_OBJECT_FULL, eng->currentObject, end);
+    }
+    SESSION_LOG_EVENT(SESSION_LOG_EV_PACKET, len);
+    // in order to save calculation cycles, we update the crc value while we are copying the object.
+    if(eng->currentObject == OTA_CONTROL_POINT_OBJ_TYPE_CMD)
+    {
+        PERF_BEGIN(PERF_STAGE_CRC);
+#if STREAM_WRITE
+        eng->cmdObjectCRC = update_CRC32_copy(eng->cmdObjectCRC, (uint8_t*)&eng->cmdObj+eng->objectBufferOffset, pValue, len);
+#else
+        eng->cmdObjectCRC = update_CRC32_copy(eng->cmdObjectCRC, eng->objectBuffer+eng->objectBufferOffset, pValue, len);
+#endif
+        PERF_END(PERF_STAGE_CRC);
+        eng->objectBufferOffset = end;
+        eng->cmdObjectOffset += len;
+    }
+    else
+    {
+#if STREAM_WRITE
+        OTA_StreamPacket(eng, pValue, len);
+#else
+        PERF_BEGIN(PERF_STAGE_CRC);
+        eng->dataObjectCRC = update_CRC32_copy(eng->dataObjectCRC, eng->objectBuffer+eng->objectBufferOffset, pValue, len);
+        PERF_END(PERF_STAGE_CRC);
+#endif
+        eng->objectBufferOffset = end;
+        eng->dataObjectOffset += len;
+    }
+}
+
+static bStatus_t OTA_PreValidateCmdObject(OTA_Engine_t* eng, CmdObject_t* obj)
+{
+    bStatus_t result = OTA_RSP_SUCCESS;
+    // the key goes to the crypto arena instead of our small stack.
+    uint8_t* key = GetSignatureKeyBuffer(&eng->crypto);
+    __attribute__((aligned(4))) EEPROM_Data_t data;
+    OTA_Port_ReadKey(eng, key);
+    OTA_Port_ReadData(eng, &data);
+    PERF_BEGIN(PERF_STAGE_SIGNATURE);
+    bStatus_t sigStatus = VerifySignature(&eng->crypto, (uint8_t*)obj, sizeof(CmdObject_t) - SIGNATURE_LEN, obj->obj_signature, key);
+    PERF_END(PERF_STAGE_SIGNATURE);
+    if(sigStatus) result = OTA_RSP_OP_FAILED;
+    else if(obj->lib_version > OTA_Port_LibVersion(eng)) result = OTA_RSP_OP_FAILED;
+    else if(obj->hw_version != HARDWARE_VERSION) result = OTA_RSP_OP_FAILED;
+    else if(obj->type != OTA_FW_TYPE_BOOTLOADER && obj->type != OTA_FW_TYPE_APPLICATION) result = OTA_RSP_OP_FAILED; // we only support uploading bootloader or app.
+    else if(obj->type == OTA_FW_TYPE_BOOTLOADER && (obj->bin_size > BOOTLOADER_MAX_SIZE || (!obj->is_debug && obj->fw_version <= data.bl_version))) result = OTA_RSP_OP_FAILED;
+    else if(obj->type == OTA_FW_TYPE_APPLICATION && (obj->bin_size > APPLICATION_MAX_SIZE || (!obj->is_debug && obj->fw_version <= data.app_version))) result = OTA_RSP_OP_FAILED;
+    return result;
+}
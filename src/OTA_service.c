@@ -1,5 +1,8 @@
 #include "HAL.h"
 #include "OTA_service.h"
+#include "OTA_engine.h"
+#include "gatt_record.h"
+#include "hot_path.h"
 
 
 // OTA Service UUID.
@@ -20,6 +23,11 @@ static uint8_t OTA_PacketUserDesp[11] = "DFU Packet";
 static gattCharCfg_t OTA_PacketClientCharCfg[PERIPHERAL_MAX_CONNECTION];
 
 // Profile Attributes Table.
+// indexes of the attributes we look up by handle. keep them in sync with the table below.
+#define OTA_CTRL_POINT_VALUE_IDX    2
+#define OTA_CTRL_POINT_CCC_IDX      4
+#define OTA_PACKET_VALUE_IDX        6
+#define OTA_PACKET_CCC_IDX          8
 static gattAttribute_t OTAServiceAttrTable[9] = {
     // OTA Service declaration
     {
@@ -96,43 +104,39 @@ static gattAttribute_t OTAServiceAttrTable[9] = {
 
 // application callbacks.
 static OTA_WriteCharCBs_t* OTA_WriteCharCBs;
-static bStatus_t OTAService_WriteAttrCB(uint16_t connHandle, gattAttribute_t *pAttr, uint8_t *pValue, uint16_t len, uint16_t offset, uint8_t method)
+static OTA_PacketSink_t OTA_PacketSink;
+// attribute handles are assigned when the service is registered. we dispatch on them instead of comparing uuids.
+static uint16_t OTA_CtrlPointHandle = 0;
+static uint16_t OTA_PacketHandle = 0;
+OTA_HOT_CODE static bStatus_t OTAService_WriteAttrCB(uint16_t connHandle, gattAttribute_t *pAttr, uint8_t *pValue, uint16_t len, uint16_t offset, uint8_t method)
 {
     bStatus_t status = ATT_ERR_ATTR_NOT_FOUND;
-    if(pAttr->type.len == ATT_UUID_SIZE)
+    uint16_t handle = pAttr->handle;
+    PERF_BEGIN(PERF_STAGE_WRITE_CB);
+    // packets come first because they are by far the most frequent writes.
+    if(handle == OTA_PacketHandle)
     {
-        if (tmos_memcmp(pAttr->type.uuid, OTA_CtrlPointUUID, ATT_UUID_SIZE) == 1)
+        GATT_RECORD_WRITE(connHandle, GATT_RECORD_KIND_PACKET, pValue, len);
+        if(OTA_PacketSink)
         {
-            if(OTA_WriteCharCBs && OTA_WriteCharCBs->ctrlPointCb)
-            {
-                OTA_WriteCharCBs->ctrlPointCb(connHandle, pAttr->handle, pValue, len);
-            }
-            status = SUCCESS;
-        }
-        else if (tmos_memcmp(pAttr->type.uuid, OTA_PacketUUID, ATT_UUID_SIZE) == 1)
-        {
-            if(OTA_WriteCharCBs && OTA_WriteCharCBs->packetCb)
-            {
-                OTA_WriteCharCBs->packetCb(connHandle, pAttr->handle, pValue, len);
-            }
-            status = SUCCESS;
+            OTA_PacketSink(connHandle, pValue, len);
         }
+        status = SUCCESS;
     }
-    else if(pAttr->type.len == ATT_BT_UUID_SIZE)
+    else if(handle == OTA_CtrlPointHandle)
     {
-        uint16_t uuid = BUILD_UINT16(pAttr->type.uuid[0], pAttr->type.uuid[1]);
-        switch(uuid)
+        GATT_RECORD_WRITE(connHandle, GATT_RECORD_KIND_CTRL_POINT, pValue, len);
+        if(OTA_WriteCharCBs && OTA_WriteCharCBs->ctrlPointCb)
         {
-            case GATT_CLIENT_CHAR_CFG_UUID:
-                if(pAttr->handle == OTAServiceAttrTable[4].handle || pAttr->handle == OTAServiceAttrTable[8].handle)
-                {
-                    status = GATTServApp_ProcessCCCWriteReq(connHandle, pAttr, pValue, len, offset, GATT_CLIENT_CFG_NOTIFY);
-                }
-                break;
-            default:
-                break;
+            OTA_WriteCharCBs->ctrlPointCb(connHandle, handle, pValue, len);
         }
+        status = SUCCESS;
+    }
+    else if(handle == OTAServiceAttrTable[OTA_CTRL_POINT_CCC_IDX].handle || handle == OTAServiceAttrTable[OTA_PACKET_CCC_IDX].handle)
+    {
+        status = GATTServApp_ProcessCCCWriteReq(connHandle, pAttr, pValue, len, offset, GATT_CLIENT_CFG_NOTIFY);
     }
+    PERF_END(PERF_STAGE_WRITE_CB);
     return status;
 }
 static gattServiceCBs_t OTAServiceCBs = {
@@ -161,6 +165,8 @@ bStatus_t OTA_AddService()
                                             GATT_NUM_ATTRS(OTAServiceAttrTable),
                                             GATT_MAX_ENCRYPT_KEY_SIZE,
                                             &OTAServiceCBs);
+    OTA_CtrlPointHandle = OTAServiceAttrTable[OTA_CTRL_POINT_VALUE_IDX].handle;
+    OTA_PacketHandle = OTAServiceAttrTable[OTA_PACKET_VALUE_IDX].handle;
     return (status);
 }
 
@@ -169,6 +175,11 @@ void OTA_RegisterWriteCharCBs(OTA_WriteCharCBs_t* cbs)
     OTA_WriteCharCBs = cbs;
 }
 
+void OTA_RegisterPacketSink(OTA_PacketSink_t sink)
+{
+    OTA_PacketSink = sink;
+}
+
 
 // static variables used only by these two functions.
 static uint16_t CtrlPoint_ConnHandle = 0;
@@ -178,44 +189,14 @@ void OTA_SetupCtrlPointRsp(uint16_t connHandle, uint16_t attrHandle, uint8_t opc
 {
     CtrlPoint_ConnHandle = connHandle;
     CtrlPoint_Noti.handle = attrHandle;
-    // only length varies based on opcode. defaults to 0.
-    uint16_t content_len = 0;
-    uint8_t* content = (uint8_t*)rsp;
-    if (rspCode == OTA_RSP_SUCCESS)
+    // reading the trace should not fill the trace.
+    if (opcode != OTA_CTRL_POINT_OPCODE_TRACE_DUMP)
     {
-        switch(opcode)
-        {
-            case OTA_CTRL_POINT_OPCODE_VERSION:
-                content_len = sizeof(OTA_CtrlPointRsp_Version_t);
-                break;
-            case OTA_CTRL_POINT_OPCODE_CRC:
-                content_len = sizeof(OTA_CtrlPointRsp_CRC_t);
-                break;
-            case OTA_CTRL_POINT_OPCODE_SELECT:
-                content_len = sizeof(OTA_CtrlPointRsp_Select_t);
-                break;
-            case OTA_CTRL_POINT_OPCODE_GET_MTU:
-                content_len = sizeof(OTA_CtrlPointRsp_MTU_t);
-                break;
-            case OTA_CTRL_POINT_OPCODE_WRITE:
-                // TODO.
-                content_len = 0;
-                break;
-            case OTA_CTRL_POINT_OPCODE_PING:
-                content_len = sizeof(OTA_CtrlPointRsp_Ping_t);
-                break;
-            case OTA_CTRL_POINT_OPCODE_HW_VERSION:
-                content_len = sizeof(OTA_CtrlPointRsp_Hardware_t);
-                break;
-            case OTA_CTRL_POINT_OPCODE_FW_VERSION:
-                content_len = sizeof(OTA_CtrlPointRsp_Firmware_t) - 3; // we don't need the paddings.
-                content += 3; // skip the 3 paddings
-                break;
-            default:
-                // any other opcode will only return 3 required bytes, no content, so the len is not modified.
-                break;
-        }
+        TRACE(TRACE_EV_CTRL_RSP, opcode, rspCode);
     }
+    // only length varies based on opcode and response code.
+    uint8_t* content;
+    uint16_t content_len = OTA_GetRspContent(opcode, rspCode, rsp, &content);
     
     // we can allocate memory and copy here because everyone does the same thing.
     // we need to allocate 3 more bytes because we need to insert 0x60(response opcode), request opcode, and the response code.
@@ -228,7 +209,9 @@ void OTA_SetupCtrlPointRsp(uint16_t connHandle, uint16_t attrHandle, uint8_t opc
         CtrlPoint_Noti.pValue[2] = rspCode;
         if (content_len)
         {
+            PERF_BEGIN(PERF_STAGE_MEMCPY);
             tmos_memcpy(CtrlPoint_Noti.pValue+3, content, content_len);
+            PERF_END(PERF_STAGE_MEMCPY);
         }
     }
 }
@@ -236,13 +219,22 @@ void OTA_SetupCtrlPointRsp(uint16_t connHandle, uint16_t attrHandle, uint8_t opc
 bStatus_t OTA_DispatchCtrlPointRsp()
 {
     bStatus_t status = bleIncorrectMode;
+    // the allocation failed, nothing to send.
+    if(CtrlPoint_Noti.pValue == NULL) return bleMemAllocError;
     if(GATTServApp_ReadCharCfg(CtrlPoint_ConnHandle, OTA_CtrlPointClientCharCfg))
     {
+        // the stack owns the buffer once it is sent, so it is recorded before.
+        GATT_RECORD_WRITE(CtrlPoint_ConnHandle, GATT_RECORD_KIND_RSP, CtrlPoint_Noti.pValue, CtrlPoint_Noti.len);
+        PERF_BEGIN(PERF_STAGE_NOTIFY);
         status = GATT_Notification(CtrlPoint_ConnHandle, &CtrlPoint_Noti, FALSE);
-        if(status != SUCCESS)
-        {
-            GATT_bm_free((gattMsg_t *)&CtrlPoint_Noti, ATT_HANDLE_VALUE_NOTI);
-        }
+        PERF_END(PERF_STAGE_NOTIFY);
+        TRACE(TRACE_EV_NOTIFY, status, CtrlPoint_Noti.len);
+    }
+    // not sent, e.g. notifications are off, the buffer is still ours.
+    if(status != SUCCESS)
+    {
+        GATT_bm_free((gattMsg_t *)&CtrlPoint_Noti, ATT_HANDLE_VALUE_NOTI);
     }
+    CtrlPoint_Noti.pValue = NULL;
     return status;
 }
\ No newline at end of file
@@ -0,0 +1,55 @@
+#include <stddef.h>
+
+#include "config.h"
+#include "crc.h"
+#include "boot_mailbox.h"
+
+_Static_assert(sizeof(BootMailbox_t) == BOOT_MAILBOX_SIZE, "keep BOOT_MAILBOX_SIZE and __mailbox_size in link.ld in sync");
+
+/**
+ * @brief leave a message for whoever runs after the next software reset.
+ *
+ * @param command one of BOOT_MAILBOX_*.
+ * @param peerAddrType the central's address type.
+ * @param pPeerAddr the central's address, B_ADDR_LEN bytes. NULL when there is none.
+ */
+void BootMailbox_Post(uint8_t command, uint8_t peerAddrType, const uint8_t* pPeerAddr)
+{
+    __attribute__((aligned(4))) BootMailbox_t mailbox;
+    mailbox.magic = BOOT_MAILBOX_MAGIC;
+    mailbox.command = command;
+    mailbox.peer_addr_type = pPeerAddr ? peerAddrType : BOOT_MAILBOX_NO_PEER;
+    for(uint8_t i = 0; i < sizeof(mailbox.peer_addr); i++) mailbox.peer_addr[i] = pPeerAddr ? pPeerAddr[i] : 0;
+    mailbox.crc = update_CRC32(CRC_INITIAL_VALUE, &mailbox, offsetof(BootMailbox_t, crc));
+    *(BootMailbox_t*)BOOT_MAILBOX_ADDR = mailbox;
+}
+
+/**
+ * @brief take the message, if there is one with this command. a taken message is gone, also after the next reset.
+ *
+ * @param command the BOOT_MAILBOX_* expected. other messages are left for their receiver.
+ * @param pMailbox where to copy it.
+ * @return uint8_t 0 = success. !0 = no such message.
+ */
+uint8_t BootMailbox_Take(uint8_t command, BootMailbox_t* pMailbox)
+{
+    BootMailbox_t* pBox = (BootMailbox_t*)BOOT_MAILBOX_ADDR;
+    *pMailbox = *pBox;
+    if(pMailbox->magic != BOOT_MAILBOX_MAGIC || pMailbox->command != command) return FAILURE;
+    if(pMailbox->crc != update_CRC32(CRC_INITIAL_VALUE, pMailbox, offsetof(BootMailbox_t, crc))) return FAILURE;
+    pBox->magic = 0;
+    return SUCCESS;
+}
+
+/**
+ * @brief for the application: reset into the bootloader's DFU mode, without touching the data flash.
+ *        does not return.
+ *
+ * @param peerAddrType the central's address type.
+ * @param pPeerAddr the central that asked for the update, the bootloader advertises to it first. NULL for anyone.
+ */
+void BootMailbox_EnterDfu(uint8_t peerAddrType, const uint8_t* pPeerAddr)
+{
+    BootMailbox_Post(BOOT_MAILBOX_ENTER_DFU, peerAddrType, pPeerAddr);
+    SYS_ResetExecute();
+}
@@ -1,6 +1,8 @@
 #include "crc.h"
+#include "hot_path.h"
 
-static const uint32_t CRC32_Table[256] =
+// the table is read for every byte, so it goes to RAM together with the code when the hot path is.
+OTA_HOT_DATA static const uint32_t CRC32_Table[256] =
 {
    0x00000000, 0x77073096, 0xEE0E612C, 0x990951BA,
    0x076DC419, 0x706AF48F, 0xE963A535, 0x9E6495A3,
@@ -69,7 +71,7 @@ static const uint32_t CRC32_Table[256] =
 };
 
 // this returns a non-xored value so that you can incrementally calculate the CRC.
-uint32_t update_CRC32 (uint32_t crc32, void *pStart, uint32_t uSize)
+OTA_HOT_CODE uint32_t update_CRC32 (uint32_t crc32, void *pStart, uint32_t uSize)
 {
   uint8_t *pData = pStart;
   crc32 ^= CRC_XOROT; // we XOR the crc32 value to get raw result first.
@@ -87,3 +89,36 @@ uint32_t calculate_CRC32 (void *pStart, uint32_t uSize)
 {
   return update_CRC32 (CRC_INITIAL_VALUE, pStart, uSize);
 }
+
+// copies the data while updating the crc, so the payload is only walked once.
+// when both buffers are dword aligned, the data is moved a word at a time.
+OTA_HOT_CODE uint32_t update_CRC32_copy (uint32_t crc32, void *pDst, void *pSrc, uint32_t uSize)
+{
+  uint8_t *pOut = pDst;
+  uint8_t *pIn = pSrc;
+  crc32 ^= CRC_XOROT;
+
+  if ((((uintptr_t)pOut | (uintptr_t)pIn) & 3) == 0)
+  {
+    while (uSize >= 4)
+    {
+      uint32_t word = *(uint32_t *)pIn;
+      *(uint32_t *)pOut = word;
+      /* the core is little endian, so the lowest byte comes first. */
+      crc32 = CRC32_Table[(crc32 ^ word) & 0xFF] ^ (crc32 >> 8);
+      crc32 = CRC32_Table[(crc32 ^ (word >> 8)) & 0xFF] ^ (crc32 >> 8);
+      crc32 = CRC32_Table[(crc32 ^ (word >> 16)) & 0xFF] ^ (crc32 >> 8);
+      crc32 = CRC32_Table[(crc32 ^ (word >> 24)) & 0xFF] ^ (crc32 >> 8);
+      pIn += 4;
+      pOut += 4;
+      uSize -= 4;
+    }
+  }
+  while (uSize --)
+  {
+    *pOut = *pIn;
+    crc32 = CRC32_Table[(crc32 ^ *pIn++) & 0xFF] ^ (crc32 >> 8);
+    pOut++;
+  }
+  return crc32 ^ CRC_XOROT;
+}
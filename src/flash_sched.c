@@ -0,0 +1,161 @@
+#include "flash_sched.h"
+#include "perf_counter.h"
+
+
+// TMOS task and event used to step through a job.
+static uint8_t FlashSched_TaskID;
+static uint16_t FlashSched_Event;
+// connection timing. the interval is kept in TMOS ticks (625us), which is exactly 2 units of 1.25ms.
+// 0 means there is no connection, so there is no radio event to avoid.
+static uint32_t FlashSched_IntervalTicks = 0;
+static uint32_t FlashSched_Anchor = 0; // system clock right after the last connection event we know of.
+// the job in flight. only one job at a time because the source buffer is shared with the protocol.
+static uint8_t FlashSched_Op = FLASH_SCHED_OP_NONE;
+static uint32_t FlashSched_Addr;
+static uint32_t FlashSched_End;
+static uint8_t* FlashSched_Buf;
+static uint8_t FlashSched_Deferrals;
+static FlashSched_DoneCB_t FlashSched_DoneCB;
+
+void FlashSched_Init(uint8_t taskID, uint16_t event)
+{
+    FlashSched_TaskID = taskID;
+    FlashSched_Event = event;
+}
+
+/**
+ * @brief set the connection interval reported by the stack.
+ *
+ * @param connInterval in units of 1.25ms. 0 when the link is gone.
+ */
+void FlashSched_SetConnInterval(uint16_t connInterval)
+{
+    FlashSched_IntervalTicks = (uint32_t)connInterval * 2;
+    FlashSched_Anchor = TMOS_GetSystemClock();
+}
+
+// the stack calls our write callbacks right after it processed a connection event, so that is our anchor.
+void FlashSched_MarkConnEvent()
+{
+    FlashSched_Anchor = TMOS_GetSystemClock();
+}
+
+/**
+ * @brief how much time is left before the next connection event.
+ *
+ * @param pWait ticks to wait until the start of the next gap.
+ * @return uint32_t microseconds usable right now.
+ */
+static uint32_t FlashSched_GapUs(uint32_t* pWait)
+{
+    if(!FlashSched_IntervalTicks)
+    {
+        *pWait = 0;
+        return UINT32_MAX;
+    }
+    uint32_t phase = (TMOS_GetSystemClock() - FlashSched_Anchor) % FlashSched_IntervalTicks;
+    uint32_t remaining = (FlashSched_IntervalTicks - phase) * SYSTEM_TIME_MICROSEN;
+    // one tick of margin on both ends because the clock resolution is one tick.
+    *pWait = FlashSched_IntervalTicks - phase + 1;
+    if(remaining <= FLASH_SCHED_GUARD_US + SYSTEM_TIME_MICROSEN) return 0;
+    return remaining - FLASH_SCHED_GUARD_US - SYSTEM_TIME_MICROSEN;
+}
+
+static bStatus_t FlashSched_Start(uint8_t op, uint32_t addr, uint8_t *pBuf, uint32_t len, FlashSched_DoneCB_t cb)
+{
+    if(FlashSched_Op != FLASH_SCHED_OP_NONE) return bleIncorrectMode;
+    FlashSched_Op = op;
+    FlashSched_Addr = addr;
+    FlashSched_End = addr + len;
+    FlashSched_Buf = pBuf;
+    FlashSched_Deferrals = 0;
+    FlashSched_DoneCB = cb;
+    tmos_set_event(FlashSched_TaskID, FlashSched_Event);
+    return SUCCESS;
+}
+
+static void FlashSched_Finish(uint8_t status)
+{
+    FlashSched_DoneCB_t cb = FlashSched_DoneCB;
+    FlashSched_Op = FLASH_SCHED_OP_NONE;
+    FlashSched_DoneCB = NULL;
+    if(cb) cb(status);
+}
+
+/**
+ * @brief queue an erase. it is split into EEPROM_BLOCK_SIZE steps, so addr and len must be block aligned.
+ */
+bStatus_t FlashSched_Erase(uint32_t addr, uint32_t len, FlashSched_DoneCB_t cb)
+{
+    return FlashSched_Start(FLASH_SCHED_OP_ERASE, addr, NULL, len, cb);
+}
+
+/**
+ * @brief queue a program. pBuf must stay untouched and dword aligned until cb is called.
+ */
+bStatus_t FlashSched_Program(uint32_t addr, uint8_t *pBuf, uint32_t len, FlashSched_DoneCB_t cb)
+{
+    return FlashSched_Start(FLASH_SCHED_OP_PROGRAM, addr, pBuf, len, cb);
+}
+
+BOOL FlashSched_Busy()
+{
+    return FlashSched_Op != FLASH_SCHED_OP_NONE;
+}
+
+/**
+ * @brief execute the next step of the job if it fits in the current gap, otherwise wait for the next one.
+ *        called from the owner task when FlashSched_Event is raised.
+ */
+void FlashSched_ProcessEvent()
+{
+    if(FlashSched_Op == FLASH_SCHED_OP_NONE) return;
+    uint32_t wait;
+    uint32_t gap = FlashSched_GapUs(&wait);
+    uint32_t len = FlashSched_End - FlashSched_Addr;
+    uint32_t cost;
+    if(FlashSched_Op == FLASH_SCHED_OP_ERASE)
+    {
+        len = EEPROM_BLOCK_SIZE;
+        cost = FLASH_SCHED_ERASE_BLOCK_US;
+    }
+    else
+    {
+        // program as many words as fit, but never chunks too small to be worth the call.
+        uint32_t fit = gap / FLASH_SCHED_PROGRAM_WORD_US * FLASH_MIN_WR_SIZE;
+        if(fit >= FLASH_SCHED_MIN_CHUNK && fit < len) len = fit;
+        cost = (len + FLASH_MIN_WR_SIZE - 1) / FLASH_MIN_WR_SIZE * FLASH_SCHED_PROGRAM_WORD_US;
+    }
+    // an operation that can never fit in one gap would be deferred forever, so it runs after a few tries.
+    if(cost > gap && FlashSched_Deferrals < FLASH_SCHED_MAX_DEFERRALS)
+    {
+        FlashSched_Deferrals++;
+        tmos_start_task(FlashSched_TaskID, FlashSched_Event, wait);
+        return;
+    }
+    FlashSched_Deferrals = 0;
+    uint8_t status;
+    if(FlashSched_Op == FLASH_SCHED_OP_ERASE)
+    {
+        PERF_BEGIN(PERF_STAGE_ERASE);
+        status = FLASH_ROM_ERASE(FlashSched_Addr, len);
+        PERF_END(PERF_STAGE_ERASE);
+    }
+    else
+    {
+        PERF_BEGIN(PERF_STAGE_PROGRAM);
+        status = FLASH_ROM_WRITE(FlashSched_Addr, FlashSched_Buf, len);
+        PERF_END(PERF_STAGE_PROGRAM);
+        FlashSched_Buf += len;
+    }
+    FlashSched_Addr += len;
+    if(status || FlashSched_Addr >= FlashSched_End)
+    {
+        FlashSched_Finish(status);
+    }
+    else
+    {
+        // re-evaluate the gap for the next step. the step we just ran used part of it.
+        tmos_set_event(FlashSched_TaskID, FlashSched_Event);
+    }
+}
@@ -0,0 +1,129 @@
+#include "config.h"
+#include "gatt_record.h"
+#include "slip.h"
+
+#if GATT_RECORD
+
+#if UART_TRANSPORT
+#error "GATT_RECORD streams on UART1, which UART_TRANSPORT uses for DFU"
+#endif
+
+// the write callbacks fill the ring and the UART interrupt drains it, 8 bytes per THR empty interrupt.
+// the task writes the head and the interrupt the tail, so no locking is needed.
+static uint8_t GattRecord_Tx[GATT_RECORD_TX_RING];
+static volatile uint16_t GattRecord_TxHead = 0;
+static volatile uint16_t GattRecord_TxTail = 0;
+static uint16_t GattRecord_Seq = 0;
+// the cycle counter wraps every 71s at 60MHz, the TMOS clock tells how many times it did between two records.
+static uint32_t GattRecord_LastCycles;
+static uint32_t GattRecord_LastTicks;
+static uint32_t GattRecord_Time = 0;
+
+void GattRecord_Init()
+{
+    GPIOA_SetBits(GPIO_Pin_9);
+    GPIOA_ModeCfg(GPIO_Pin_9, GPIO_ModeOut_PP_5mA);
+    UART1_DefInit();
+    UART1_BaudRateCfg(GATT_RECORD_BAUD);
+    PFIC_EnableIRQ(UART1_IRQn);
+    __asm__ volatile ("csrr %0, mcycle" : "=r"(GattRecord_LastCycles));
+    GattRecord_LastTicks = TMOS_GetSystemClock();
+}
+
+__INTERRUPT __HIGH_CODE void UART1_IRQHandler(void)
+{
+    if(UART1_GetITFlag() != UART_II_THR_EMPTY) return;
+    uint16_t tail = GattRecord_TxTail;
+    uint16_t head = GattRecord_TxHead;
+    for(uint8_t i = 0; i < UART_FIFO_SIZE && tail != head; i++)
+    {
+        R8_UART1_THR = GattRecord_Tx[tail & (GATT_RECORD_TX_RING - 1)];
+        tail++;
+    }
+    GattRecord_TxTail = tail;
+    // nothing left, stay quiet until the next record re-enables it.
+    if(tail == head) UART1_INTCfg(DISABLE, RB_IER_THR_EMPTY);
+}
+
+static uint32_t GattRecord_Now()
+{
+    uint32_t cycles;
+    __asm__ volatile ("csrr %0, mcycle" : "=r"(cycles));
+    uint32_t ticks = TMOS_GetSystemClock();
+    uint64_t elapsed = (uint32_t)(cycles - GattRecord_LastCycles) / (FREQ_SYS / 1000000);
+    uint64_t coarse = (uint64_t)(ticks - GattRecord_LastTicks) * SYSTEM_TIME_MICROSEN;
+    const uint32_t wrap = UINT32_MAX / (FREQ_SYS / 1000000) + 1;
+    while(elapsed + wrap / 2 < coarse) elapsed += wrap;
+    GattRecord_LastCycles = cycles;
+    GattRecord_LastTicks = ticks;
+    GattRecord_Time += (uint32_t)elapsed;
+    return GattRecord_Time;
+}
+
+static uint16_t GattRecord_EncodedLen(const uint8_t* p, uint16_t len)
+{
+    uint16_t encoded = len;
+    for(uint16_t i = 0; i < len; i++)
+    {
+        if(p[i] == SLIP_END || p[i] == SLIP_ESC) encoded++;
+    }
+    return encoded;
+}
+
+static void GattRecord_Put(uint16_t* pHead, uint8_t byte)
+{
+    GattRecord_Tx[*pHead & (GATT_RECORD_TX_RING - 1)] = byte;
+    (*pHead)++;
+}
+
+static void GattRecord_PutEscaped(uint16_t* pHead, const uint8_t* p, uint16_t len)
+{
+    for(uint16_t i = 0; i < len; i++)
+    {
+        if(p[i] == SLIP_END)
+        {
+            GattRecord_Put(pHead, SLIP_ESC);
+            GattRecord_Put(pHead, SLIP_ESC_END);
+        }
+        else if(p[i] == SLIP_ESC)
+        {
+            GattRecord_Put(pHead, SLIP_ESC);
+            GattRecord_Put(pHead, SLIP_ESC_ESC);
+        }
+        else
+        {
+            GattRecord_Put(pHead, p[i]);
+        }
+    }
+}
+
+/**
+ * @brief queue one record for the UART. costs a copy of the value, the UART is drained by its interrupt.
+ *
+ * @param connHandle connection the attribute was written on.
+ * @param kind GATT_RECORD_KIND_*.
+ * @param pValue attribute value.
+ * @param len length of the value.
+ */
+void GattRecord_Write(uint16_t connHandle, uint8_t kind, const uint8_t* pValue, uint16_t len)
+{
+    GattRecordHeader_t header;
+    header.time = GattRecord_Now();
+    header.seq = GattRecord_Seq++;
+    header.connHandle = connHandle;
+    header.mtu = ATT_GetMTU(connHandle);
+    header.kind = kind;
+    header.reserved = 0;
+    uint16_t encoded = GattRecord_EncodedLen((uint8_t*)&header, sizeof(header)) + GattRecord_EncodedLen(pValue, len) + 2;
+    uint16_t head = GattRecord_TxHead;
+    if((uint16_t)(head - GattRecord_TxTail) + encoded > GATT_RECORD_TX_RING) return;
+    GattRecord_Put(&head, SLIP_END);
+    GattRecord_PutEscaped(&head, (uint8_t*)&header, sizeof(header));
+    GattRecord_PutEscaped(&head, pValue, len);
+    GattRecord_Put(&head, SLIP_END);
+    // publish the bytes before the interrupt can look for them.
+    GattRecord_TxHead = head;
+    UART1_INTCfg(ENABLE, RB_IER_THR_EMPTY);
+}
+
+#endif
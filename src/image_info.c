@@ -0,0 +1,43 @@
+#include <stddef.h>
+
+#include "config.h"
+#include "crc.h"
+#include "image_info.h"
+
+_Static_assert(sizeof(ImageInfo_t) <= EEPROM_PAGE_SIZE, "the record must fit its page");
+
+/**
+ * @brief read the installed application's record.
+ *
+ * @param pInfo where to read it to, dword aligned.
+ * @return uint8_t 0 = success. !0 = no application was installed by the bootloader.
+ */
+uint8_t ImageInfo_Read(ImageInfo_t* pInfo)
+{
+    EEPROM_READ(IMAGE_INFO_ADDR, pInfo, sizeof(ImageInfo_t));
+    return pInfo->crc == update_CRC32(CRC_INITIAL_VALUE, pInfo, offsetof(ImageInfo_t, crc)) ? SUCCESS : FAILURE;
+}
+
+/**
+ * @brief record a newly installed application. the cpu stalls for the data flash.
+ *
+ * @param version its version, from the init packet.
+ * @param pDigest its SHA-256, IMAGE_INFO_DIGEST_LEN bytes.
+ */
+void ImageInfo_Write(uint32_t version, const uint8_t* pDigest)
+{
+    __attribute__((aligned(4))) ImageInfo_t info;
+    info.app_version = version;
+    tmos_memcpy(info.app_digest, pDigest, IMAGE_INFO_DIGEST_LEN);
+    info.crc = update_CRC32(CRC_INITIAL_VALUE, &info, offsetof(ImageInfo_t, crc));
+    EEPROM_ERASE(IMAGE_INFO_ADDR, EEPROM_PAGE_SIZE);
+    EEPROM_WRITE(IMAGE_INFO_ADDR, &info, sizeof(ImageInfo_t));
+}
+
+/**
+ * @brief forget the installed application, before its region is erased. the cpu stalls for the data flash.
+ */
+void ImageInfo_Erase()
+{
+    EEPROM_ERASE(IMAGE_INFO_ADDR, EEPROM_PAGE_SIZE);
+}
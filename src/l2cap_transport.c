@@ -0,0 +1,91 @@
+#include "l2cap_transport.h"
+
+#if L2CAP_TRANSPORT
+
+static l2capPsm_t L2cap_Psm;
+static OTA_PacketSink_t L2cap_Sink;
+static uint16_t L2cap_CID = 0; // 0 while there is no channel.
+static BOOL L2cap_Hold = FALSE; // a flash job owns the object buffer, the peer must not get new credits.
+static BOOL L2cap_CreditsOwed = FALSE; // the peer hit the threshold while we were holding.
+
+void L2capTransport_Init(uint8_t taskID, OTA_PacketSink_t sink)
+{
+    L2cap_Sink = sink;
+    L2cap_Psm.psm = L2CAP_TRANSPORT_PSM;
+    L2cap_Psm.mtu = L2CAP_TRANSPORT_MTU;
+    L2cap_Psm.initPeerCredits = L2CAP_TRANSPORT_CREDITS;
+    L2cap_Psm.peerCreditThreshold = L2CAP_TRANSPORT_CREDIT_THRESHOLD;
+    L2cap_Psm.maxNumChannels = 1;
+    L2cap_Psm.pfnVerifySecCB = NULL;
+    L2cap_Psm.taskId = taskID;
+    L2CAP_RegisterPsm(&L2cap_Psm);
+}
+
+static void L2capTransport_TopUp()
+{
+    if(L2cap_CID && !L2cap_Hold)
+    {
+        L2CAP_FlowCtrlCredit(L2cap_CID, L2CAP_TRANSPORT_CREDITS - L2CAP_TRANSPORT_CREDIT_THRESHOLD);
+        L2cap_CreditsOwed = FALSE;
+    }
+    else
+    {
+        L2cap_CreditsOwed = TRUE;
+    }
+}
+
+/**
+ * @brief handle the L2CAP messages sent to the owner task for our PSM.
+ *
+ * @param pMsg the message. the owner task deallocates it afterwards.
+ */
+void L2capTransport_ProcessMsg(tmos_event_hdr_t* pMsg)
+{
+    if(pMsg->event == L2CAP_SIGNAL_EVENT)
+    {
+        l2capSignalEvent_t* pEvt = (l2capSignalEvent_t*)pMsg;
+        switch(pEvt->opcode)
+        {
+            case L2CAP_CHANNEL_ESTABLISHED_EVT:
+                if(pEvt->cmd.channelEstEvt.result == SUCCESS)
+                {
+                    L2cap_CID = pEvt->cmd.channelEstEvt.CID;
+                    L2cap_CreditsOwed = FALSE;
+                }
+                break;
+            case L2CAP_CHANNEL_TERMINATED_EVT:
+                if(pEvt->cmd.channelTermEvt.CID == L2cap_CID) L2cap_CID = 0;
+                break;
+            case L2CAP_PEER_CREDIT_THRESHOLD_EVT:
+                L2capTransport_TopUp();
+                break;
+            default:
+                break;
+        }
+    }
+    else if(pMsg->event == L2CAP_DATA_EVENT)
+    {
+        // the stack reassembled the SDU, it is consumed like one packet write.
+        l2capDataEvent_t* pData = (l2capDataEvent_t*)pMsg;
+        if(pData->pkt.CID == L2cap_CID)
+        {
+            L2cap_Sink(pData->connHandle, pData->pkt.pPayload, pData->pkt.len);
+        }
+        BM_free(pData->pkt.pPayload);
+    }
+}
+
+// called when a flash job starts. the peer runs out of credits instead of sending into a busy buffer.
+void L2capTransport_Hold()
+{
+    L2cap_Hold = TRUE;
+}
+
+// called when the flash job is committed.
+void L2capTransport_Release()
+{
+    L2cap_Hold = FALSE;
+    if(L2cap_CreditsOwed) L2capTransport_TopUp();
+}
+
+#endif
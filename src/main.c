@@ -1,5 +1,7 @@
 #include "HAL.h"
 #include "peripheral.h"
+#include "mem_watermark.h"
+#include "boot_mailbox.h"
 
 
 __attribute__((aligned(4))) uint32_t MEM_BUF[BLE_MEMHEAP_SIZE / 4];
@@ -13,18 +15,24 @@ __attribute__((aligned(4))) uint32_t MEM_BUF[BLE_MEMHEAP_SIZE / 4];
 int main()
 {
     SetSysClock(CLK_SOURCE_PLL_60MHz);
+    // an application that asks for DFU through the mailbox leaves the boot flag alone.
+    __attribute__((aligned(4))) BootMailbox_t mailbox;
+    BOOL requested = BootMailbox_Take(BOOT_MAILBOX_ENTER_DFU, &mailbox) == SUCCESS;
     uint32_t boot_ota;
     EEPROM_READ(EEPROM_DATA_ADDR, &boot_ota, sizeof(boot_ota));
-    if(!boot_ota) // only the number 0 will boot the app because the flash will be erased to 1's. You have to actively set it to be 0, so 0 means set.
+    if(!requested && !boot_ota) // only the number 0 will boot the app because the flash will be erased to 1's. You have to actively set it to be 0, so 0 means set.
     {
         jumpApp();
     }
     GPIOA_ModeCfg(GPIO_Pin_All, GPIO_ModeIN_PU);
     GPIOB_ModeCfg(GPIO_Pin_All, GPIO_ModeIN_PU);
     GPIOB_ModeCfg(GPIO_Pin_7, GPIO_ModeOut_PP_20mA);
+#if MEM_WATERMARK
+    MemWatermark_Init();
+#endif
     CH57X_BLEInit();
     HAL_Init();
-    OTA_Init();
+    OTA_Init(requested ? &mailbox : NULL);
     while(1)
     {
         TMOS_SystemProcess();
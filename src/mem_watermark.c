@@ -0,0 +1,50 @@
+#include "mem_watermark.h"
+
+#if MEM_WATERMARK
+
+// provided by link.ld. the stack grows down from _eusrstack to _susrstack.
+extern uint32_t _susrstack[];
+extern uint32_t _eusrstack[];
+
+/**
+ * @brief paint the free part of the stack and the whole BLE heap.
+ *        must be called from main() before CH57X_BLEInit(), while nothing lives in the heap yet.
+ */
+void MemWatermark_Init()
+{
+    // stop a bit below our own frame so that we do not paint over it.
+    uint32_t *sp = (uint32_t *)__builtin_frame_address(0) - 16;
+    for(uint32_t *p = _susrstack; p < sp; p++)
+    {
+        *p = MEM_PAINT_PATTERN;
+    }
+    for(uint32_t i = 0; i < BLE_MEMHEAP_SIZE / 4; i++)
+    {
+        MEM_BUF[i] = MEM_PAINT_PATTERN;
+    }
+}
+
+uint32_t MemWatermark_StackSize()
+{
+    return (uint32_t)(_eusrstack - _susrstack) * 4;
+}
+
+// deepest stack usage since boot, in bytes.
+uint32_t MemWatermark_StackUsed()
+{
+    uint32_t *p = _susrstack;
+    while(p < _eusrstack && *p == MEM_PAINT_PATTERN) p++;
+    return (uint32_t)(_eusrstack - p) * 4;
+}
+
+// highest BLE heap offset ever touched, in bytes. the heap is allocated from the bottom up,
+// so this is an upper bound of the peak usage.
+// if the stack clears the heap on init, this reads as the whole heap, which is still a safe answer.
+uint32_t MemWatermark_HeapUsed()
+{
+    uint32_t i = BLE_MEMHEAP_SIZE / 4;
+    while(i && MEM_BUF[i - 1] == MEM_PAINT_PATTERN) i--;
+    return i * 4;
+}
+
+#endif
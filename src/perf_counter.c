@@ -0,0 +1,37 @@
+#include "perf_counter.h"
+
+#if PERF_COUNTERS
+
+static PerfStage_t Perf_Stages[PERF_STAGE_COUNT];
+
+void Perf_Record(uint8_t stage, uint32_t cycles)
+{
+    PerfStage_t* p = &Perf_Stages[stage];
+    if(!p->count || cycles < p->min) p->min = cycles;
+    if(cycles > p->max) p->max = cycles;
+    uint32_t lo = p->total_lo + cycles;
+    if(lo < p->total_lo) p->total_hi++;
+    p->total_lo = lo;
+    p->count++;
+}
+
+/**
+ * @brief copy out the counters of one stage.
+ *
+ * @param stage one of PERF_STAGE_*.
+ * @param pStage where to copy the counters.
+ * @return bStatus_t 0 = success. !0 = stage out of range.
+ */
+bStatus_t Perf_Get(uint8_t stage, PerfStage_t* pStage)
+{
+    if(stage >= PERF_STAGE_COUNT) return FAILURE;
+    tmos_memcpy(pStage, &Perf_Stages[stage], sizeof(PerfStage_t));
+    return SUCCESS;
+}
+
+void Perf_Reset()
+{
+    tmos_memset(Perf_Stages, 0, sizeof(Perf_Stages));
+}
+
+#endif
@@ -7,18 +7,42 @@
 
 
 #include "config.h"
-#include "crc.h"
 #include "peripheral.h"
 #include "OTA_service.h"
-#include "signature.h"
+#include "OTA_engine.h"
+#include "flash_sched.h"
+#include "uart_transport.h"
+#include "l2cap_transport.h"
+#include "gatt_record.h"
+#include "write_queue.h"
+#include "image_info.h"
+#include "session_log.h"
+#include "trace.h"
+#include "hot_path.h"
 
 
 // function declaration for later reference.
 static void OTA_GAPStateNotificationCB(gapRole_States_t newState, gapRoleEvent_t *pEvent);
 static void OTA_GAPParamUpdateCB(uint16_t connHandle, uint16_t connInterval, uint16_t connSlaveLatency, uint16_t connTimeout);
 static void OTA_CtrlPointCB(uint16_t connHandle, uint16_t attrHandle, uint8_t* pValue, uint16_t len);
-static void OTA_PacketCB(uint16_t connHandle, uint16_t attrHandle, uint8_t* pValue, uint16_t len);
-static bStatus_t OTA_PreValidateCmdObject(CmdObject_t* obj);
+static void OTA_PacketSink(uint16_t connHandle, uint8_t* pValue, uint16_t len);
+static void OTA_HandleCtrlPoint(uint16_t connHandle, uint16_t attrHandle, uint8_t* pValue, uint16_t len);
+#if WRITE_QUEUE
+static void OTA_QueueWrite(uint8_t kind, uint16_t connHandle, uint16_t attrHandle, uint8_t* pValue, uint16_t len);
+static void OTA_HandleQueued(WriteQueue_Entry_t* pEntry);
+static void OTA_DrainQueue();
+#endif
+#if L2CAP_TRANSPORT
+static void OTA_ChannelSink(uint16_t connHandle, uint8_t* pValue, uint16_t len);
+#endif
+static void OTA_FlashDoneCB(uint8_t status);
+static void OTA_StartAdvertising(uint8_t mode);
+static void OTA_LinkLost(uint8_t reason);
+static void OTA_Leave();
+#if UART_TRANSPORT
+static void OTA_UartFrameCB(uint8_t* pFrame, uint16_t len);
+static void OTA_WiredLost();
+#endif
 
 /**************************************************
  * Public APIs.
@@ -27,6 +51,22 @@ static bStatus_t OTA_PreValidateCmdObject(CmdObject_t* obj);
 static uint32_t BOOTAPP = 0; // constant to write to the EEPROM.
 static uint8_t Main_TaskID;
 static BOOL Conn_Established = FALSE;
+static BOOL Wired_Active = FALSE; // a host talks to us over the UART transport, see OTA_WiredLost.
+static BOOL Engine_ResetPending = FALSE; // the link was lost during a flash job, start over once it is done.
+static BOOL Finish_Pending = FALSE; // the new image is in place, reset as soon as the link is down.
+static BOOL Rsp_Pending = FALSE; // a BLE response is set up and waits for MAIN_TASK_WRITERSP_EVENT.
+static BOOL App_Intact = FALSE; // entered through the mailbox and the application is not erased yet.
+// advertising modes, see OTA_StartAdvertising.
+#define OTA_ADV_FAST                 0x00
+#define OTA_ADV_SLOW                 0x01
+#define OTA_ADV_DIRECTED             0x02
+static uint8_t Adv_Mode = OTA_ADV_FAST;
+static BOOL Adv_Restart = FALSE; // advertising is being stopped to come back in Adv_Mode.
+static gapRole_States_t Gap_State = GAPROLE_INIT;
+// the last central, directed advertising after a lost link goes to it.
+static BOOL Central_Known = FALSE;
+static uint8_t Central_AddrType;
+static uint8_t Central_Addr[B_ADDR_LEN];
 static uint8_t advertData[31] = {
    // Flags; this sets the device to use limited discoverable mode (advertises indefinitely)
    0x02, // length of this data
@@ -44,10 +84,6 @@ static uint8_t advertData[31] = {
    LO_UINT16(OTA_SERV_UUID), HI_UINT16(OTA_SERV_UUID)
 };
 static uint8_t scanRspData[31] = {
-    // complete name
-    0x08, // length of this data
-    GAP_ADTYPE_LOCAL_NAME_SHORT,
-    'D','F','U','_','O','T','A',
     // connection interval range
     0x05, // length of this data
     GAP_ADTYPE_SLAVE_CONN_INTERVAL_RANGE,
@@ -59,39 +95,97 @@ static uint8_t scanRspData[31] = {
     // Tx power level
     0x02, // length of this data
     GAP_ADTYPE_POWER_LEVEL,
-    0 // 0dBm
+    0, // 0dBm
+
+    // the installed application's version and digest, filled in by OTA_Init. see image_info.h.
 };
+#define SCAN_RSP_IMAGE_INFO_OFFSET  9
+_Static_assert(SCAN_RSP_IMAGE_INFO_OFFSET + IMAGE_INFO_AD_LEN <= sizeof(scanRspData), "the image info does not fit the scan response");
 static uint8_t advertising_enabled = TRUE;
 static uint8_t advertising_event_type = GAP_ADTYPE_ADV_IND;
 static uint16_t desired_min_interval = DEFAULT_DESIRED_MIN_CONN_INTERVAL;
 static uint16_t desired_max_interval = DEFAULT_DESIRED_MAX_CONN_INTERVAL;
 static uint8_t attDeviceName[GAP_DEVICE_NAME_LEN] = "DFU_OTA";
+static OTA_Engine_t OTA_Engine;
 static gapRolesCBs_t OTA_GAPRoleCBs = {OTA_GAPStateNotificationCB, NULL, OTA_GAPParamUpdateCB};
 static gapBondCBs_t OTA_BondMgrCBs = {NULL,NULL};
-static OTA_WriteCharCBs_t OTA_WriteCharCBs = {OTA_CtrlPointCB, OTA_PacketCB};
+static OTA_WriteCharCBs_t OTA_WriteCharCBs = {OTA_CtrlPointCB};
 /*********************************************************************
  * @fn      BLETester_Init
  *
  * @brief   主要业务初始化。
  *
+ * @param   pMailbox - the application's request to enter DFU, NULL when started by the boot flag.
+ *
  * @return  none
  */
-void OTA_Init()
+void OTA_Init(const BootMailbox_t* pMailbox)
 {
     GAPRole_PeripheralInit();
     Main_TaskID = TMOS_ProcessEventRegister(Main_Task_ProcessEvent);
+    FlashSched_Init(Main_TaskID, MAIN_TASK_FLASH_EVENT);
+    OTA_Engine_Init(&OTA_Engine, NULL);
+    // leaving without an update gives the device back to an application that asked for DFU, see OTA_Leave.
+    if(pMailbox)
+    {
+        __attribute__((aligned(4))) EEPROM_Data_t data;
+        EEPROM_READ(EEPROM_DATA_ADDR, &data, sizeof(EEPROM_Data_t));
+        App_Intact = !data.boot_app;
+    }
+#if UART_TRANSPORT
+    UartTransport_Init(Main_TaskID, MAIN_TASK_UART_EVENT, OTA_UartFrameCB);
+#endif
+#if L2CAP_TRANSPORT
+    L2capTransport_Init(Main_TaskID, OTA_ChannelSink);
+#endif
+#if GATT_RECORD
+    GattRecord_Init();
+#endif
+#if WRITE_QUEUE
+    WriteQueue_Init();
+#endif
+#if SESSION_LOG
+    SessionLog_Init();
+#endif
 
-    // init GAP to advertise in DEFAULT_ADVERTISING_INTERVAL intervals.
-    GAP_SetParamValue(TGAP_DISC_ADV_INT_MIN, DEFAULT_ADVERTISING_INTERVAL);
-    GAP_SetParamValue(TGAP_DISC_ADV_INT_MAX, DEFAULT_ADVERTISING_INTERVAL);
+    // init GAP to start with the fast advertising burst, MAIN_TASK_ADV_EVENT backs off to DEFAULT_ADVERTISING_INTERVAL.
+    GAP_SetParamValue(TGAP_DISC_ADV_INT_MIN, FAST_ADVERTISING_INTERVAL);
+    GAP_SetParamValue(TGAP_DISC_ADV_INT_MAX, FAST_ADVERTISING_INTERVAL);
 
     GAPRole_SetParameter(GAPROLE_MIN_CONN_INTERVAL, sizeof(uint16_t), &desired_min_interval);
     GAPRole_SetParameter(GAPROLE_MAX_CONN_INTERVAL, sizeof(uint16_t), &desired_max_interval);
     GAPRole_SetParameter(GAPROLE_ADVERT_ENABLED, sizeof(uint8_t), &advertising_enabled);
     GAPRole_SetParameter(GAPROLE_ADV_EVENT_TYPE, sizeof(uint8_t), &advertising_event_type);
     GAPRole_SetParameter(GAPROLE_ADVERT_DATA, sizeof(advertData), advertData);
+    // the central that made the application ask for DFU is still around, advertise to it first.
+    if(pMailbox && pMailbox->peer_addr_type != BOOT_MAILBOX_NO_PEER)
+    {
+        Central_Known = TRUE;
+        Central_AddrType = pMailbox->peer_addr_type;
+        tmos_memcpy(Central_Addr, pMailbox->peer_addr, B_ADDR_LEN);
+        OTA_StartAdvertising(OTA_ADV_DIRECTED);
+    }
+    // a host can skip connecting to a device that already runs its image. zeros when none was installed.
+    {
+        __attribute__((aligned(4))) ImageInfo_t info;
+        if(ImageInfo_Read(&info)) tmos_memset(&info, 0, sizeof(ImageInfo_t));
+        ImageInfo_ServiceData(OTA_SERV_UUID, info.app_version, info.app_digest, scanRspData + SCAN_RSP_IMAGE_INFO_OFFSET);
+    }
     GAPRole_SetParameter(GAPROLE_SCAN_RSP_DATA, sizeof(scanRspData), scanRspData);
 
+    // bond when the central asks for it, without a passkey. a bonded central keeps our attribute table and
+    // the CCCDs it wrote, so a reconnect goes straight to the control point without service discovery.
+    {
+        uint8_t pairMode = GAPBOND_PAIRING_MODE_WAIT_FOR_REQ;
+        uint8_t mitm = FALSE;
+        uint8_t ioCap = GAPBOND_IO_CAP_NO_INPUT_NO_OUTPUT;
+        uint8_t bonding = TRUE;
+        GAPBondMgr_SetParameter(GAPBOND_PERI_PAIRING_MODE, sizeof(uint8_t), &pairMode);
+        GAPBondMgr_SetParameter(GAPBOND_PERI_MITM_PROTECTION, sizeof(uint8_t), &mitm);
+        GAPBondMgr_SetParameter(GAPBOND_PERI_IO_CAPABILITIES, sizeof(uint8_t), &ioCap);
+        GAPBondMgr_SetParameter(GAPBOND_PERI_BONDING_ENABLED, sizeof(uint8_t), &bonding);
+    }
+
     // setting up the GAP GATT services required by the BLE specification. (this is boilerplate that you have to do for every peripheral. Detailed doc on TI's website.)
     GGS_SetParameter(GGS_DEVICE_NAME_ATT, GAP_DEVICE_NAME_LEN, attDeviceName);
     GGS_AddService(GATT_ALL_SERVICES);         // GAP
@@ -99,6 +193,7 @@ void OTA_Init()
 
     OTA_AddService();
     OTA_RegisterWriteCharCBs(&OTA_WriteCharCBs);
+    OTA_RegisterPacketSink(OTA_PacketSink);
 
     // start TMOS with the init event.
     tmos_set_event(Main_TaskID, MAIN_TASK_INIT_EVENT);
@@ -106,29 +201,96 @@ void OTA_Init()
 
 uint16_t Main_Task_ProcessEvent(uint8_t task_id, uint16_t events)
 {
+    // responses are already traced when they are dispatched.
+    if (events != MAIN_TASK_WRITERSP_EVENT)
+    {
+        TRACE(TRACE_EV_TASK, 0, events);
+    }
+    if (events & SYS_EVENT_MSG)
+    {
+        uint8_t *pMsg;
+        if ((pMsg = tmos_msg_receive(Main_TaskID)) != NULL)
+        {
+#if L2CAP_TRANSPORT
+            L2capTransport_ProcessMsg((tmos_event_hdr_t *)pMsg);
+#endif
+#if SESSION_LOG
+            if (((tmos_event_hdr_t *)pMsg)->event == GAP_MSG_EVENT && ((gapRoleEvent_t *)pMsg)->gap.opcode == GAP_PHY_UPDATE_EVENT)
+            {
+                SESSION_LOG_EVENT(SESSION_LOG_EV_PHY, ((gapRoleEvent_t *)pMsg)->linkPhyUpdate.connRxPHYS);
+            }
+#endif
+            tmos_msg_deallocate(pMsg);
+        }
+        return events ^ SYS_EVENT_MSG;
+    }
     if (events & MAIN_TASK_INIT_EVENT)
     {
         // start the device as a peripheral.
         GAPRole_PeripheralStartDevice(Main_TaskID, &OTA_BondMgrCBs, &OTA_GAPRoleCBs);
         // setup a timeout to reset the device because we are limited discoverable.
         tmos_start_task(Main_TaskID, MAIN_TASK_TIMEOUT_EVENT, MAIN_TASK_ADV_TIMEOUT);
+        tmos_start_task(Main_TaskID, MAIN_TASK_ADV_EVENT, FAST_ADVERTISING_TIME);
         return events ^ MAIN_TASK_INIT_EVENT;
     }
+    if (events & MAIN_TASK_ADV_EVENT)
+    {
+        // the burst is over, back off.
+        if (!Conn_Established && Adv_Mode == OTA_ADV_FAST)
+        {
+            OTA_StartAdvertising(OTA_ADV_SLOW);
+        }
+        return events ^ MAIN_TASK_ADV_EVENT;
+    }
     if (events & MAIN_TASK_TIMEOUT_EVENT)
     {
-        // after timeout occurs and there is no connection, put the device into shutdown, you must disconnect and reconnect power to startup again.
-        if (!Conn_Established)
+        // after timeout occurs and there is no connection, leave DFU. see OTA_Leave.
+        if (!Conn_Established && !Wired_Active)
         {
-            GPIOB_SetBits(GPIO_Pin_7);
-            LowPower_Shutdown(0);
+            OTA_Leave();
         }
         return events ^ MAIN_TASK_TIMEOUT_EVENT;
     }
     if (events & MAIN_TASK_WRITERSP_EVENT)
     {
-        OTA_DispatchCtrlPointRsp();
+        // already sent when the next response came first, see OTA_Port_SendRsp.
+        if (Rsp_Pending)
+        {
+            Rsp_Pending = FALSE;
+            OTA_DispatchCtrlPointRsp();
+        }
         return events ^ MAIN_TASK_WRITERSP_EVENT;
     }
+    if (events & MAIN_TASK_FLASH_EVENT)
+    {
+        FlashSched_ProcessEvent();
+        return events ^ MAIN_TASK_FLASH_EVENT;
+    }
+#if WRITE_QUEUE
+    if (events & MAIN_TASK_QUEUE_EVENT)
+    {
+        // one write per wake up, the stack's own events get their turn in between.
+        WriteQueue_Entry_t* pEntry = WriteQueue_Peek();
+        if (pEntry)
+        {
+            OTA_HandleQueued(pEntry);
+            WriteQueue_Pop();
+        }
+        return WriteQueue_Peek() ? events : events ^ MAIN_TASK_QUEUE_EVENT;
+    }
+#endif
+#if UART_TRANSPORT
+    if (events & MAIN_TASK_UART_EVENT)
+    {
+        UartTransport_ProcessEvent();
+        return events ^ MAIN_TASK_UART_EVENT;
+    }
+    if (events & MAIN_TASK_WIRED_EVENT)
+    {
+        OTA_WiredLost();
+        return events ^ MAIN_TASK_WIRED_EVENT;
+    }
+#endif
     if (events & MAIN_TASK_RESET_EVENT)
     {
         SYS_ResetExecute();
@@ -152,6 +314,8 @@ uint16_t Main_Task_ProcessEvent(uint8_t task_id, uint16_t events)
  */
 static void OTA_GAPStateNotificationCB(gapRole_States_t newState, gapRoleEvent_t *pEvent)
 {
+    TRACE(TRACE_EV_GAP_STATE, newState, pEvent->gap.opcode);
+    Gap_State = newState;
     switch(newState)
     {
         case GAPROLE_STARTED:
@@ -160,9 +324,7 @@ static void OTA_GAPStateNotificationCB(gapRole_States_t newState, gapRoleEvent_t
         case GAPROLE_ADVERTISING:
             if(pEvent->gap.opcode == GAP_LINK_TERMINATED_EVENT)
             {
-                Conn_Established = FALSE;
-                GPIOB_SetBits(GPIO_Pin_7);
-                LowPower_Shutdown(0);
+                OTA_LinkLost(pEvent->linkTerminate.reason);
             }
             else
             {
@@ -173,9 +335,20 @@ static void OTA_GAPStateNotificationCB(gapRole_States_t newState, gapRoleEvent_t
         case GAPROLE_WAITING:
             if(pEvent->gap.opcode == GAP_LINK_TERMINATED_EVENT)
             {
-                Conn_Established = FALSE;
-                GPIOB_SetBits(GPIO_Pin_7);
-                LowPower_Shutdown(0);
+                OTA_LinkLost(pEvent->linkTerminate.reason);
+            }
+            else if(Adv_Restart)
+            {
+                // stopped by OTA_StartAdvertising, come back with the new parameters.
+                uint8_t enable = TRUE;
+                Adv_Restart = FALSE;
+                GAPRole_SetParameter(GAPROLE_ADVERT_ENABLED, sizeof(uint8_t), &enable);
+            }
+            else if(Adv_Mode == OTA_ADV_DIRECTED)
+            {
+                // high duty cycle directed advertising ends by itself after 1.28s, the central may have
+                // changed its address or be scanning from another device, so anyone can connect again.
+                OTA_StartAdvertising(OTA_ADV_FAST);
             }
             else
             {
@@ -189,6 +362,14 @@ static void OTA_GAPStateNotificationCB(gapRole_States_t newState, gapRoleEvent_t
         case GAPROLE_CONNECTED:
             GPIOB_SetBits(GPIO_Pin_7);
             Conn_Established = TRUE; // once connected, we raise the connected flag.
+            tmos_stop_task(Main_TaskID, MAIN_TASK_ADV_EVENT);
+            Central_Known = TRUE;
+            Central_AddrType = ((gapEstLinkReqEvent_t *)pEvent)->devAddrType;
+            tmos_memcpy(Central_Addr, ((gapEstLinkReqEvent_t *)pEvent)->devAddr, B_ADDR_LEN);
+            FlashSched_SetConnInterval(((gapEstLinkReqEvent_t *)pEvent)->connInterval);
+            // every link starts on the 1M PHY.
+            SESSION_LOG_EVENT(SESSION_LOG_EV_INTERVAL, ((gapEstLinkReqEvent_t *)pEvent)->connInterval);
+            SESSION_LOG_EVENT(SESSION_LOG_EV_PHY, GAP_PHY_BIT_LE_1M);
             GAPRole_PeripheralConnParamUpdateReq(((gapEstLinkReqEvent_t *)pEvent)->connectionHandle,
                                                 DEFAULT_DESIRED_MIN_CONN_INTERVAL,
                                                 DEFAULT_DESIRED_MAX_CONN_INTERVAL,
@@ -212,254 +393,388 @@ static void OTA_GAPStateNotificationCB(gapRole_States_t newState, gapRoleEvent_t
  */
 static void OTA_GAPParamUpdateCB(uint16_t connHandle, uint16_t connInterval, uint16_t connSlaveLatency, uint16_t connTimeout)
 {
+    // flash commits are scheduled around connection events, so the scheduler has to follow the interval.
+    FlashSched_SetConnInterval(connInterval);
+    SESSION_LOG_EVENT(SESSION_LOG_EV_INTERVAL, connInterval);
+}
+
+/**
+ * @brief advertise in one of the OTA_ADV_* modes. OTA_ADV_FAST backs off to OTA_ADV_SLOW after FAST_ADVERTISING_TIME.
+ *        advertising that is on has to be stopped first, it is enabled again from GAPROLE_WAITING.
+ *
+ * @param mode OTA_ADV_FAST, OTA_ADV_SLOW or OTA_ADV_DIRECTED to the last central.
+ */
+static void OTA_StartAdvertising(uint8_t mode)
+{
+    uint16_t interval = mode == OTA_ADV_SLOW ? DEFAULT_ADVERTISING_INTERVAL : FAST_ADVERTISING_INTERVAL;
+    uint8_t enable = TRUE;
+    Adv_Mode = mode;
+    advertising_event_type = mode == OTA_ADV_DIRECTED ? GAP_ADTYPE_ADV_HDC_DIRECT_IND : GAP_ADTYPE_ADV_IND;
+    GAP_SetParamValue(TGAP_DISC_ADV_INT_MIN, interval);
+    GAP_SetParamValue(TGAP_DISC_ADV_INT_MAX, interval);
+    GAPRole_SetParameter(GAPROLE_ADV_EVENT_TYPE, sizeof(uint8_t), &advertising_event_type);
+    if(mode == OTA_ADV_DIRECTED)
+    {
+        GAPRole_SetParameter(GAPROLE_ADV_DIRECT_TYPE, sizeof(uint8_t), &Central_AddrType);
+        GAPRole_SetParameter(GAPROLE_ADV_DIRECT_ADDR, B_ADDR_LEN, Central_Addr);
+    }
+    if(mode == OTA_ADV_FAST)
+    {
+        tmos_start_task(Main_TaskID, MAIN_TASK_ADV_EVENT, FAST_ADVERTISING_TIME);
+    }
+    if(Gap_State == GAPROLE_ADVERTISING)
+    {
+        Adv_Restart = TRUE;
+        enable = FALSE;
+    }
+    GAPRole_SetParameter(GAPROLE_ADVERT_ENABLED, sizeof(uint8_t), &enable);
+}
+
+/**
+ * @brief the BLE link is gone. a central that hung up, or our own disconnect after an update, ends it all as before.
+ *        anything else is a drop, e.g. the central went out of range: advertise to it directly and give it
+ *        the same timeout as after power on to come back.
+ *
+ * @param reason the link layer's termination reason.
+ */
+static void OTA_LinkLost(uint8_t reason)
+{
+    Conn_Established = FALSE;
+    // no more connection events to keep clear of, a flash job in flight runs at full speed.
+    FlashSched_SetConnInterval(0);
+#if WRITE_QUEUE
+    // what the central wrote before it was gone is handled first, as if it had been right away.
+    OTA_DrainQueue();
+#endif
+#if SESSION_LOG
+    SessionLog_End();
+#endif
+    if(Finish_Pending)
+    {
+        // the new image is waiting, no need to sit out the rest of the delay.
+        tmos_set_event(Main_TaskID, MAIN_TASK_RESET_EVENT);
+        return;
+    }
+    if(reason == LL_PEER_REQUESTED_TERM || reason == LL_HOST_REQUESTED_TERM)
+    {
+        OTA_Leave();
+        return;
+    }
+    // the engine can't resume a session, the central starts over on a clean one, unless a wired host is using it.
+    // a flash job has the object buffer until it is done, so then it waits for OTA_FlashDoneCB.
+    if(!Wired_Active)
+    {
+        if(OTA_Engine.busy) Engine_ResetPending = TRUE;
+        else OTA_Engine_Init(&OTA_Engine, NULL);
+    }
+    tmos_start_task(Main_TaskID, MAIN_TASK_TIMEOUT_EVENT, MAIN_TASK_ADV_TIMEOUT);
+    OTA_StartAdvertising(OTA_ADV_DIRECTED);
+}
 
+/**
+ * @brief DFU is over without an update. an application that asked for it through the mailbox is still in place
+ *        and gets the device back, with the central it may want to reconnect to. otherwise we shut down as before,
+ *        power has to be cycled to start again.
+ */
+static void OTA_Leave()
+{
+    GPIOB_SetBits(GPIO_Pin_7);
+    if(App_Intact)
+    {
+        BootMailbox_Post(BOOT_MAILBOX_BOOT_APP, Central_AddrType, Central_Known ? Central_Addr : NULL);
+        SYS_ResetExecute();
+    }
+    LowPower_Shutdown(0);
 }
 
-static uint16_t OTA_Receipt_PRN = 0;
-static uint16_t OTA_Receipt_PRN_Counter = 0;
-// since we need to write this buffer to flash, it has to be dword aligned, and the size is one page size.
-__attribute__((aligned(4))) static uint8_t OTA_ObjectBuffer[EEPROM_PAGE_SIZE];
-static uint16_t OTA_ObjectBufferOffset = 0; // this is the offset within the buffer, so that multiple packets can be stored.
-static uint8_t OTA_CurrentObject = OTA_CONTROL_POINT_OBJ_TYPE_INVALID; // 0 is invalid object, 1 is command, 2 is data.
-static CmdObject_t cmdObj;
-static uint32_t OTA_CmdObjectOffset = 0;
-static uint32_t OTA_CmdObjectSize = 0;
-static uint32_t OTA_CmdObjectCRC = CRC_INITIAL_VALUE;
-static uint32_t OTA_DataObjectOffset = 0;
-static uint32_t OTA_DataObjectSize = 0;
-static uint32_t OTA_DataObjectCRC = CRC_INITIAL_VALUE;
+// the protocol itself lives in OTA_engine.c, this file is its port to the chip and the BLE stack.
+// the big blocks of the RAM map have to fit, so a too large object buffer fails here with a name on it.
+// the rest of .data and .bss is left to the linker's ASSERT(_ebss <= _susrstack).
+_Static_assert(sizeof(OTA_Engine_t) + BLE_MEMHEAP_SIZE + OTA_STACK_SIZE + BOOT_MAILBOX_SIZE + WRITE_QUEUE_RAM + OTA_HIGHCODE_RAM
+               <= CH57x_RAM_SIZE,
+               "the engine, BLE heap, stack, mailbox, write queue and .highcode do not fit in RAM");
+// where the response to the last control point request goes.
+#define OTA_TRANSPORT_BLE            0x00
+#define OTA_TRANSPORT_UART           0x01
+static uint8_t OTA_RspTransport = OTA_TRANSPORT_BLE;
+static uint16_t OTA_RspConnHandle;
+static uint16_t OTA_RspAttrHandle;
+
 static void OTA_CtrlPointCB(uint16_t connHandle, uint16_t attrHandle, uint8_t* pValue, uint16_t len)
 {
-    OtaRspCode_t rspCode = OTA_RSP_INSUFFICIENT_RESOURCES;
     if(len <= 0) return; // guard.
-    uint8_t opcode = pValue[0];
-    uint8_t* pContent = pValue+1;
-    uint32_t size;
-    OTA_CtrlPointRsp_t rsp;
-    uint16_t mtu = ATT_GetMTU(connHandle);
-    if (mtu >= sizeof(OTA_CtrlPointRsp_t) + 6)
-    {
-        switch(opcode)
+    FlashSched_MarkConnEvent();
+#if WRITE_QUEUE
+    OTA_QueueWrite(WRITE_QUEUE_CTRL_POINT, connHandle, attrHandle, pValue, len);
+#else
+    OTA_HandleCtrlPoint(connHandle, attrHandle, pValue, len);
+#endif
+}
+
+OTA_HOT_CODE static void OTA_PacketSink(uint16_t connHandle, uint8_t* pValue, uint16_t len)
+{
+    FlashSched_MarkConnEvent();
+#if WRITE_QUEUE
+    OTA_QueueWrite(WRITE_QUEUE_PACKET, connHandle, 0, pValue, len);
+#else
+    OTA_Engine_Packet(&OTA_Engine, pValue, len);
+#endif
+}
+
+static void OTA_HandleCtrlPoint(uint16_t connHandle, uint16_t attrHandle, uint8_t* pValue, uint16_t len)
+{
+    // a deferred response still has to go where its request came from.
+    if(!OTA_Engine.busy)
+    {
+        OTA_RspTransport = OTA_TRANSPORT_BLE;
+        OTA_RspConnHandle = connHandle;
+        OTA_RspAttrHandle = attrHandle;
+    }
+    OTA_Engine_CtrlPoint(&OTA_Engine, pValue, len);
+}
+
+#if WRITE_QUEUE
+// a write was dropped and the host has not pinged since.
+static BOOL Queue_Overflow = FALSE;
+
+/**
+ * @brief called from the write callbacks. the write is left to the main task. GATT has no flow control for
+ *        packets and the stack frees the value once we return, so a write that finds no room is dropped
+ *        and counted. from then on packets are dropped as well, so nothing lands behind the gap, and control
+ *        point requests are answered by OTA_Engine_Dropped with where the object stands instead of handled.
+ *        a PING ends it: the host sends one once it has read the answers to everything it sent before,
+ *        so the packets behind the PING are the ones it sends again.
+ *        packets leave WRITE_QUEUE_CTRL_RESERVE bytes, so a control point write is only dropped when
+ *        the host keeps more of them in flight than that.
+ */
+OTA_HOT_CODE static void OTA_QueueWrite(uint8_t kind, uint16_t connHandle, uint16_t attrHandle, uint8_t* pValue, uint16_t len)
+{
+    BOOL resync = kind == WRITE_QUEUE_CTRL_POINT && len && pValue[0] == OTA_CTRL_POINT_OPCODE_PING;
+    uint8_t flags = (kind == WRITE_QUEUE_CTRL_POINT && Queue_Overflow && !resync) ? WRITE_QUEUE_FLAG_OVERFLOW : 0;
+    if((kind == WRITE_QUEUE_CTRL_POINT || !Queue_Overflow)
+       && WriteQueue_Push(kind, flags, connHandle, attrHandle, pValue, len) == SUCCESS)
+    {
+        if(resync) Queue_Overflow = FALSE;
+        tmos_set_event(Main_TaskID, MAIN_TASK_QUEUE_EVENT);
+        return;
+    }
+    TRACE(TRACE_EV_QUEUE_FULL, kind, len);
+    SESSION_LOG_EVENT(SESSION_LOG_EV_DROP, len);
+    Queue_Overflow = TRUE;
+}
+
+static void OTA_HandleQueued(WriteQueue_Entry_t* pEntry)
+{
+    uint8_t* pValue = (uint8_t*)(pEntry + 1);
+    if(pEntry->kind == WRITE_QUEUE_PACKET)
+    {
+        OTA_Engine_Packet(&OTA_Engine, pValue, pEntry->len);
+    }
+    else if(pEntry->flags & WRITE_QUEUE_FLAG_OVERFLOW)
+    {
+        if(!OTA_Engine.busy)
         {
-            case OTA_CTRL_POINT_OPCODE_VERSION:
-                rsp.version.version = OTA_PROTOCOL_VER;
-                rspCode = OTA_RSP_SUCCESS;
-                break;
-            case OTA_CTRL_POINT_OPCODE_CREATE:
-                OTA_CurrentObject = pContent[0];
-                tmos_memcpy(&size, pContent+1, sizeof(uint32_t));
-                if(size == 0)
-                {
-                    rspCode = OTA_RSP_INV_PARAM;
-                }
-                else if(OTA_CurrentObject == OTA_CONTROL_POINT_OBJ_TYPE_CMD)
-                {
-                    OTA_CmdObjectSize = size;
-                    OTA_ObjectBufferOffset = 0; // when creating a new object, we reset the buffer offset because old data is executed (dumped somewhere else.)
-                    rspCode = OTA_RSP_SUCCESS;
-                }
-                else if(OTA_CurrentObject == OTA_CONTROL_POINT_OBJ_TYPE_DATA)
-                {
-                    OTA_DataObjectSize = size;
-                    OTA_ObjectBufferOffset = 0;
-                    rspCode = OTA_RSP_SUCCESS;
-                }
-                else
-                {
-                    rspCode = OTA_RSP_UNSUPPORTED_TYPE;
-                }
-                break;
-            case OTA_CTRL_POINT_OPCODE_SET_RCPT_NOTI:
-                tmos_memcpy(&OTA_Receipt_PRN, pContent, sizeof(uint16_t));
-                OTA_Receipt_PRN_Counter = 0; // we need to reset the counter everytime we update the PRN.
-                rspCode = OTA_RSP_SUCCESS;
-                break;
-            case OTA_CTRL_POINT_OPCODE_CRC:
-                if(OTA_CurrentObject == OTA_CONTROL_POINT_OBJ_TYPE_CMD)
-                {
-                    rsp.crc.offset = OTA_CmdObjectOffset;
-                    rsp.crc.crc = OTA_CmdObjectCRC;
-                    rspCode = OTA_RSP_SUCCESS;
-                }
-                else if(OTA_CurrentObject == OTA_CONTROL_POINT_OBJ_TYPE_DATA)
-                {
-                    rsp.crc.offset = OTA_DataObjectOffset;
-                    rsp.crc.crc = OTA_DataObjectCRC;
-                    rspCode = OTA_RSP_SUCCESS;
-                }
-                else
-                {
-                    rspCode = OTA_RSP_INV_OBJECT;
-                }
-                
-                break;
-            case OTA_CTRL_POINT_OPCODE_EXECUTE:
-                if (OTA_CurrentObject == OTA_CONTROL_POINT_OBJ_TYPE_CMD)
-                {
-                    // when executing the command object, we finalize and validate it.
-                    tmos_memcpy(&cmdObj, OTA_ObjectBuffer, sizeof(CmdObject_t));
-                    rspCode = OTA_PreValidateCmdObject(&cmdObj);
-                }
-                else if (OTA_CurrentObject == OTA_CONTROL_POINT_OBJ_TYPE_DATA)
-                {
-                    UpdateHash(OTA_ObjectBuffer, OTA_ObjectBufferOffset);
-                    // the write to flash operation is executed here.
-                    if(FLASH_ROM_WRITE(APPLICATION_START_ADDR+OTA_DataObjectOffset-OTA_ObjectBufferOffset, OTA_ObjectBuffer, OTA_ObjectBufferOffset))
-                    {
-                        rspCode = OTA_RSP_EXT_ERROR;
-                    }
-                    else
-                    {
-                        rspCode = OTA_RSP_SUCCESS;
-                    }
-                    // do post validation.
-                    if(OTA_DataObjectOffset == cmdObj.bin_size)
-                    {
-                        if(VerifyHash(cmdObj.fw_hash) == SUCCESS)
-                        {
-                            // raise the boot app flag.
-                            EEPROM_WRITE(EEPROM_DATA_ADDR, &BOOTAPP, sizeof(uint32_t));
-                            // dispatch a delayed reset.
-                            tmos_start_task(Main_TaskID, MAIN_TASK_RESET_EVENT, 800); // half a second later.
-                            // terminate the link.
-                            GAPRole_TerminateLink(connHandle);
-                            rspCode = OTA_RSP_SUCCESS;
-                        }
-                        else
-                        {
-                            rspCode = OTA_RSP_OP_FAILED;
-                        }
-                    }
-                }
-                else
-                {
-                    rspCode = OTA_RSP_INV_OBJECT;
-                }
-                break;
-            case OTA_CTRL_POINT_OPCODE_SELECT:
-                if(pContent[0] == OTA_CONTROL_POINT_OBJ_TYPE_CMD)
-                {
-                    rsp.select.offset = OTA_CmdObjectOffset;
-                    OTA_CmdObjectCRC = CRC_INITIAL_VALUE; // we initialize CRC when we select.
-                    rsp.select.crc = OTA_CmdObjectCRC;
-                    rsp.select.max_size = EEPROM_PAGE_SIZE; // each object can be at max the length of our object buffer.
-                    rspCode = OTA_RSP_SUCCESS;
-                }
-                else if(pContent[0] == OTA_CONTROL_POINT_OBJ_TYPE_DATA)
-                {
-                    rsp.select.offset = OTA_DataObjectOffset;
-                    OTA_DataObjectCRC = CRC_INITIAL_VALUE;
-                    rsp.select.crc = OTA_DataObjectCRC;
-                    rsp.select.max_size = EEPROM_PAGE_SIZE;
-                    InitHash();
-                    // we need to erase the corresponding flash region to prepare for the write.
-                    if(FLASH_ROM_ERASE(APPLICATION_START_ADDR, APPLICATION_MAX_SIZE))
-                    {
-                        rspCode = OTA_RSP_EXT_ERROR;
-                    }
-                    else
-                    {
-                        rspCode = OTA_RSP_SUCCESS;
-                    }
-                }
-                else
-                {
-                    rspCode = OTA_RSP_UNSUPPORTED_TYPE;
-                }
-                break;
-            case OTA_CTRL_POINT_OPCODE_GET_MTU:
-                rsp.mtu.size = mtu;
-                rspCode = OTA_RSP_SUCCESS;
-                break;
-            case OTA_CTRL_POINT_OPCODE_WRITE:
-                // TODO.
-                rspCode = OTA_RSP_SUCCESS;
-                break;
-            case OTA_CTRL_POINT_OPCODE_PING:
-                rsp.ping.id = pContent[0];
-                rspCode = OTA_RSP_SUCCESS;
-                break;
-            case OTA_CTRL_POINT_OPCODE_HW_VERSION:
-                rsp.hardware.part = HARDWARE_VERSION;
-                rsp.hardware.variant = HARDWARE_VARIANT;
-                rsp.hardware.memory.rom_size = CH571_ROM_SIZE;
-                rsp.hardware.memory.ram_size = CH57x_RAM_SIZE;
-                rsp.hardware.memory.rom_page_size = EEPROM_PAGE_SIZE;
-                rspCode = OTA_RSP_SUCCESS;
-                break;
-            case OTA_CTRL_POINT_OPCODE_FW_VERSION:
-                rsp.firmware.type = pContent[0];
-                switch(pContent[0])
-                {
-                    case OTA_FW_TYPE_BLE_LIB:
-                    rsp.firmware.version = *VER_LIB;
-                    rsp.firmware.addr = LIB_FLASH_BASE_ADDRESSS;
-                    rsp.firmware.len = LIB_FLASH_MAX_SIZE;
-                    rspCode = OTA_RSP_SUCCESS;
-                    break;
-                    case OTA_FW_TYPE_APPLICATION:
-                    rsp.firmware.version = 0; // TODO.
-                    rsp.firmware.addr = APPLICATION_START_ADDR;
-                    rsp.firmware.len = APPLICATION_MAX_SIZE;
-                    rspCode = OTA_RSP_SUCCESS;
-                    break;
-                    case OTA_FW_TYPE_BOOTLOADER:
-                    rsp.firmware.version = BOOTLOADER_VERSION;
-                    rsp.firmware.addr = BOOTLOADER_START_ADDR;
-                    rsp.firmware.len = BOOTLOADER_MAX_SIZE;
-                    rspCode = OTA_RSP_SUCCESS;
-                    break;
-                    default:
-                    rspCode = OTA_RSP_INV_PARAM;
-                    break;
-                }
-                break;
-            case OTA_CTRL_POINT_OPCODE_ABORT:
-                // TODO.
-                rspCode = OTA_RSP_SUCCESS;
-                break;
-            default:
-                rspCode = OTA_RSP_INV_CODE;
-                break;
+            OTA_RspTransport = OTA_TRANSPORT_BLE;
+            OTA_RspConnHandle = pEntry->connHandle;
+            OTA_RspAttrHandle = pEntry->attrHandle;
         }
+        OTA_Engine_Dropped(&OTA_Engine, pValue[0]);
+    }
+    else
+    {
+        OTA_HandleCtrlPoint(pEntry->connHandle, pEntry->attrHandle, pValue, pEntry->len);
     }
-    
-    OTA_SetupCtrlPointRsp(connHandle, attrHandle, opcode, &rsp, rspCode);
-    tmos_set_event(Main_TaskID, MAIN_TASK_WRITERSP_EVENT);
 }
 
-static void OTA_PacketCB(uint16_t connHandle, uint16_t attrHandle, uint8_t* pValue, uint16_t len)
+// handle everything queued now, in order.
+static void OTA_DrainQueue()
 {
-    // if we received a command object and we have enough space, we copy the data.
-    if(OTA_CurrentObject == OTA_CONTROL_POINT_OBJ_TYPE_CMD && OTA_CmdObjectOffset + len <= ATT_MAX_MTU_SIZE)
+    WriteQueue_Entry_t* pEntry;
+    while((pEntry = WriteQueue_Peek()) != NULL)
     {
-        tmos_memcpy(OTA_ObjectBuffer+OTA_ObjectBufferOffset, pValue, len);
-        OTA_ObjectBufferOffset += len;
-        OTA_CmdObjectOffset += len;
-        // in order to save calculation cycles, we update the crc value while we are receiving the object.
-        OTA_CmdObjectCRC = update_CRC32(OTA_CmdObjectCRC, pValue, len);
+        OTA_HandleQueued(pEntry);
+        WriteQueue_Pop();
     }
-    else if(OTA_CurrentObject == OTA_CONTROL_POINT_OBJ_TYPE_DATA)
+}
+#endif
+
+#if L2CAP_TRANSPORT
+// SDUs already come through the main task's messages. GATT writes queued before them go first.
+static void OTA_ChannelSink(uint16_t connHandle, uint8_t* pValue, uint16_t len)
+{
+    FlashSched_MarkConnEvent();
+#if WRITE_QUEUE
+    OTA_DrainQueue();
+#endif
+    OTA_Engine_Packet(&OTA_Engine, pValue, len);
+}
+#endif
+
+#if UART_TRANSPORT
+static void OTA_UartFrameCB(uint8_t* pFrame, uint16_t len)
+{
+    // a wired host keeps us awake like a connection does, as long as it keeps talking.
+    Wired_Active = TRUE;
+    tmos_start_task(Main_TaskID, MAIN_TASK_WIRED_EVENT, MAIN_TASK_WIRED_TIMEOUT);
+    if(!OTA_Engine.busy)
+    {
+        OTA_RspTransport = OTA_TRANSPORT_UART;
+    }
+    OTA_Engine_CtrlPoint(&OTA_Engine, pFrame, len);
+}
+
+/**
+ * @brief the wired host went silent, e.g. it was unplugged mid update. like a lost link, its session is dropped
+ *        and the advertising timeout runs again, so an idle device still shuts down.
+ */
+static void OTA_WiredLost()
+{
+    Wired_Active = FALSE;
+    // a central that took the engine over since keeps its session.
+    if(OTA_RspTransport == OTA_TRANSPORT_UART)
+    {
+        if(OTA_Engine.busy) Engine_ResetPending = TRUE;
+        else OTA_Engine_Init(&OTA_Engine, NULL);
+    }
+    if(!Conn_Established) tmos_start_task(Main_TaskID, MAIN_TASK_TIMEOUT_EVENT, MAIN_TASK_ADV_TIMEOUT);
+}
+#endif
+
+static void OTA_FlashDoneCB(uint8_t status)
+{
+#if L2CAP_TRANSPORT
+    L2capTransport_Release();
+#endif
+    OTA_Engine_FlashDone(&OTA_Engine, status);
+    if(Engine_ResetPending)
     {
-        tmos_memcpy(OTA_ObjectBuffer+OTA_ObjectBufferOffset, pValue, len);
-        OTA_ObjectBufferOffset += len;
-        OTA_DataObjectOffset += len;
-        OTA_DataObjectCRC = update_CRC32(OTA_DataObjectCRC, pValue, len);
+        Engine_ResetPending = FALSE;
+        OTA_Engine_Init(&OTA_Engine, NULL);
     }
 }
 
-static bStatus_t OTA_PreValidateCmdObject(CmdObject_t* obj)
+/**************************************************
+ * Engine port.
+ */
+uint16_t OTA_Port_GetMTU(OTA_Engine_t* eng)
+{
+#if UART_TRANSPORT
+    if(OTA_RspTransport == OTA_TRANSPORT_UART) return UART_TRANSPORT_MTU;
+#endif
+    return ATT_GetMTU(OTA_RspConnHandle);
+}
+
+void OTA_Port_SendRsp(OTA_Engine_t* eng, uint8_t opcode, OTA_CtrlPointRsp_t* rsp, OtaRspCode_t rspCode)
+{
+#if UART_TRANSPORT
+    if(OTA_RspTransport == OTA_TRANSPORT_UART)
+    {
+        UartTransport_SendRsp(opcode, rsp, rspCode);
+        return;
+    }
+#endif
+    // there is only one notification to set up. requests handled back to back, e.g. queued ones drained
+    // in one go, would overwrite the response before and lose its buffer, so that one goes out first.
+    if(Rsp_Pending)
+    {
+        OTA_DispatchCtrlPointRsp();
+    }
+    OTA_SetupCtrlPointRsp(OTA_RspConnHandle, OTA_RspAttrHandle, opcode, rsp, rspCode);
+    Rsp_Pending = TRUE;
+    tmos_set_event(Main_TaskID, MAIN_TASK_WRITERSP_EVENT);
+}
+
+/**
+ * @brief make sure a reset comes back to DFU from now on. an application that asked through the mailbox
+ *        left the boot flag at 0, which would start whatever is left of it after a power loss.
+ */
+static void OTA_StayInDfu()
 {
-    bStatus_t result = OTA_RSP_SUCCESS;
-    __attribute__((aligned(4))) uint8_t key[SIGNATURE_KEY_LEN];
     __attribute__((aligned(4))) EEPROM_Data_t data;
-    EEPROM_READ(SIGNATURE_KEY_ADDR, key, SIGNATURE_KEY_LEN);
+    __attribute__((aligned(4))) ImageInfo_t info;
+    // an interrupted update leaves no application, nothing may go on claiming its version and digest.
+    // OTA_Port_Finish records the new one once it is verified.
+    if(ImageInfo_Read(&info) == SUCCESS)
+    {
+        ImageInfo_Erase();
+        tmos_memset(&info, 0, sizeof(ImageInfo_t));
+        ImageInfo_ServiceData(OTA_SERV_UUID, info.app_version, info.app_digest, scanRspData + SCAN_RSP_IMAGE_INFO_OFFSET);
+        GAPRole_SetParameter(GAPROLE_SCAN_RSP_DATA, sizeof(scanRspData), scanRspData);
+    }
     EEPROM_READ(EEPROM_DATA_ADDR, &data, sizeof(EEPROM_Data_t));
-    if(VerifySignature((uint8_t*)obj, sizeof(CmdObject_t) - SIGNATURE_LEN, obj->obj_signature, key)) result = OTA_RSP_OP_FAILED;
-    else if(obj->lib_version > *VER_LIB) result = OTA_RSP_OP_FAILED;
-    else if(obj->hw_version != HARDWARE_VERSION) result = OTA_RSP_OP_FAILED;
-    else if(obj->type != OTA_FW_TYPE_BOOTLOADER && obj->type != OTA_FW_TYPE_APPLICATION) result = OTA_RSP_OP_FAILED; // we only support uploading bootloader or app.
-    else if(obj->type == OTA_FW_TYPE_BOOTLOADER && (obj->bin_size > BOOTLOADER_MAX_SIZE || (!obj->is_debug && obj->fw_version <= data.bl_version))) result = OTA_RSP_OP_FAILED;
-    else if(obj->type == OTA_FW_TYPE_APPLICATION && (obj->bin_size > APPLICATION_MAX_SIZE || (!obj->is_debug && obj->fw_version <= data.app_version))) result = OTA_RSP_OP_FAILED;
-    return result;
-}
\ No newline at end of file
+    App_Intact = FALSE;
+    if(data.boot_app) return;
+    data.boot_app = ~BOOTAPP;
+    EEPROM_ERASE(EEPROM_DATA_ADDR, EEPROM_PAGE_SIZE);
+    EEPROM_WRITE(EEPROM_DATA_ADDR, &data, sizeof(EEPROM_Data_t));
+}
+
+// flash jobs are done block by block between connection events, the engine is answered once they are committed.
+bStatus_t OTA_Port_FlashErase(OTA_Engine_t* eng, uint32_t addr, uint32_t len)
+{
+    // the only erase is the application region's.
+    OTA_StayInDfu();
+    bStatus_t status = FlashSched_Erase(addr, len, OTA_FlashDoneCB);
+#if L2CAP_TRANSPORT
+    if(status == SUCCESS) L2capTransport_Hold();
+#endif
+    return status;
+}
+
+bStatus_t OTA_Port_FlashProgram(OTA_Engine_t* eng, uint32_t addr, uint8_t* pBuf, uint32_t len)
+{
+    bStatus_t status = FlashSched_Program(addr, pBuf, len, OTA_FlashDoneCB);
+#if L2CAP_TRANSPORT
+    if(status == SUCCESS) L2capTransport_Hold();
+#endif
+    return status;
+}
+
+#if STREAM_WRITE
+// called from the packet path, right after the connection event the packet came in.
+// a full packet is about 60 words, which takes well under the gap before the next event.
+bStatus_t OTA_Port_FlashWrite(OTA_Engine_t* eng, uint32_t addr, uint8_t* pBuf, uint32_t len)
+{
+    return FLASH_ROM_WRITE(addr, pBuf, len);
+}
+#endif
+
+void OTA_Port_ReadKey(OTA_Engine_t* eng, uint8_t* pKey)
+{
+    EEPROM_READ(SIGNATURE_KEY_ADDR, pKey, SIGNATURE_KEY_LEN);
+}
+
+void OTA_Port_ReadData(OTA_Engine_t* eng, EEPROM_Data_t* pData)
+{
+    EEPROM_READ(EEPROM_DATA_ADDR, pData, sizeof(EEPROM_Data_t));
+}
+
+uint8_t OTA_Port_ReadImageInfo(OTA_Engine_t* eng, ImageInfo_t* pInfo)
+{
+    return ImageInfo_Read(pInfo);
+}
+
+uint32_t OTA_Port_LibVersion(OTA_Engine_t* eng)
+{
+    return *VER_LIB;
+}
+
+void OTA_Port_Finish(OTA_Engine_t* eng)
+{
+    // recorded before the boot flag, so the new application never runs without its record.
+    if(eng->cmdObj.type == OTA_FW_TYPE_APPLICATION) ImageInfo_Write(eng->cmdObj.fw_version, eng->cmdObj.fw_hash);
+    // raise the boot app flag.
+    EEPROM_WRITE(EEPROM_DATA_ADDR, &BOOTAPP, sizeof(uint32_t));
+    // the application can reconnect to the central that updated it right away, see boot_mailbox.h.
+    if(OTA_RspTransport == OTA_TRANSPORT_BLE) BootMailbox_Post(BOOT_MAILBOX_BOOT_APP, Central_AddrType, Central_Addr);
+    else BootMailbox_Post(BOOT_MAILBOX_BOOT_APP, BOOT_MAILBOX_NO_PEER, NULL);
+#if SESSION_LOG
+    // the reset may come before the link terminated event, so the session is stored now.
+    SessionLog_End();
+#endif
+    // reset once the link is down, at the latest half a second later, e.g. for a wired host.
+    Finish_Pending = TRUE;
+    tmos_start_task(Main_TaskID, MAIN_TASK_RESET_EVENT, 800);
+    // terminate the link.
+    if(OTA_RspTransport == OTA_TRANSPORT_BLE) GAPRole_TerminateLink(OTA_RspConnHandle);
+}
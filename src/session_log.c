@@ -0,0 +1,177 @@
+#include "config.h"
+#include "crc.h"
+#include "OTA_service.h"
+#include "session_log.h"
+
+#if SESSION_LOG
+
+#define SESSION_LOG_SLOTS            (SESSION_LOG_SIZE / SESSION_LOG_SLOT_SIZE)
+#define SESSION_LOG_SLOTS_PER_PAGE   (EEPROM_PAGE_SIZE / SESSION_LOG_SLOT_SIZE)
+
+_Static_assert(sizeof(SessionRecord_t) == 20, "the record is the control point response, keep it 20 bytes");
+_Static_assert(SESSION_LOG_SIZE % EEPROM_PAGE_SIZE == 0 && SESSION_LOG_SIZE >= 2 * EEPROM_PAGE_SIZE,
+               "the ring erases a page ahead of the newest record, so it needs whole pages and at least 2 of them");
+
+// a slot is valid when its crc matches, so a torn write or an erased slot never looks like a record.
+typedef struct
+{
+    SessionRecord_t record;
+    uint32_t crc;
+} SessionSlot_t;
+
+static SessionRecord_t SessionLog_Current;
+static BOOL SessionLog_Active = FALSE;
+static BOOL SessionLog_Created = FALSE; // a data object is created and not executed yet.
+static uint32_t SessionLog_Start; // TMOS clock at the first request.
+static uint32_t SessionLog_FlashStart;
+static uint8_t SessionLog_FlashOp;
+static uint32_t SessionLog_EraseTicks;
+static uint32_t SessionLog_ProgramTicks;
+// the link is reported when it is set up, before the session starts.
+static uint16_t SessionLog_Interval = 0;
+static uint8_t SessionLog_Phy = 0;
+static uint16_t SessionLog_Next = 0; // slot of the next record.
+static uint16_t SessionLog_Seq = 0; // of the next record.
+
+static BOOL SessionLog_ReadSlot(uint16_t slot, SessionSlot_t* pSlot)
+{
+    EEPROM_READ(SESSION_LOG_ADDR + slot * SESSION_LOG_SLOT_SIZE, pSlot, sizeof(SessionSlot_t));
+    return pSlot->crc == update_CRC32(CRC_INITIAL_VALUE, &pSlot->record, sizeof(SessionRecord_t));
+}
+
+static uint16_t SessionLog_Ms(uint32_t ticks)
+{
+    uint32_t ms = ticks * SYSTEM_TIME_MICROSEN / 1000;
+    return ms > UINT16_MAX ? UINT16_MAX : ms;
+}
+
+/**
+ * @brief find where the ring continues. the newest record is the one the next slot does not follow up.
+ */
+void SessionLog_Init()
+{
+    __attribute__((aligned(4))) SessionSlot_t slot;
+    __attribute__((aligned(4))) SessionSlot_t next;
+    BOOL found = FALSE;
+    for(uint16_t i = 0; i < SESSION_LOG_SLOTS; i++)
+    {
+        if(!SessionLog_ReadSlot(i, &slot)) continue;
+        uint16_t j = (i + 1) % SESSION_LOG_SLOTS;
+        if(SessionLog_ReadSlot(j, &next) && next.record.seq == (uint16_t)(slot.record.seq + 1)) continue;
+        // stale records from an older layout can leave more than one end, the latest one wins.
+        if(!found || (uint16_t)(slot.record.seq - SessionLog_Seq) < UINT16_MAX / 2)
+        {
+            SessionLog_Next = j;
+            SessionLog_Seq = slot.record.seq + 1;
+            found = TRUE;
+        }
+    }
+}
+
+void SessionLog_Event(uint8_t event, uint16_t arg)
+{
+    SessionRecord_t* r = &SessionLog_Current;
+    if(event == SESSION_LOG_EV_INTERVAL)
+    {
+        SessionLog_Interval = arg;
+        return;
+    }
+    if(event == SESSION_LOG_EV_PHY)
+    {
+        SessionLog_Phy = arg;
+        return;
+    }
+    if(!SessionLog_Active)
+    {
+        // anything else from the engine starts a session.
+        tmos_memset(r, 0, sizeof(SessionRecord_t));
+        SessionLog_Active = TRUE;
+        SessionLog_Created = FALSE;
+        SessionLog_Start = TMOS_GetSystemClock();
+        SessionLog_EraseTicks = 0;
+        SessionLog_ProgramTicks = 0;
+    }
+    switch(event)
+    {
+        case SESSION_LOG_EV_REQUEST:
+            r->mtu = arg;
+            break;
+        case SESSION_LOG_EV_PACKET:
+            r->bytes += arg;
+            break;
+        case SESSION_LOG_EV_DROP:
+            if(r->packet_drops < UINT8_MAX) r->packet_drops++;
+            break;
+        case SESSION_LOG_EV_CREATE:
+            if(SessionLog_Created && r->object_retries < UINT8_MAX) r->object_retries++;
+            SessionLog_Created = TRUE;
+            break;
+        case SESSION_LOG_EV_EXECUTE:
+            SessionLog_Created = FALSE;
+            break;
+        case SESSION_LOG_EV_FLASH_START:
+            SessionLog_FlashOp = arg;
+            SessionLog_FlashStart = TMOS_GetSystemClock();
+            break;
+        case SESSION_LOG_EV_FLASH_DONE:
+        {
+            uint32_t ticks = TMOS_GetSystemClock() - SessionLog_FlashStart;
+            if(SessionLog_FlashOp == OTA_CTRL_POINT_OPCODE_SELECT) SessionLog_EraseTicks += ticks;
+            else SessionLog_ProgramTicks += ticks;
+            break;
+        }
+        case SESSION_LOG_EV_OUTCOME:
+            r->outcome = arg;
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief append the session to the ring, if it got as far as an init packet or object data.
+ *        called when the link goes away or the new image takes over. the cpu stalls for the data flash.
+ */
+void SessionLog_End()
+{
+    if(!SessionLog_Active) return;
+    SessionLog_Active = FALSE;
+    SessionRecord_t* r = &SessionLog_Current;
+    if(!r->bytes && r->outcome == SESSION_OUTCOME_NONE) return; // only queries, nothing worth a flash write.
+    uint32_t duration = (TMOS_GetSystemClock() - SessionLog_Start) * SYSTEM_TIME_MICROSEN / 100000;
+    r->seq = SessionLog_Seq;
+    r->phy = SessionLog_Phy;
+    r->conn_interval = SessionLog_Interval;
+    r->duration = duration > UINT16_MAX ? UINT16_MAX : duration;
+    r->erase_ms = SessionLog_Ms(SessionLog_EraseTicks);
+    r->program_ms = SessionLog_Ms(SessionLog_ProgramTicks);
+
+    __attribute__((aligned(4))) SessionSlot_t slot;
+    tmos_memcpy(&slot.record, r, sizeof(SessionRecord_t));
+    slot.crc = update_CRC32(CRC_INITIAL_VALUE, &slot.record, sizeof(SessionRecord_t));
+    uint32_t addr = SESSION_LOG_ADDR + SessionLog_Next * SESSION_LOG_SLOT_SIZE;
+    // entering a page drops its oldest records, the rest of the page then marks the end of the ring.
+    if(SessionLog_Next % SESSION_LOG_SLOTS_PER_PAGE == 0) EEPROM_ERASE(addr, EEPROM_PAGE_SIZE);
+    EEPROM_WRITE(addr, &slot, sizeof(SessionSlot_t));
+    SessionLog_Next = (SessionLog_Next + 1) % SESSION_LOG_SLOTS;
+    SessionLog_Seq++;
+}
+
+/**
+ * @brief copy out a stored record.
+ *
+ * @param index 0 is the newest record, 1 the one before and so on.
+ * @param pRecord where to copy the record.
+ * @return uint8_t 0 = success. !0 = there is no such record.
+ */
+uint8_t SessionLog_Read(uint8_t index, SessionRecord_t* pRecord)
+{
+    __attribute__((aligned(4))) SessionSlot_t slot;
+    if(index >= SESSION_LOG_SLOTS) return FAILURE;
+    uint16_t i = (SessionLog_Next + SESSION_LOG_SLOTS - 1 - index) % SESSION_LOG_SLOTS;
+    if(!SessionLog_ReadSlot(i, &slot) || slot.record.seq != (uint16_t)(SessionLog_Seq - 1 - index)) return FAILURE;
+    tmos_memcpy(pRecord, &slot.record, sizeof(SessionRecord_t));
+    return SUCCESS;
+}
+
+#endif
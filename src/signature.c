@@ -1,47 +1,88 @@
 #include "signature.h"
 
 
+_Static_assert(sizeof(CryptoArena_t) <= CRYPTO_ARENA_BUDGET, "crypto arena exceeds CRYPTO_ARENA_BUDGET");
+
+// entering a phase hands the whole arena to it. whatever the previous phase left is gone.
+static void CryptoArena_Enter(CryptoArena_t *arena, uint8_t phase)
+{
+    if(arena->phase != phase)
+    {
+        tmos_memset(arena, 0, sizeof(CryptoArena_t));
+        arena->phase = phase;
+    }
+}
+
+/**
+ * @brief get the buffer to load the signing key into. it belongs to the verification phase,
+ *        so it is wiped as soon as VerifySignature is done with it.
+ *
+ * @return uint8_t* SIGNATURE_KEY_LEN bytes, dword aligned.
+ */
+uint8_t* GetSignatureKeyBuffer(CryptoArena_t *arena)
+{
+    CryptoArena_Enter(arena, CRYPTO_PHASE_VERIFY);
+    return arena->verify.key;
+}
+
 /**
  * @brief 
  * 
+ * @param arena the crypto arena to work in.
  * @param pData start address of message.
  * @param len length of message.
  * @param pSignature pointer to signature to be verified.
  * @param pKey pointer to the signing key. Length is determined by the signature algorithm.
  * @return bStatus_t 0 means success. !0 means failure.
  */
-bStatus_t VerifySignature(uint8_t *pData, uint8_t len, uint8_t *pSignature, uint8_t *pKey)
+bStatus_t VerifySignature(CryptoArena_t *arena, uint8_t *pData, uint8_t len, uint8_t *pSignature, uint8_t *pKey)
 {
-    uint8_t buffer[SIGNATURE_LEN];
+    bStatus_t result = 1;
+    // the key may already be in the arena, so entering the phase must not wipe it.
+    if(pKey != arena->verify.key) CryptoArena_Enter(arena, CRYPTO_PHASE_VERIFY);
 #if SIGNATURE_ALGO == SIG_HMAC256
-    hmacCompute(SHA256_HASH_ALGO, pKey, SIGNATURE_KEY_LEN, pData, len, buffer);
-    return !tmos_memcmp(buffer, pSignature, SIGNATURE_LEN);
+    // the one shot hmacCompute would put the whole context on our 512 bytes stack.
+    if(!hmacInit(&arena->verify.context, SHA256_HASH_ALGO, pKey, SIGNATURE_KEY_LEN))
+    {
+        hmacUpdate(&arena->verify.context, pData, len);
+        hmacFinal(&arena->verify.context, arena->verify.mac);
+        result = !tmos_memcmp(arena->verify.mac, pSignature, SIGNATURE_LEN);
+    }
 #elif SIGNATURE_ALGO == SIG_CMACAES
-    cmacCompute(AES_CIPHER_ALGO, pKey, SIGNATURE_KEY_LEN, pData, len, buffer, SIGNATURE_LEN);
-    return !tmos_memcmp(buffer, pSignature, SIGNATURE_LEN);
-#else
-    return 1;
+    if(!cmacInit(&arena->verify.context, AES_CIPHER_ALGO, pKey, SIGNATURE_KEY_LEN))
+    {
+        cmacUpdate(&arena->verify.context, pData, len);
+        if(!cmacFinal(&arena->verify.context, arena->verify.mac, SIGNATURE_LEN))
+        {
+            result = !tmos_memcmp(arena->verify.mac, pSignature, SIGNATURE_LEN);
+        }
+    }
 #endif
+    // don't leave the key and the contexts derived from it lying around.
+    tmos_memset(&arena->verify, 0, sizeof(arena->verify));
+    return result;
 }
 
-static Sha256Context hash_context;
-static uint8_t digest[SHA256_DIGEST_SIZE];
-void InitHash()
+void InitHash(CryptoArena_t *arena)
 {
-    sha256Init(&hash_context);
+    CryptoArena_Enter(arena, CRYPTO_PHASE_HASH);
+    sha256Init(&arena->hash.context);
 }
-void UpdateHash(const void *data, size_t length)
+void UpdateHash(CryptoArena_t *arena, const void *data, size_t length)
 {
-    sha256Update(&hash_context, data, length);
+    sha256Update(&arena->hash.context, data, length);
 }
 /**
  * @brief verify the provided hash with calculated one.
  * 
+ * @param arena the crypto arena to work in.
  * @param hash the provided hash to compare with.
  * @return bStatus_t 0 = success. !0 = failure.
  */
-bStatus_t VerifyHash(const void *hash)
+bStatus_t VerifyHash(CryptoArena_t *arena, const void *hash)
 {
-    sha256Final(&hash_context, digest);
-    return !tmos_memcmp(digest, hash, SHA256_DIGEST_SIZE);
+    // the arena was handed to another phase since InitHash, the hash is gone.
+    if(arena->phase != CRYPTO_PHASE_HASH) return 1;
+    sha256Final(&arena->hash.context, arena->hash.digest);
+    return !tmos_memcmp(arena->hash.digest, hash, SHA256_DIGEST_SIZE);
 }
\ No newline at end of file
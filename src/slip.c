@@ -0,0 +1,79 @@
+#include "slip.h"
+
+
+void Slip_DecoderInit(Slip_Decoder_t* dec, uint8_t* pBuf, uint16_t size)
+{
+    dec->pBuf = pBuf;
+    dec->size = size;
+    dec->len = 0;
+    dec->escaped = 0;
+    dec->overflow = 0;
+}
+
+/**
+ * @brief feed one received byte to the decoder.
+ *
+ * @param dec the decoder.
+ * @param byte the received byte.
+ * @return uint16_t length of the frame in dec->pBuf when this byte completed one. 0 otherwise.
+ *         the frame stays valid until the next byte is fed.
+ */
+uint16_t Slip_Decode(Slip_Decoder_t* dec, uint8_t byte)
+{
+    if(byte == SLIP_END)
+    {
+        // empty frames are just the leading delimiter of the next one.
+        uint16_t len = dec->overflow ? 0 : dec->len;
+        dec->len = 0;
+        dec->escaped = 0;
+        dec->overflow = 0;
+        return len;
+    }
+    if(byte == SLIP_ESC)
+    {
+        dec->escaped = 1;
+        return 0;
+    }
+    if(dec->escaped)
+    {
+        dec->escaped = 0;
+        if(byte == SLIP_ESC_END) byte = SLIP_END;
+        else if(byte == SLIP_ESC_ESC) byte = SLIP_ESC;
+    }
+    if(dec->len < dec->size) dec->pBuf[dec->len++] = byte;
+    else dec->overflow = 1;
+    return 0;
+}
+
+/**
+ * @brief encode a frame, with an END delimiter on both ends.
+ *
+ * @param pDst at least SLIP_ENCODED_MAX(len) bytes.
+ * @param pSrc the frame.
+ * @param len length of the frame.
+ * @return uint16_t encoded length.
+ */
+uint16_t Slip_Encode(uint8_t* pDst, const uint8_t* pSrc, uint16_t len)
+{
+    uint16_t n = 0;
+    pDst[n++] = SLIP_END;
+    for(uint16_t i = 0; i < len; i++)
+    {
+        if(pSrc[i] == SLIP_END)
+        {
+            pDst[n++] = SLIP_ESC;
+            pDst[n++] = SLIP_ESC_END;
+        }
+        else if(pSrc[i] == SLIP_ESC)
+        {
+            pDst[n++] = SLIP_ESC;
+            pDst[n++] = SLIP_ESC_ESC;
+        }
+        else
+        {
+            pDst[n++] = pSrc[i];
+        }
+    }
+    pDst[n++] = SLIP_END;
+    return n;
+}
@@ -0,0 +1,49 @@
+#include "config.h"
+#include "trace.h"
+
+#if TRACE_RING
+
+// records are only written from the TMOS context, so a single free running index is all the locking we need.
+static TraceRecord_t Trace_Ring[TRACE_RING_SIZE];
+static uint16_t Trace_Head = 0; // sequence number of the next record.
+
+void Trace_Record(uint8_t event, uint8_t arg8, uint16_t arg16)
+{
+    TraceRecord_t* p = &Trace_Ring[Trace_Head & (TRACE_RING_SIZE - 1)];
+    p->time = TMOS_GetSystemClock();
+    p->event = event;
+    p->arg8 = arg8;
+    p->arg16 = arg16;
+    Trace_Head++;
+}
+
+/**
+ * @brief copy records out of the ring, starting at a sequence number.
+ *
+ * @param seq sequence number of the first record wanted. moved forward if it was already overwritten.
+ * @param pRecords where to copy the records.
+ * @param count max number of records to copy.
+ * @param pHead sequence number of the next record to be written.
+ * @return uint16_t sequence number of the first record copied.
+ */
+uint16_t Trace_Read(uint16_t seq, TraceRecord_t* pRecords, uint8_t count, uint16_t* pHead)
+{
+    uint16_t head = Trace_Head;
+    if((uint16_t)(head - seq) > TRACE_RING_SIZE) seq = head - TRACE_RING_SIZE;
+    for(uint8_t i = 0; i < count; i++)
+    {
+        // head and everything after it is not written yet, or is left from a lap ago.
+        if((uint16_t)(seq + i - head) < 0x8000)
+        {
+            tmos_memset(&pRecords[i], 0, sizeof(TraceRecord_t));
+        }
+        else
+        {
+            tmos_memcpy(&pRecords[i], &Trace_Ring[(seq + i) & (TRACE_RING_SIZE - 1)], sizeof(TraceRecord_t));
+        }
+    }
+    *pHead = head;
+    return seq;
+}
+
+#endif
@@ -0,0 +1,112 @@
+#include "uart_transport.h"
+#include "OTA_engine.h"
+#include "slip.h"
+
+#if UART_TRANSPORT
+
+// the interrupt only moves bytes from the 8 bytes hardware fifo to this ring, all decoding is done in the task.
+// the interrupt writes the head and the task the tail, so no locking is needed.
+static uint8_t Uart_Rx[UART_TRANSPORT_RX_RING];
+static volatile uint16_t Uart_RxHead = 0;
+static uint16_t Uart_RxTail = 0;
+static volatile uint16_t Uart_RxOverflow = 0; // bytes lost because the ring was full.
+static uint8_t Uart_Frame[UART_TRANSPORT_MTU];
+static Slip_Decoder_t Uart_Decoder;
+static UartTransport_FrameCB_t Uart_FrameCB;
+// a response is at most the 3 header bytes and the largest content.
+static uint8_t Uart_Tx[SLIP_ENCODED_MAX(3 + OTA_RSP_CONTENT_MAX_LEN)];
+
+void UartTransport_Init(uint8_t taskID, uint16_t event, UartTransport_FrameCB_t cb)
+{
+    Uart_FrameCB = cb;
+    Slip_DecoderInit(&Uart_Decoder, Uart_Frame, sizeof(Uart_Frame));
+    GPIOA_SetBits(GPIO_Pin_9);
+    GPIOA_ModeCfg(GPIO_Pin_8, GPIO_ModeIN_PU);
+    GPIOA_ModeCfg(GPIO_Pin_9, GPIO_ModeOut_PP_5mA);
+    UART1_DefInit();
+    UART1_BaudRateCfg(UART_TRANSPORT_BAUD);
+    // interrupt when the fifo is half full, the receive timeout picks up the tail of a frame.
+    UART1_ByteTrigCfg(UART_4BYTE_TRIG);
+    UART1_INTCfg(ENABLE, RB_IER_RECV_RDY | RB_IER_LINE_STAT);
+    PFIC_EnableIRQ(UART1_IRQn);
+    // TMOS events must not be raised from interrupts, so the task polls the ring instead.
+    tmos_start_reload_task(taskID, event, UART_TRANSPORT_POLL_TICKS);
+}
+
+__INTERRUPT __HIGH_CODE void UART1_IRQHandler(void)
+{
+    switch(UART1_GetITFlag())
+    {
+        case UART_II_LINE_STAT:
+            // reading the status clears it. a framing error shows up as a bad frame, which the host retries.
+            UART1_GetLinSTA();
+            break;
+        case UART_II_RECV_RDY:
+        case UART_II_RECV_TOUT:
+            while(R8_UART1_RFC)
+            {
+                uint8_t byte = R8_UART1_RBR;
+                uint16_t head = Uart_RxHead;
+                if((uint16_t)(head - Uart_RxTail) < UART_TRANSPORT_RX_RING)
+                {
+                    Uart_Rx[head & (UART_TRANSPORT_RX_RING - 1)] = byte;
+                    Uart_RxHead = head + 1;
+                }
+                else
+                {
+                    Uart_RxOverflow++;
+                }
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief decode what the interrupt received since the last poll and hand over complete frames.
+ *        called from the owner task when the poll event is raised.
+ */
+void UartTransport_ProcessEvent()
+{
+    uint16_t lost = Uart_RxOverflow;
+    uint16_t head = Uart_RxHead;
+    if(lost)
+    {
+        // we can't tell which frame lost the bytes, so everything buffered is dropped up to the next END.
+        // the host notices it on the next CRC request, the same as a lost packet write.
+        TRACE(TRACE_EV_PACKET_DROP, 0, lost);
+        Uart_RxOverflow = 0;
+        Uart_RxTail = head;
+        Uart_Decoder.overflow = 1;
+        return;
+    }
+    while(Uart_RxTail != head)
+    {
+        uint16_t len = Slip_Decode(&Uart_Decoder, Uart_Rx[Uart_RxTail & (UART_TRANSPORT_RX_RING - 1)]);
+        Uart_RxTail++;
+        if(len) Uart_FrameCB(Uart_Frame, len);
+    }
+}
+
+void UartTransport_SendRsp(uint8_t opcode, OTA_CtrlPointRsp_t* rsp, OtaRspCode_t rspCode)
+{
+    // the frame goes to the end of the tx buffer and is encoded onto itself from the front.
+    // an encoded byte takes at most 2, so the encoder never writes past what it reads next.
+    uint8_t* frame = Uart_Tx + sizeof(Uart_Tx) - (3 + OTA_RSP_CONTENT_MAX_LEN);
+    uint8_t* content;
+    uint16_t content_len;
+    if (opcode != OTA_CTRL_POINT_OPCODE_TRACE_DUMP)
+    {
+        TRACE(TRACE_EV_CTRL_RSP, opcode, rspCode);
+    }
+    content_len = OTA_GetRspContent(opcode, rspCode, rsp, &content);
+    frame[0] = OTA_CTRL_POINT_OPCODE_RSP;
+    frame[1] = opcode;
+    frame[2] = rspCode;
+    tmos_memcpy(frame + 3, content, content_len);
+    // the tx fifo is drained by polling, a response is a few dozen bytes so it is over in well under a millisecond.
+    UART1_SendString(Uart_Tx, Slip_Encode(Uart_Tx, frame, content_len + 3));
+}
+
+#endif
@@ -0,0 +1,95 @@
+#include "write_queue.h"
+
+#if WRITE_QUEUE
+
+_Static_assert(WRITE_QUEUE_SIZE % 4 == 0 && WRITE_QUEUE_SIZE <= 0x8000, "the ring holds whole words and its offsets fit a uint16_t");
+_Static_assert(sizeof(WriteQueue_Entry_t) % 4 == 0, "payloads start dword aligned");
+
+// head == tail is empty, so head never catches up with tail from behind.
+static __attribute__((aligned(4))) uint8_t Queue_Buffer[WRITE_QUEUE_SIZE];
+static volatile uint16_t Queue_Head = 0;
+static volatile uint16_t Queue_Tail = 0;
+
+void WriteQueue_Init()
+{
+    Queue_Head = 0;
+    Queue_Tail = 0;
+}
+
+/**
+ * @brief copy a write to the ring. only called by the producer.
+ *
+ * @param kind WRITE_QUEUE_PACKET or WRITE_QUEUE_CTRL_POINT. a packet also needs WRITE_QUEUE_CTRL_RESERVE bytes left behind it.
+ * @param flags WRITE_QUEUE_FLAG_*.
+ * @param connHandle the connection it came from.
+ * @param attrHandle the attribute written.
+ * @param pValue the value, only valid during the call.
+ * @param len its length.
+ * @return bStatus_t 0 = success. !0 = no room, nothing was copied.
+ */
+bStatus_t WriteQueue_Push(uint8_t kind, uint8_t flags, uint16_t connHandle, uint16_t attrHandle, const uint8_t* pValue, uint16_t len)
+{
+    uint32_t need = sizeof(WriteQueue_Entry_t) + ((len + 3) & ~3);
+    // the reserve is counted in the same part of the ring the entry goes to.
+    uint32_t room = need + (kind == WRITE_QUEUE_PACKET ? WRITE_QUEUE_CTRL_RESERVE : 0);
+    uint16_t head = Queue_Head;
+    uint16_t tail = Queue_Tail;
+    uint16_t pos = head;
+    WriteQueue_Entry_t* pEntry;
+    if(head >= tail)
+    {
+        // up to the end, unless head would wrap onto a tail at 0. otherwise start over at 0, in front of the tail.
+        if(WRITE_QUEUE_SIZE - head < room + (tail == 0))
+        {
+            if(tail <= room) return FAILURE;
+            pos = 0;
+        }
+    }
+    else if(tail - head <= room)
+    {
+        return FAILURE;
+    }
+    if(pos != head && WRITE_QUEUE_SIZE - head >= sizeof(WriteQueue_Entry_t))
+    {
+        ((WriteQueue_Entry_t*)(Queue_Buffer + head))->kind = WRITE_QUEUE_WRAP;
+    }
+    pEntry = (WriteQueue_Entry_t*)(Queue_Buffer + pos);
+    pEntry->len = len;
+    pEntry->kind = kind;
+    pEntry->flags = flags;
+    pEntry->connHandle = connHandle;
+    pEntry->attrHandle = attrHandle;
+    tmos_memcpy(pEntry + 1, pValue, len);
+    Queue_Head = pos + need == WRITE_QUEUE_SIZE ? 0 : pos + need;
+    return SUCCESS;
+}
+
+/**
+ * @brief the oldest entry. only called by the consumer.
+ *
+ * @return WriteQueue_Entry_t* the entry, valid until WriteQueue_Pop. NULL when the ring is empty.
+ */
+WriteQueue_Entry_t* WriteQueue_Peek()
+{
+    uint16_t tail = Queue_Tail;
+    if(tail == Queue_Head) return NULL;
+    // no room for a header at the end is a wrap as well.
+    if(WRITE_QUEUE_SIZE - tail < sizeof(WriteQueue_Entry_t) || ((WriteQueue_Entry_t*)(Queue_Buffer + tail))->kind == WRITE_QUEUE_WRAP)
+    {
+        Queue_Tail = tail = 0;
+        if(tail == Queue_Head) return NULL;
+    }
+    return (WriteQueue_Entry_t*)(Queue_Buffer + tail);
+}
+
+/**
+ * @brief drop the entry returned by WriteQueue_Peek. only called by the consumer.
+ */
+void WriteQueue_Pop()
+{
+    uint16_t tail = Queue_Tail;
+    uint32_t next = tail + sizeof(WriteQueue_Entry_t) + ((((WriteQueue_Entry_t*)(Queue_Buffer + tail))->len + 3) & ~3);
+    Queue_Tail = next == WRITE_QUEUE_SIZE ? 0 : next;
+}
+
+#endif
@@ -0,0 +1,224 @@
+#include "bundle.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+namespace dfu
+{
+
+namespace
+{
+
+constexpr size_t kImageAlign = 4096;
+// records or pages a worker takes at a time, enough to not fight over the counter.
+constexpr size_t kBatch = 64;
+
+size_t Align(size_t value, size_t align)
+{
+    return (value + align - 1) / align * align;
+}
+
+int HexDigit(char c)
+{
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// runs fn(begin, end) over [0, count) in batches on up to threads threads.
+template<typename Fn>
+void ParallelFor(size_t count, unsigned threads, Fn fn)
+{
+    std::atomic<size_t> next{0};
+    auto worker = [&] {
+        for(size_t begin; (begin = next.fetch_add(kBatch)) < count;) fn(begin, std::min(begin + kBatch, count));
+    };
+    threads = std::max(1u, std::min<unsigned>(threads, (count + kBatch - 1) / kBatch));
+    std::vector<std::thread> pool;
+    for(unsigned i = 1; i < threads; i++) pool.emplace_back(worker);
+    worker();
+    for(std::thread& t : pool) t.join();
+}
+
+}  // namespace
+
+bool ReadKeys(const std::string& path, std::vector<BundleDevice>& devices, std::string& error)
+{
+    std::ifstream f(path);
+    if(!f)
+    {
+        error = "cannot open " + path;
+        return false;
+    }
+    std::string line;
+    for(unsigned lineNo = 1; std::getline(f, line); lineNo++)
+    {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        BundleDevice dev;
+        std::string hex;
+        if(!(fields >> dev.id)) continue;
+        bool ok = (fields >> hex) && hex.size() == 2 * dev.key.size();
+        for(size_t i = 0; ok && i < dev.key.size(); i++)
+        {
+            int hi = HexDigit(hex[2 * i]), lo = HexDigit(hex[2 * i + 1]);
+            ok = hi >= 0 && lo >= 0;
+            dev.key[i] = hi << 4 | lo;
+        }
+        if(!ok)
+        {
+            error = path + ":" + std::to_string(lineNo) + ": expected an id and " + std::to_string(2 * dev.key.size()) + " hex digits";
+            return false;
+        }
+        devices.push_back(std::move(dev));
+    }
+    return true;
+}
+
+bool WriteBundle(const std::string& path, const CmdObject_t& cmd, const uint8_t* pImage, size_t size,
+                 std::vector<BundleDevice> devices, const BundleOptions& options, std::string& error)
+{
+    std::sort(devices.begin(), devices.end(), [](const BundleDevice& a, const BundleDevice& b) { return a.id < b.id; });
+    for(size_t i = 0; i < devices.size(); i++)
+    {
+        if(devices[i].id.empty() || devices[i].id.size() >= kBundleIdLen)
+        {
+            error = "device id '" + devices[i].id + "' must be 1 to " + std::to_string(kBundleIdLen - 1) + " characters";
+            return false;
+        }
+        if(i && devices[i].id == devices[i - 1].id)
+        {
+            error = "device " + devices[i].id + " is listed twice";
+            return false;
+        }
+    }
+
+    BundleHeader header{};
+    header.magic = kBundleMagic;
+    header.version = kBundleVersion;
+    header.cmdSize = sizeof(CmdObject_t);
+    header.deviceCount = devices.size();
+    header.recordsOffset = Align(sizeof(header), 64);
+    header.pageSize = options.pageSize;
+    header.pageCount = options.pageSize ? (size + options.pageSize - 1) / options.pageSize : 0;
+    header.pagesOffset = Align(header.recordsOffset + devices.size() * sizeof(BundleRecord), 64);
+    header.imageOffset = Align(header.pagesOffset + header.pageCount * sizeof(BundlePage), kImageAlign);
+    header.imageSize = size;
+    header.cmd = cmd;
+    std::memset(header.cmd.obj_signature, 0, sizeof(header.cmd.obj_signature));
+    size_t fileSize = header.imageOffset + size;
+
+    std::string tmp = path + ".tmp";
+    int fd = open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+    {
+        error = tmp + ": " + std::strerror(errno);
+        return false;
+    }
+    void* p = ftruncate(fd, fileSize) ? MAP_FAILED : mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(p == MAP_FAILED)
+    {
+        error = tmp + ": " + std::strerror(errno);
+        close(fd);
+        unlink(tmp.c_str());
+        return false;
+    }
+    uint8_t* pFile = static_cast<uint8_t*>(p);
+    std::memcpy(pFile, &header, sizeof(header));
+    std::memcpy(pFile + header.imageOffset, pImage, size);
+
+    unsigned threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    BundleRecord* pRecords = reinterpret_cast<BundleRecord*>(pFile + header.recordsOffset);
+    ParallelFor(devices.size(), threads, [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++)
+        {
+            BundleRecord& record = pRecords[i];
+            // ids are checked to be shorter than the field above, so it always ends in a zero.
+            std::memset(record.id, 0, sizeof(record.id));
+            std::memcpy(record.id, devices[i].id.data(), devices[i].id.size());
+            record.cmd = header.cmd;
+            SignCmdObject(record.cmd, devices[i].key);
+        }
+    });
+    BundlePage* pPages = reinterpret_cast<BundlePage*>(pFile + header.pagesOffset);
+    ParallelFor(header.pageCount, threads, [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++)
+        {
+            size_t offset = i * options.pageSize;
+            size_t len = std::min<size_t>(options.pageSize, size - offset);
+            sha256Compute(pImage + offset, len, pPages[i].digest);
+            // a page past the end of the base image is new, so changed as well.
+            bool same = options.pBase && offset + len <= options.baseSize && !std::memcmp(pImage + offset, options.pBase + offset, len);
+            pPages[i].flags = options.pBase && !same ? kBundlePageChanged : 0;
+        }
+    });
+
+    bool ok = msync(p, fileSize, MS_SYNC) == 0;
+    if(!ok) error = tmp + ": " + std::strerror(errno);
+    munmap(p, fileSize);
+    close(fd);
+    if(ok && rename(tmp.c_str(), path.c_str()))
+    {
+        error = path + ": " + std::strerror(errno);
+        ok = false;
+    }
+    if(!ok) unlink(tmp.c_str());
+    return ok;
+}
+
+bool Bundle::Open(const std::string& path, std::string& error)
+{
+    if(!file_.Open(path))
+    {
+        error = "cannot map " + path;
+        return false;
+    }
+    if(file_.Size() < sizeof(BundleHeader))
+    {
+        error = path + " is too short for a bundle";
+        return false;
+    }
+    const BundleHeader& h = Header();
+    if(h.magic != kBundleMagic || h.version != kBundleVersion)
+    {
+        error = path + " is not a version " + std::to_string(kBundleVersion) + " bundle";
+        return false;
+    }
+    if(h.cmdSize != sizeof(CmdObject_t))
+    {
+        error = path + " was made for another signature algorithm";
+        return false;
+    }
+    uint64_t recordsEnd = h.recordsOffset + uint64_t(h.deviceCount) * sizeof(BundleRecord);
+    uint64_t pagesEnd = h.pagesOffset + uint64_t(h.pageCount) * sizeof(BundlePage);
+    if(recordsEnd > file_.Size() || pagesEnd > file_.Size() || uint64_t(h.imageOffset) + h.imageSize > file_.Size()
+       || h.imageSize != h.cmd.bin_size)
+    {
+        error = path + " is truncated or inconsistent";
+        return false;
+    }
+    return true;
+}
+
+const BundleRecord* Bundle::Find(const std::string& id) const
+{
+    const BundleRecord* pBegin = Records();
+    const BundleRecord* pEnd = pBegin + DeviceCount();
+    const BundleRecord* p = std::lower_bound(pBegin, pEnd, id, [](const BundleRecord& record, const std::string& key) {
+        return std::strncmp(record.id, key.c_str(), sizeof(record.id)) < 0;
+    });
+    return p != pEnd && std::strncmp(p->id, id.c_str(), sizeof(p->id)) == 0 ? p : nullptr;
+}
+
+}  // namespace dfu
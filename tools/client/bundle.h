@@ -0,0 +1,112 @@
+// a release bundle: the image and an init packet signed for every device, in one file the orchestrator maps
+// and streams from. the image is hashed once and the init packets are signed in parallel, so a release for
+// thousands of devices takes about as long as reading the image.
+//
+// layout, little endian like the devices:
+//   BundleHeader
+//   BundleRecord[deviceCount]  sorted by id
+//   BundlePage[pageCount]      optional, a digest per page of the image
+//   the image                  at a 4K aligned offset
+
+#ifndef DFU_BUNDLE_H
+#define DFU_BUNDLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "dfu_client.h"
+
+namespace dfu
+{
+
+constexpr uint32_t kBundleMagic = 0x42554644; // "DFUB".
+constexpr uint32_t kBundleVersion = 1;
+constexpr size_t kBundleIdLen = 32; // with the terminating 0.
+constexpr uint32_t kBundlePageChanged = 0x01; // the page differs from the base image.
+
+struct BundleHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t cmdSize; // sizeof(CmdObject_t), differs with the signature algorithm.
+    uint32_t deviceCount;
+    uint32_t recordsOffset;
+    uint32_t pageSize; // 0 without page digests.
+    uint32_t pageCount;
+    uint32_t pagesOffset;
+    uint32_t imageOffset;
+    uint32_t imageSize;
+    CmdObject_t cmd; // the init packet every record is signed from, without a signature.
+};
+
+struct BundleRecord
+{
+    char id[kBundleIdLen];
+    CmdObject_t cmd;
+};
+
+struct BundlePage
+{
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    uint32_t flags;
+};
+
+struct BundleDevice
+{
+    std::string id;
+    DeviceKey key;
+};
+
+struct BundleOptions
+{
+    unsigned threads = 0; // 0 uses every core.
+    uint32_t pageSize = 0; // 0 leaves out the page digests.
+    const uint8_t* pBase = nullptr; // the image devices run now, to flag the changed pages.
+    size_t baseSize = 0;
+};
+
+// reads "<id> <key in hex>" lines, # starts a comment.
+bool ReadKeys(const std::string& path, std::vector<BundleDevice>& devices, std::string& error);
+
+// writes the bundle to path, through a temporary file so a reader never maps half a bundle.
+bool WriteBundle(const std::string& path, const CmdObject_t& cmd, const uint8_t* pImage, size_t size,
+                 std::vector<BundleDevice> devices, const BundleOptions& options, std::string& error);
+
+// a bundle mapped read only.
+class Bundle
+{
+public:
+    Bundle() = default;
+    Bundle(const Bundle&) = delete;
+    Bundle& operator=(const Bundle&) = delete;
+
+    bool Open(const std::string& path, std::string& error);
+
+    const BundleHeader& Header() const { return *reinterpret_cast<const BundleHeader*>(file_.Data()); }
+    const uint8_t* Image() const { return file_.Data() + Header().imageOffset; }
+    size_t ImageSize() const { return Header().imageSize; }
+    size_t DeviceCount() const { return Header().deviceCount; }
+    const BundleRecord& Record(size_t i) const { return Records()[i]; }
+    // the record of a device, nullptr when it is not in the bundle.
+    const BundleRecord* Find(const std::string& id) const;
+    size_t PageCount() const { return Header().pageCount; }
+    const BundlePage& Page(size_t i) const
+    {
+        return reinterpret_cast<const BundlePage*>(file_.Data() + Header().pagesOffset)[i];
+    }
+
+private:
+    const BundleRecord* Records() const
+    {
+        return reinterpret_cast<const BundleRecord*>(file_.Data() + Header().recordsOffset);
+    }
+
+    MappedFile file_;
+};
+
+}  // namespace dfu
+
+#endif /* DFU_BUNDLE_H */
@@ -0,0 +1,263 @@
+// updates a device with the DFU client library.
+//
+// usage: dfu [-k key file] [-V fw version] [-d] [-w window] [-c crc every] [-o init packet] [-b baud]
+//            (-p serial port | -s [-Q drop every] [-R recording]) [-M] (-L | -I | -C | <image>)
+//   -k  the device's signing key, SIGNATURE_KEY_LEN raw bytes. all zeros otherwise.
+//   -V  firmware version put in the init packet. -d marks it debug, the device then skips the version check.
+//   -w  control point requests in flight at most. -c also checks the CRC every this many packets.
+//   -o  also write the signed init packet to this file.
+//   -p  update over a serial port (the UART transport or tools/sim/uart_sim).
+//   -s  update an in-process simulated device, with the same key.
+//   -Q  the simulated device drops every this many packets like a full write queue, the client resumes the object.
+//   -R  also write the simulated device's traffic to this file as a GATT recording, for tools/sim/gatt_replay.
+//   -L  print the device's session log instead of updating it. the firmware must be built with SESSION_LOG.
+//   -I  print the version and digest of the application the device has installed instead of updating it.
+//   -C  print the device's capability descriptor instead of updating it.
+//   -M  print the device's stack and BLE heap high water marks after the rest, or alone. the firmware must be
+//       built with MEM_WATERMARK. the simulated device measures them on the host, see SimDevice::SetMemWatermark.
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "dfu_client.h"
+#include "serial_transport.h"
+#include "sim_transport.h"
+
+namespace
+{
+
+void Usage()
+{
+    std::fprintf(stderr, "usage: dfu [-k key file] [-V fw version] [-d] [-w window] [-c crc every] [-o init packet] [-b baud]\n"
+                         "           (-p serial port | -s [-Q drop every] [-R recording]) [-M] (-L | -I | -C | <image>)\n");
+}
+
+const char* OutcomeName(uint8_t outcome)
+{
+    switch(outcome)
+    {
+        case SESSION_OUTCOME_NONE: return "none";
+        case SESSION_OUTCOME_INTERRUPTED: return "interrupted";
+        case SESSION_OUTCOME_UPDATED: return "updated";
+        case SESSION_OUTCOME_REJECTED: return "rejected";
+        case SESSION_OUTCOME_HASH_FAILED: return "hash failed";
+        case SESSION_OUTCOME_FLASH_ERROR: return "flash error";
+        default: return "?";
+    }
+}
+
+void PrintSessionLog(const std::vector<SessionRecord_t>& records)
+{
+    std::printf("  seq outcome       bytes     time   mtu interval phy retries drops erase ms program ms\n");
+    for(const SessionRecord_t& r : records)
+    {
+        std::printf("%5u %-11s %9u %7.1fs %5u %6.2fms %3u %7u %5u %8u %10u\n", r.seq, OutcomeName(r.outcome), r.bytes,
+                    r.duration / 10.0, r.mtu, r.conn_interval * 1.25, r.phy, r.object_retries, r.packet_drops, r.erase_ms,
+                    r.program_ms);
+    }
+}
+
+void PrintCapabilities(const dfu::DeviceCapabilities& caps)
+{
+    const OTA_CtrlPointRsp_Hardware_t& hw = caps.hardware;
+    std::printf("protocol %u, part 0x%X variant 0x%X, rom %u ram %u page %u\n", caps.protocol, hw.part, hw.variant,
+                hw.memory.rom_size, hw.memory.ram_size, hw.memory.rom_page_size);
+    for(const OTA_CtrlPointRsp_Firmware_t& fw : caps.firmware)
+    {
+        std::printf("firmware %u: version %u at 0x%05X, %u bytes\n", fw.type, fw.version, fw.addr, fw.len);
+    }
+    std::printf("max object %u, mtu %u, signature %u, compression %u, transports 0x%02X, features 0x%02X\n", caps.maxObject,
+                caps.mtu, caps.modes.signature, caps.modes.compression, caps.modes.transports, caps.modes.features);
+    std::printf("command object at %u crc %08X, data object at %u crc %08X\n", caps.cmdObject.offset, caps.cmdObject.crc,
+                caps.dataObject.offset, caps.dataObject.crc);
+}
+
+// the marks, after whatever else was asked of the device.
+int PrintMemUsage(dfu::DfuClient& client)
+{
+    OTA_CtrlPointRsp_Mem_t mem;
+    if(!client.ReadMemUsage(mem))
+    {
+        std::fprintf(stderr, "reading the memory usage failed: %s\n", client.Error().c_str());
+        return 1;
+    }
+    std::printf("stack %u of %u bytes, heap %u of %u bytes\n", mem.stack_used, mem.stack_size, mem.heap_used, mem.heap_size);
+    return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    uint8_t key[SIGNATURE_KEY_LEN] = {};
+    dfu::FirmwareInfo info;
+    dfu::ClientOptions options;
+    std::string port;
+    std::string initPath;
+    std::string recordPath;
+    uint32_t queueDrops = 0;
+    uint32_t baud = 1500000;
+    bool simulated = false;
+    bool readLog = false;
+    bool readImage = false;
+    bool readCaps = false;
+    bool readMem = false;
+    int opt;
+    while((opt = getopt(argc, argv, "k:V:dw:c:o:b:p:sQ:R:LICM")) != -1)
+    {
+        switch(opt)
+        {
+            case 'k':
+            {
+                std::ifstream f(optarg, std::ios::binary);
+                if(!f.read(reinterpret_cast<char*>(key), sizeof(key)))
+                {
+                    std::fprintf(stderr, "cannot read %u key bytes from %s\n", SIGNATURE_KEY_LEN, optarg);
+                    return 2;
+                }
+                break;
+            }
+            case 'V': info.fwVersion = std::strtoul(optarg, nullptr, 0); break;
+            case 'd': info.debug = true; break;
+            case 'w': options.window = std::strtoul(optarg, nullptr, 0); break;
+            case 'c': options.crcEvery = std::strtoul(optarg, nullptr, 0); break;
+            case 'o': initPath = optarg; break;
+            case 'b': baud = std::strtoul(optarg, nullptr, 0); break;
+            case 'p': port = optarg; break;
+            case 's': simulated = true; break;
+            case 'Q': queueDrops = std::strtoul(optarg, nullptr, 0); break;
+            case 'R': recordPath = optarg; break;
+            case 'L': readLog = true; break;
+            case 'I': readImage = true; break;
+            case 'C': readCaps = true; break;
+            case 'M': readMem = true; break;
+            default: Usage(); return 2;
+        }
+    }
+    bool query = readLog || readImage || readCaps;
+    // -M alone only reads the marks.
+    bool update = !query && !(readMem && optind == argc);
+    if(optind + update != argc || readLog + readImage + readCaps > 1 || port.empty() == !simulated ||
+       ((!recordPath.empty() || queueDrops) && !simulated))
+    {
+        Usage();
+        return 2;
+    }
+
+    dfu::MappedFile image;
+    CmdObject_t cmd;
+    if(update)
+    {
+        if(!image.Open(argv[optind]))
+        {
+            std::fprintf(stderr, "cannot map %s\n", argv[optind]);
+            return 1;
+        }
+        if(image.Size() > APPLICATION_MAX_SIZE)
+        {
+            std::fprintf(stderr, "%s is larger than the application region (%u bytes)\n", argv[optind], APPLICATION_MAX_SIZE);
+            return 1;
+        }
+        cmd = dfu::BuildCmdObject(info, image.Data(), image.Size(), key);
+        if(!initPath.empty())
+        {
+            std::ofstream f(initPath, std::ios::binary);
+            f.write(reinterpret_cast<const char*>(&cmd), sizeof(cmd));
+        }
+    }
+
+    std::unique_ptr<sim::SimDevice> dev;
+    std::ofstream recording;
+    std::unique_ptr<dfu::Transport> transport;
+    if(simulated)
+    {
+        dev = std::make_unique<sim::SimDevice>(key);
+        dev->SetMemWatermark(readMem);
+        dev->SetQueueDrops(queueDrops);
+        if(!recordPath.empty())
+        {
+            recording.open(recordPath, std::ios::binary);
+            if(!recording)
+            {
+                std::fprintf(stderr, "cannot create %s\n", recordPath.c_str());
+                return 1;
+            }
+            dev->SetRecording(&recording);
+        }
+        transport = std::make_unique<dfu::SimTransport>(*dev);
+    }
+    else
+    {
+        auto serial = std::make_unique<dfu::SerialTransport>();
+        if(!serial->Open(port, baud))
+        {
+            std::fprintf(stderr, "%s: %s\n", port.c_str(), serial->Error().c_str());
+            return 1;
+        }
+        transport = std::move(serial);
+    }
+
+    dfu::DfuClient client(*transport, options);
+    if(readLog)
+    {
+        std::vector<SessionRecord_t> records;
+        if(!client.ReadSessionLog(records))
+        {
+            std::fprintf(stderr, "reading the session log failed: %s\n", client.Error().c_str());
+            return 1;
+        }
+        PrintSessionLog(records);
+        return readMem ? PrintMemUsage(client) : 0;
+    }
+    if(readImage)
+    {
+        dfu::InstalledImage installed;
+        if(!client.ReadImage(installed))
+        {
+            std::fprintf(stderr, "reading the installed image failed: %s\n", client.Error().c_str());
+            return 1;
+        }
+        std::printf("version %u, sha256 ", installed.version);
+        for(uint8_t b : installed.digest) std::printf("%02x", b);
+        std::printf("\n");
+        return readMem ? PrintMemUsage(client) : 0;
+    }
+    if(readCaps)
+    {
+        dfu::DeviceCapabilities caps;
+        if(!client.ReadCapabilities(caps))
+        {
+            std::fprintf(stderr, "reading the capabilities failed: %s\n", client.Error().c_str());
+            return 1;
+        }
+        PrintCapabilities(caps);
+        return readMem ? PrintMemUsage(client) : 0;
+    }
+    if(!update) return PrintMemUsage(client);
+    if(!client.Update(cmd, image.Data(), image.Size()))
+    {
+        std::fprintf(stderr, "update failed: %s\n", client.Error().c_str());
+        if(client.Rejected() && !info.debug && info.fwVersion == 0)
+        {
+            std::fprintf(stderr, "the init packet has firmware version 0, give the version with -V or skip the check with -d\n");
+        }
+        return 1;
+    }
+    if(dev && !dev->Finished())
+    {
+        std::fprintf(stderr, "the simulated device did not finish the update\n");
+        return 1;
+    }
+    const dfu::ClientStats& stats = client.Stats();
+    std::printf("updated %zu bytes in %.3f s (%.1f kB/s): %u objects, %u packets of up to %u bytes, %u requests\n",
+                image.Size(), stats.seconds, image.Size() / stats.seconds / 1000, stats.objects, stats.packets,
+                transport->PacketSize(), stats.requests);
+    if(stats.resumes) std::printf("%u objects resumed after the device dropped writes\n", stats.resumes);
+    return readMem ? PrintMemUsage(client) : 0;
+}
@@ -0,0 +1,473 @@
+#include "dfu_client.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "crc.h"
+
+namespace dfu
+{
+
+namespace
+{
+
+std::string Hex(uint8_t value)
+{
+    char buf[8];
+    std::snprintf(buf, sizeof(buf), "0x%02X", value);
+    return buf;
+}
+
+// times an object is sent again after the device dropped writes, before giving up on it.
+constexpr uint32_t kMaxResumes = 16;
+
+const char* RspName(uint8_t rspCode)
+{
+    switch(rspCode)
+    {
+        case OTA_RSP_INV_CODE: return "unknown opcode";
+        case OTA_RSP_NOT_SUPPORTED: return "not supported";
+        case OTA_RSP_INV_PARAM: return "invalid parameter";
+        case OTA_RSP_INSUFFICIENT_RESOURCES: return "insufficient resources";
+        case OTA_RSP_INV_OBJECT: return "invalid object";
+        case OTA_RSP_UNSUPPORTED_TYPE: return "unsupported type";
+        case OTA_RSP_OP_NOT_PERMITTED: return "not permitted";
+        case OTA_RSP_OP_FAILED: return "operation failed";
+        case OTA_RSP_EXT_ERROR: return "extended error";
+        default: return "unknown code";
+    }
+}
+
+}  // namespace
+
+MappedFile::~MappedFile()
+{
+    if(data_ && size_) munmap(const_cast<uint8_t*>(data_), size_);
+}
+
+bool MappedFile::Open(const std::string& path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) return false;
+    struct stat st;
+    if(fstat(fd, &st) || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(p == MAP_FAILED) return false;
+    // the image is read once from start to end.
+    madvise(p, st.st_size, MADV_SEQUENTIAL);
+    data_ = static_cast<const uint8_t*>(p);
+    size_ = st.st_size;
+    return true;
+}
+
+void SignCmdObject(CmdObject_t& cmd, const uint8_t (&key)[SIGNATURE_KEY_LEN])
+{
+#if SIGNATURE_ALGO == SIG_HMAC256
+    hmacCompute(SHA256_HASH_ALGO, key, sizeof(key), &cmd, sizeof(cmd) - SIGNATURE_LEN, cmd.obj_signature);
+#elif SIGNATURE_ALGO == SIG_CMACAES
+    cmacCompute(AES_CIPHER_ALGO, key, sizeof(key), &cmd, sizeof(cmd) - SIGNATURE_LEN, cmd.obj_signature, SIGNATURE_LEN);
+#endif
+}
+
+CmdObject_t PrepareCmdObject(const FirmwareInfo& info, const uint8_t* pImage, size_t size)
+{
+    CmdObject_t cmd{};
+    cmd.type = info.type;
+    cmd.is_debug = info.debug;
+    cmd.fw_version = info.fwVersion;
+    cmd.hw_version = info.hwVersion;
+    cmd.lib_version = info.libVersion;
+    cmd.bin_size = size;
+    sha256Compute(pImage, size, cmd.fw_hash);
+    return cmd;
+}
+
+CmdObject_t BuildCmdObject(const FirmwareInfo& info, const uint8_t* pImage, size_t size, const uint8_t (&key)[SIGNATURE_KEY_LEN])
+{
+    CmdObject_t cmd = PrepareCmdObject(info, pImage, size);
+    SignCmdObject(cmd, key);
+    return cmd;
+}
+
+bool AdvertisedImage::Matches(const CmdObject_t& cmd) const
+{
+    return cmd.type == OTA_FW_TYPE_APPLICATION && version == cmd.fw_version
+           && std::memcmp(digest.data(), cmd.fw_hash, digest.size()) == 0;
+}
+
+bool ParseAdvertisedImage(const uint8_t* pData, size_t len, AdvertisedImage& image)
+{
+    // AD structures: a length, which counts the type but not itself, then the type and the data.
+    for(size_t i = 0; i + 1 < len && pData[i]; i += pData[i] + 1)
+    {
+        const uint8_t* pAd = pData + i;
+        if(i + pAd[0] + 1 > len) break;
+        if(pAd[0] + 1 != IMAGE_INFO_AD_LEN || pAd[1] != IMAGE_INFO_AD_TYPE) continue;
+        if((pAd[2] | pAd[3] << 8) != OTA_SERV_UUID) continue;
+        image.version = pAd[4] | pAd[5] << 8 | pAd[6] << 16 | uint32_t(pAd[7]) << 24;
+        std::memcpy(image.digest.data(), pAd + 8, image.digest.size());
+        return true;
+    }
+    return false;
+}
+
+DfuClient::DfuClient(Transport& transport, const ClientOptions& options)
+    : transport_(transport), options_(options)
+{
+    if(options_.window == 0) options_.window = 1;
+}
+
+bool DfuClient::Fail(const std::string& error)
+{
+    if(error_.empty()) error_ = error;
+    return false;
+}
+
+bool DfuClient::Request(const std::vector<uint8_t>& req, bool checkCrc, uint32_t offset, uint32_t crc)
+{
+    if(!Drain(options_.window - 1)) return false;
+    if(!transport_.WriteCtrlPoint(req.data(), req.size())) return Fail("request " + Hex(req[0]) + ": " + transport_.Error());
+    pending_.push_back({req[0], checkCrc, offset, crc});
+    stats_.requests++;
+    return true;
+}
+
+bool DfuClient::Drain(size_t keep)
+{
+    std::vector<uint8_t> rsp;
+    while(pending_.size() > keep)
+    {
+        Pending p = pending_.front();
+        pending_.pop_front();
+        if(!transport_.ReadResponse(rsp, options_.timeout))
+        {
+            return Fail("no response to " + Hex(p.opcode) + ": " + transport_.Error());
+        }
+        // it may answer any request, the one it belongs to could have been dropped itself.
+        if(rsp.size() >= 3 + sizeof(dropInfo_) - 2 && rsp[0] == OTA_CTRL_POINT_OPCODE_RSP && rsp[2] == OTA_RSP_EXT_ERROR
+           && rsp[3] == OTA_EXT_DATA_DROPPED)
+        {
+            dropped_ = true;
+            std::memcpy(&dropInfo_.code, rsp.data() + 3, sizeof(dropInfo_) - 2);
+            return Fail("the device dropped writes");
+        }
+        if(rsp.size() < 3 || rsp[0] != OTA_CTRL_POINT_OPCODE_RSP || rsp[1] != p.opcode)
+        {
+            return Fail("unexpected response to " + Hex(p.opcode));
+        }
+        if(rsp[2] != OTA_RSP_SUCCESS)
+        {
+            rejected_ = true;
+            rejectedOpcode_ = p.opcode;
+            bool flash = rsp[2] == OTA_RSP_EXT_ERROR && rsp.size() > 3 && rsp[3] == OTA_EXT_FLASH_ERROR;
+            return Fail("request " + Hex(p.opcode) + " failed with " + Hex(rsp[2]) + " (" + (flash ? "flash error" : RspName(rsp[2])) + ")");
+        }
+        lastRsp_.assign(rsp.begin() + 3, rsp.end());
+        if(p.checkCrc)
+        {
+            OTA_CtrlPointRsp_CRC_t crc;
+            if(lastRsp_.size() < sizeof(crc)) return Fail("short CRC response");
+            std::memcpy(&crc, lastRsp_.data(), sizeof(crc));
+            if(crc.offset != p.offset || crc.crc != p.crc)
+            {
+                // the device can't roll an object back, the session has to start over.
+                char buf[96];
+                std::snprintf(buf, sizeof(buf), "CRC mismatch: device at %u crc %08X, expected %u crc %08X",
+                              crc.offset, crc.crc, p.offset, p.crc);
+                return Fail(buf);
+            }
+        }
+    }
+    return true;
+}
+
+bool DfuClient::SendObject(uint8_t type, const uint8_t* pData, uint32_t size, uint32_t baseOffset, uint32_t& crc)
+{
+    const uint32_t objectCrc = crc;
+    uint32_t from = 0;
+    for(uint32_t resumes = 0;; resumes++)
+    {
+        // executing an object needs the whole buffer, or flash, until it is answered.
+        if(SendObjectFrom(type, pData, size, baseOffset, from, crc) && Drain(0))
+        {
+            stats_.objects++;
+            return true;
+        }
+        if(!dropped_ || resumes == kMaxResumes || !Resync()) return false;
+        // the device took everything up to the first dropped write in order and nothing after it.
+        // another type means the CREATE of this object was dropped.
+        from = 0;
+        if(dropInfo_.type == type)
+        {
+            if(dropInfo_.offset < baseOffset || dropInfo_.offset > baseOffset + size) return Fail("the device lost track of the object, start over");
+            from = dropInfo_.offset - baseOffset;
+        }
+        crc = update_CRC32(objectCrc, const_cast<uint8_t*>(pData), from);
+        if(dropInfo_.type == type && crc != dropInfo_.crc) return Fail("the device lost track of the object, start over");
+        stats_.resumes++;
+    }
+}
+
+bool DfuClient::SendObjectFrom(uint8_t type, const uint8_t* pData, uint32_t size, uint32_t baseOffset, uint32_t from, uint32_t& crc)
+{
+    // a CREATE again would leave the device's offset where it is, so it only comes before the first packet.
+    if(from == 0)
+    {
+        std::vector<uint8_t> create = {OTA_CTRL_POINT_OPCODE_CREATE, type};
+        create.insert(create.end(), reinterpret_cast<uint8_t*>(&size), reinterpret_cast<uint8_t*>(&size) + sizeof(size));
+        if(!Request(create)) return false;
+    }
+    // packets follow the CREATE without waiting, the device handles everything in order.
+    uint16_t packetSize = transport_.PacketSize();
+    uint32_t packets = 0;
+    for(uint32_t offset = from; offset < size; offset += packetSize)
+    {
+        uint16_t len = std::min<uint32_t>(packetSize, size - offset);
+        if(!transport_.WritePacket(pData + offset, len)) return Fail("packet: " + transport_.Error());
+        crc = update_CRC32(crc, const_cast<uint8_t*>(pData + offset), len);
+        stats_.packets++;
+        stats_.bytes += len;
+        if(options_.crcEvery && ++packets % options_.crcEvery == 0 && offset + len < size)
+        {
+            if(!Request({OTA_CTRL_POINT_OPCODE_CRC}, true, baseOffset + offset + len, crc)) return false;
+        }
+    }
+    if(!Request({OTA_CTRL_POINT_OPCODE_CRC}, true, baseOffset + size, crc)) return false;
+    return Request({OTA_CTRL_POINT_OPCODE_EXECUTE});
+}
+
+bool DfuClient::Resync()
+{
+    // the requests still in flight were not handled, their answers are skipped up to the PING's.
+    pending_.clear();
+    uint8_t id = ++pingId_;
+    std::vector<uint8_t> req = {OTA_CTRL_POINT_OPCODE_PING, id};
+    if(!transport_.WriteCtrlPoint(req.data(), req.size()))
+    {
+        error_ = "the device dropped writes, PING: " + transport_.Error();
+        return false;
+    }
+    std::vector<uint8_t> rsp;
+    do
+    {
+        if(!transport_.ReadResponse(rsp, options_.timeout))
+        {
+            error_ = "the device dropped writes, no response to PING: " + transport_.Error();
+            return false;
+        }
+    } while(rsp.size() < 4 || rsp[1] != OTA_CTRL_POINT_OPCODE_PING || rsp[2] != OTA_RSP_SUCCESS || rsp[3] != id);
+    dropped_ = false;
+    error_.clear();
+    return true;
+}
+
+bool DfuClient::Update(const CmdObject_t& cmd, const uint8_t* pImage, size_t size)
+{
+    auto start = std::chrono::steady_clock::now();
+    error_.clear();
+    rejected_ = false;
+    rejectedOpcode_ = 0;
+    dropped_ = false;
+    pending_.clear();
+    stats_ = ClientStats();
+    if(size != cmd.bin_size) return Fail("the init packet is for another image size");
+    if(size > APPLICATION_MAX_SIZE) return Fail("the image is larger than the application region");
+
+    // the descriptor says whether the init packet can go right away, then SELECT command is not needed.
+    // bootloaders without it answer INV_CODE and get the SELECT.
+    DeviceCapabilities caps;
+    uint8_t rspCode;
+    OTA_CtrlPointRsp_Select_t select{};
+    if(!QueryCapabilities(caps, rspCode)) return false;
+    if(rspCode == OTA_RSP_SUCCESS && caps.cmdObject.offset == 0 && caps.cmdObject.crc == CRC_INITIAL_VALUE)
+    {
+        select.max_size = caps.maxObject;
+    }
+    else
+    {
+        if(!Request({OTA_CTRL_POINT_OPCODE_SELECT, OTA_CONTROL_POINT_OBJ_TYPE_CMD}) || !Drain(0)) return false;
+        std::memcpy(&select, lastRsp_.data(), std::min(lastRsp_.size(), sizeof(select)));
+        // the device does not resume, a previous session on the same boot can't be continued.
+        if(select.offset != 0) return Fail("the device has a partial session, reset it first");
+    }
+    if(select.max_size < sizeof(CmdObject_t)) return Fail("the device does not take a whole init packet");
+    uint32_t crc = CRC_INITIAL_VALUE;
+    if(!SendObject(OTA_CONTROL_POINT_OBJ_TYPE_CMD, reinterpret_cast<const uint8_t*>(&cmd), sizeof(cmd), 0, crc))
+    {
+        // the device checks the init packet on EXECUTE and answers the same to everything it does not like.
+        if(rejectedOpcode_ == OTA_CTRL_POINT_OPCODE_EXECUTE)
+        {
+            error_ = "the device refused the init packet: its signature, a firmware version not newer than the installed one "
+                     "(unless debug), the hardware version or the image size";
+        }
+        return false;
+    }
+
+    if(!Request({OTA_CTRL_POINT_OPCODE_SELECT, OTA_CONTROL_POINT_OBJ_TYPE_DATA}) || !Drain(0)) return false;
+    std::memcpy(&select, lastRsp_.data(), std::min(lastRsp_.size(), sizeof(select)));
+    if(select.offset != 0) return Fail("the device has a partial session, reset it first");
+    if(select.max_size == 0) return Fail("the device reports an object size of 0");
+    crc = CRC_INITIAL_VALUE;
+    for(uint32_t offset = 0; offset < size; offset += select.max_size)
+    {
+        uint32_t objectSize = std::min<uint32_t>(select.max_size, size - offset);
+        if(!SendObject(OTA_CONTROL_POINT_OBJ_TYPE_DATA, pImage + offset, objectSize, offset, crc)) return false;
+    }
+    stats_.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+bool DfuClient::Query(const std::vector<uint8_t>& req, uint8_t& rspCode)
+{
+    std::vector<uint8_t> rsp;
+    if(!transport_.WriteCtrlPoint(req.data(), req.size())) return Fail("request " + Hex(req[0]) + ": " + transport_.Error());
+    if(!transport_.ReadResponse(rsp, options_.timeout)) return Fail("no response to " + Hex(req[0]) + ": " + transport_.Error());
+    if(rsp.size() < 3 || rsp[0] != OTA_CTRL_POINT_OPCODE_RSP || rsp[1] != req[0]) return Fail("unexpected response to " + Hex(req[0]));
+    stats_.requests++;
+    rspCode = rsp[2];
+    lastRsp_.assign(rsp.begin() + 3, rsp.end());
+    return true;
+}
+
+bool DfuClient::ReadSessionLog(std::vector<SessionRecord_t>& records)
+{
+    error_.clear();
+    rejected_ = false;
+    rejectedOpcode_ = 0;
+    pending_.clear();
+    records.clear();
+    // one request at a time, the first index the device has no record for ends the log.
+    for(unsigned index = 0; index <= UINT8_MAX; index++)
+    {
+        uint8_t rspCode;
+        if(!Query({OTA_CTRL_POINT_OPCODE_SESSION_LOG, uint8_t(index)}, rspCode)) return false;
+        if(rspCode == OTA_RSP_INV_CODE) return Fail("the device was built without SESSION_LOG");
+        if(rspCode != OTA_RSP_SUCCESS) break;
+        if(lastRsp_.size() < sizeof(SessionRecord_t)) return Fail("short session log response");
+        SessionRecord_t record;
+        std::memcpy(&record, lastRsp_.data(), sizeof(record));
+        records.push_back(record);
+    }
+    return true;
+}
+
+bool DfuClient::ReadImage(InstalledImage& image)
+{
+    error_.clear();
+    rejected_ = false;
+    rejectedOpcode_ = 0;
+    pending_.clear();
+    for(uint8_t offset = 0; offset < image.digest.size(); offset += OTA_DIGEST_RSP_LEN)
+    {
+        uint8_t rspCode;
+        if(!Query({OTA_CTRL_POINT_OPCODE_IMAGE_DIGEST, offset}, rspCode)) return false;
+        if(rspCode == OTA_RSP_INV_OBJECT) return Fail("no application was installed by the bootloader");
+        if(rspCode != OTA_RSP_SUCCESS) return Fail("request " + Hex(OTA_CTRL_POINT_OPCODE_IMAGE_DIGEST) + " failed with " + Hex(rspCode));
+        OTA_CtrlPointRsp_Digest_t rsp;
+        if(lastRsp_.size() < sizeof(rsp)) return Fail("short digest response");
+        std::memcpy(&rsp, lastRsp_.data(), sizeof(rsp));
+        image.version = rsp.version;
+        std::memcpy(image.digest.data() + offset, rsp.digest, sizeof(rsp.digest));
+    }
+    return true;
+}
+
+bool DfuClient::ReadMemUsage(OTA_CtrlPointRsp_Mem_t& mem)
+{
+    error_.clear();
+    rejected_ = false;
+    rejectedOpcode_ = 0;
+    pending_.clear();
+    uint8_t rspCode;
+    if(!Query({OTA_CTRL_POINT_OPCODE_MEM_USAGE}, rspCode)) return false;
+    if(rspCode == OTA_RSP_INV_CODE) return Fail("the device was built without MEM_WATERMARK");
+    if(rspCode != OTA_RSP_SUCCESS) return Fail("request " + Hex(OTA_CTRL_POINT_OPCODE_MEM_USAGE) + " failed with " + Hex(rspCode));
+    if(lastRsp_.size() < sizeof(mem)) return Fail("short memory usage response");
+    std::memcpy(&mem, lastRsp_.data(), sizeof(mem));
+    return true;
+}
+
+bool DfuClient::QueryCapabilities(DeviceCapabilities& caps, uint8_t& rspCode)
+{
+    // a page is the total length and as much of the descriptor from the offset asked as fits the MTU.
+    std::vector<uint8_t> bytes;
+    size_t total = 0;
+    do
+    {
+        if(!Query({OTA_CTRL_POINT_OPCODE_CAPABILITIES, uint8_t(bytes.size())}, rspCode)) return false;
+        if(rspCode != OTA_RSP_SUCCESS) return bytes.empty() || Fail("capabilities failed with " + Hex(rspCode));
+        if(lastRsp_.empty()) return Fail("short capabilities response");
+        total = lastRsp_[0];
+        if(lastRsp_.size() == 1 && bytes.size() < total) return Fail("empty capabilities response");
+        bytes.insert(bytes.end(), lastRsp_.begin() + 1, lastRsp_.end());
+    } while(bytes.size() < total);
+    if(bytes.size() != total) return Fail("the capabilities are longer than the device says");
+
+    caps = DeviceCapabilities();
+    for(size_t i = 0; i < bytes.size(); i += 2 + bytes[i + 1])
+    {
+        if(i + 2 > bytes.size() || i + 2 + bytes[i + 1] > bytes.size()) return Fail("truncated capability record");
+        const uint8_t* pValue = bytes.data() + i + 2;
+        size_t len = bytes[i + 1];
+        // a record may grow, only the part known here is read and the rest is left zero.
+        OTA_CtrlPointRsp_Firmware_t firmware{};
+        OTA_Cap_Object_t object{};
+        switch(bytes[i])
+        {
+            case OTA_CAP_PROTOCOL:
+                std::memcpy(&caps.protocol, pValue, std::min(len, sizeof(caps.protocol)));
+                break;
+            case OTA_CAP_HARDWARE:
+                std::memcpy(&caps.hardware, pValue, std::min(len, sizeof(caps.hardware)));
+                break;
+            case OTA_CAP_FIRMWARE:
+                std::memcpy(&firmware.type, pValue, std::min(len, sizeof(firmware) - 3));
+                caps.firmware.push_back(firmware);
+                break;
+            case OTA_CAP_MAX_OBJECT:
+                std::memcpy(&caps.maxObject, pValue, std::min(len, sizeof(caps.maxObject)));
+                break;
+            case OTA_CAP_MTU:
+                std::memcpy(&caps.mtu, pValue, std::min(len, sizeof(caps.mtu)));
+                break;
+            case OTA_CAP_MODES:
+                std::memcpy(&caps.modes, pValue, std::min(len, sizeof(caps.modes)));
+                break;
+            case OTA_CAP_OBJECT:
+                std::memcpy(&object.type, pValue, std::min(len, sizeof(object) - 3));
+                if(object.type == OTA_CONTROL_POINT_OBJ_TYPE_CMD) caps.cmdObject = object;
+                if(object.type == OTA_CONTROL_POINT_OBJ_TYPE_DATA) caps.dataObject = object;
+                break;
+            default:
+                // from a newer bootloader.
+                break;
+        }
+    }
+    return true;
+}
+
+bool DfuClient::ReadCapabilities(DeviceCapabilities& caps)
+{
+    error_.clear();
+    rejected_ = false;
+    rejectedOpcode_ = 0;
+    pending_.clear();
+    uint8_t rspCode;
+    if(!QueryCapabilities(caps, rspCode)) return false;
+    if(rspCode == OTA_RSP_INV_CODE) return Fail("the device has no capability descriptor");
+    if(rspCode != OTA_RSP_SUCCESS) return Fail("request " + Hex(OTA_CTRL_POINT_OPCODE_CAPABILITIES) + " failed with " + Hex(rspCode));
+    return true;
+}
+
+}  // namespace dfu
@@ -0,0 +1,174 @@
+// a DFU client for this bootloader: builds and signs the init packet (CmdObject_t), maps the image and
+// streams it in objects of the size SELECT reports, chunked to the transport's packet size.
+// requests are pipelined: a request is sent without waiting for the previous answers, up to a window,
+// except after the requests the device answers only once flash is done (SELECT data and EXECUTE data),
+// because it rejects everything until then.
+
+#ifndef DFU_CLIENT_H
+#define DFU_CLIENT_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "peripheral.h"
+#include "OTA_service.h"
+#include "transport.h"
+
+namespace dfu
+{
+
+// a read only mapping of a file.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Open(const std::string& path);
+    const uint8_t* Data() const { return data_; }
+    size_t Size() const { return size_; }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+struct FirmwareInfo
+{
+    uint8_t type = OTA_FW_TYPE_APPLICATION;
+    bool debug = false; // the device skips the version check.
+    uint32_t fwVersion = 0; // must be newer than the installed one, so 0 is always refused unless debug.
+    uint32_t hwVersion = HARDWARE_VERSION;
+    uint32_t libVersion = 0;
+};
+
+using DeviceKey = std::array<uint8_t, SIGNATURE_KEY_LEN>;
+
+// the init packet for an image, not signed yet. the image is hashed here, signing is cheap per device.
+CmdObject_t PrepareCmdObject(const FirmwareInfo& info, const uint8_t* pImage, size_t size);
+// the init packet for an image, signed with the device's key.
+CmdObject_t BuildCmdObject(const FirmwareInfo& info, const uint8_t* pImage, size_t size, const uint8_t (&key)[SIGNATURE_KEY_LEN]);
+void SignCmdObject(CmdObject_t& cmd, const uint8_t (&key)[SIGNATURE_KEY_LEN]);
+inline void SignCmdObject(CmdObject_t& cmd, const DeviceKey& key)
+{
+    SignCmdObject(cmd, *reinterpret_cast<const uint8_t(*)[SIGNATURE_KEY_LEN]>(key.data()));
+}
+
+// what a device advertises about its installed application, in its scan response (image_info.h).
+struct AdvertisedImage
+{
+    uint32_t version = 0;
+    std::array<uint8_t, IMAGE_INFO_AD_DIGEST_LEN> digest{};
+
+    // true when it is the application of this init packet.
+    bool Matches(const CmdObject_t& cmd) const;
+};
+
+// finds the image service data in advertising or scan response data, false when there is none.
+bool ParseAdvertisedImage(const uint8_t* pData, size_t len, AdvertisedImage& image);
+
+// the installed application, as the device reports it on the control point.
+struct InstalledImage
+{
+    uint32_t version = 0;
+    std::array<uint8_t, IMAGE_INFO_DIGEST_LEN> digest{};
+};
+
+// what the device reports with CAPABILITIES, the records this client knows. see OTA_CAP_* in OTA_service.h.
+struct DeviceCapabilities
+{
+    uint8_t protocol = 0;
+    OTA_CtrlPointRsp_Hardware_t hardware{};
+    std::vector<OTA_CtrlPointRsp_Firmware_t> firmware; // one per type, the paddings are not used.
+    uint32_t maxObject = 0;
+    uint16_t mtu = 0;
+    OTA_Cap_Modes_t modes{};
+    OTA_Cap_Object_t cmdObject{};
+    OTA_Cap_Object_t dataObject{};
+};
+
+struct ClientOptions
+{
+    size_t window = 4; // control point requests in flight at most.
+    uint32_t crcEvery = 0; // also check the CRC every this many packets. 0 only checks once per object.
+    std::chrono::milliseconds timeout{5000}; // per response. erasing the application region takes the longest.
+};
+
+struct ClientStats
+{
+    uint32_t objects = 0;
+    uint32_t packets = 0;
+    uint32_t requests = 0;
+    uint64_t bytes = 0; // object data, init packet included.
+    uint32_t resumes = 0; // objects sent again from where the device got to, after it dropped writes.
+    double seconds = 0;
+};
+
+class DfuClient
+{
+public:
+    DfuClient(Transport& transport, const ClientOptions& options = ClientOptions());
+
+    // run a complete update. false on the first failure, Error() tells what it was.
+    bool Update(const CmdObject_t& cmd, const uint8_t* pImage, size_t size);
+    // read the device's session log (SESSION_LOG), newest record first.
+    bool ReadSessionLog(std::vector<SessionRecord_t>& records);
+    // read the installed application's version and digest. false when none was installed, see Error().
+    bool ReadImage(InstalledImage& image);
+    // read the capability descriptor. false when the device has none, see Error().
+    bool ReadCapabilities(DeviceCapabilities& caps);
+    // read the stack and BLE heap high water marks (MEM_WATERMARK).
+    bool ReadMemUsage(OTA_CtrlPointRsp_Mem_t& mem);
+
+    const std::string& Error() const { return error_; }
+    // the device answered a request with an error, e.g. refused the init packet. trying again won't help.
+    bool Rejected() const { return rejected_; }
+    const ClientStats& Stats() const { return stats_; }
+
+private:
+    // a request waiting for its response, with what the response must say.
+    struct Pending
+    {
+        uint8_t opcode;
+        bool checkCrc;
+        uint32_t offset;
+        uint32_t crc;
+    };
+
+    bool Request(const std::vector<uint8_t>& req, bool checkCrc = false, uint32_t offset = 0, uint32_t crc = 0);
+    // wait until at most `keep` requests are still in flight.
+    bool Drain(size_t keep);
+    bool SendObject(uint8_t type, const uint8_t* pData, uint32_t size, uint32_t baseOffset, uint32_t& crc);
+    // CREATE unless part of the object is on the device already, then the packets from `from` on, CRC and EXECUTE.
+    bool SendObjectFrom(uint8_t type, const uint8_t* pData, uint32_t size, uint32_t baseOffset, uint32_t from, uint32_t& crc);
+    // after the device dropped writes: skip the answers to what is still in flight and PING, so it takes packets again.
+    bool Resync();
+    bool Fail(const std::string& error);
+    // one request and its response, outside the pipeline. rspCode is the device's verdict, the content is in lastRsp_.
+    bool Query(const std::vector<uint8_t>& req, uint8_t& rspCode);
+    // all pages of the descriptor. rspCode is the device's verdict on the first one, caps is only set on success.
+    bool QueryCapabilities(DeviceCapabilities& caps, uint8_t& rspCode);
+
+    Transport& transport_;
+    ClientOptions options_;
+    std::deque<Pending> pending_;
+    std::vector<uint8_t> lastRsp_; // content of the last response read.
+    std::string error_;
+    bool rejected_ = false;
+    uint8_t rejectedOpcode_ = 0; // of the request the device answered with an error.
+    bool dropped_ = false; // the device dropped writes, dropInfo_ is where its object stood.
+    OTA_CtrlPointRsp_Ext_t dropInfo_{};
+    uint8_t pingId_ = 0;
+    ClientStats stats_;
+};
+
+}  // namespace dfu
+
+#endif /* DFU_CLIENT_H */
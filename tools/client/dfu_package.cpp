@@ -0,0 +1,129 @@
+// packages a release for a fleet: the image and an init packet signed for every device key, in a bundle
+// (bundle.h) for fleet_update.
+//
+// usage: dfu_package [-V fw version] [-d] [-B] [-j threads] [-P page size] [-b base image] -k keys -o bundle <image>
+//   -k  the device keys, a "<id> <key in hex>" line per device.
+//   -V  firmware version in the init packets. -d marks them debug, devices then skip the version check.
+//   -B  the image is a bootloader, an application otherwise.
+//   -j  signing threads, every core by default.
+//   -P  also store a SHA-256 digest per this many bytes of the image. with -b, the pages that differ from
+//       the base image are flagged, to see how much of a release actually changes.
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "bundle.h"
+
+namespace
+{
+
+void Usage()
+{
+    std::fprintf(stderr, "usage: dfu_package [-V fw version] [-d] [-B] [-j threads] [-P page size] [-b base image] -k keys -o bundle <image>\n");
+}
+
+double Since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    dfu::FirmwareInfo info;
+    dfu::BundleOptions options;
+    std::string keysPath;
+    std::string bundlePath;
+    std::string basePath;
+    int opt;
+    while((opt = getopt(argc, argv, "V:dBj:P:b:k:o:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'V': info.fwVersion = std::strtoul(optarg, nullptr, 0); break;
+            case 'd': info.debug = true; break;
+            case 'B': info.type = OTA_FW_TYPE_BOOTLOADER; break;
+            case 'j': options.threads = std::strtoul(optarg, nullptr, 0); break;
+            case 'P': options.pageSize = std::strtoul(optarg, nullptr, 0); break;
+            case 'b': basePath = optarg; break;
+            case 'k': keysPath = optarg; break;
+            case 'o': bundlePath = optarg; break;
+            default: Usage(); return 2;
+        }
+    }
+    if(optind + 1 != argc || keysPath.empty() || bundlePath.empty() || (!basePath.empty() && !options.pageSize))
+    {
+        Usage();
+        return 2;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    dfu::MappedFile image;
+    if(!image.Open(argv[optind]))
+    {
+        std::fprintf(stderr, "cannot map %s\n", argv[optind]);
+        return 1;
+    }
+    size_t maxSize = info.type == OTA_FW_TYPE_BOOTLOADER ? BOOTLOADER_MAX_SIZE : APPLICATION_MAX_SIZE;
+    if(image.Size() > maxSize)
+    {
+        std::fprintf(stderr, "%s is larger than its region (%zu bytes)\n", argv[optind], maxSize);
+        return 1;
+    }
+    dfu::MappedFile base;
+    if(!basePath.empty())
+    {
+        if(!base.Open(basePath))
+        {
+            std::fprintf(stderr, "cannot map %s\n", basePath.c_str());
+            return 1;
+        }
+        options.pBase = base.Data();
+        options.baseSize = base.Size();
+    }
+    std::vector<dfu::BundleDevice> devices;
+    std::string error;
+    if(!dfu::ReadKeys(keysPath, devices, error))
+    {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    double readSeconds = Since(start);
+
+    auto hashStart = std::chrono::steady_clock::now();
+    CmdObject_t cmd = dfu::PrepareCmdObject(info, image.Data(), image.Size());
+    double hashSeconds = Since(hashStart);
+
+    auto writeStart = std::chrono::steady_clock::now();
+    size_t count = devices.size();
+    if(!dfu::WriteBundle(bundlePath, cmd, image.Data(), image.Size(), std::move(devices), options, error))
+    {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    double writeSeconds = Since(writeStart);
+
+    std::printf("%s: %zu devices, %zu byte image, read %.3f s, hash %.3f s, sign and write %.3f s (%.0f devices/s)\n",
+                bundlePath.c_str(), count, image.Size(), readSeconds, hashSeconds, writeSeconds,
+                writeSeconds > 0 ? count / writeSeconds : 0);
+    if(options.pageSize)
+    {
+        dfu::Bundle bundle;
+        if(!bundle.Open(bundlePath, error))
+        {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        size_t changed = 0;
+        for(size_t i = 0; i < bundle.PageCount(); i++) changed += (bundle.Page(i).flags & dfu::kBundlePageChanged) != 0;
+        std::printf("%zu pages of %u bytes", bundle.PageCount(), options.pageSize);
+        if(options.pBase) std::printf(", %zu changed from %s", changed, basePath.c_str());
+        std::printf("\n");
+    }
+    return 0;
+}
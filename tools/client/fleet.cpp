@@ -0,0 +1,301 @@
+#include "fleet.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace dfu
+{
+
+namespace
+{
+
+constexpr size_t kNoSlot = std::numeric_limits<size_t>::max();
+
+}  // namespace
+
+const char* DeviceStateName(DeviceState state)
+{
+    switch(state)
+    {
+        case DeviceState::kQueued: return "queued";
+        case DeviceState::kRunning: return "running";
+        case DeviceState::kBackoff: return "backoff";
+        case DeviceState::kDone: return "done";
+        case DeviceState::kFailed: return "failed";
+        case DeviceState::kCurrent: return "current";
+    }
+    return "?";
+}
+
+double Percentile(const std::vector<double>& sorted, double q)
+{
+    if(sorted.empty()) return 0;
+    size_t i = static_cast<size_t>(q * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(i, sorted.size() - 1)];
+}
+
+Fleet::Fleet(std::vector<Adapter*> adapters, const FleetOptions& options)
+    : options_(options)
+{
+    if(options_.maxAttempts == 0) options_.maxAttempts = 1;
+    for(Adapter* adapter : adapters)
+    {
+        slots_.push_back(std::make_unique<Slot>());
+        slots_.back()->adapter = adapter;
+    }
+}
+
+void Fleet::AddDevice(const std::string& id, const uint8_t (&key)[SIGNATURE_KEY_LEN], std::vector<size_t> adapters)
+{
+    DeviceRecord dev;
+    dev.id = id;
+    std::memcpy(dev.key, key, sizeof(dev.key));
+    dev.adapters = std::move(adapters);
+    devices_.push_back(std::move(dev));
+}
+
+void Fleet::AddDevice(const std::string& id, const CmdObject_t* pCmd, std::vector<size_t> adapters)
+{
+    DeviceRecord dev;
+    dev.id = id;
+    std::memset(dev.key, 0, sizeof(dev.key));
+    dev.pCmd = pCmd;
+    dev.adapters = std::move(adapters);
+    devices_.push_back(std::move(dev));
+}
+
+void Fleet::SetState(DeviceRecord& dev, DeviceState state)
+{
+    dev.state = state;
+    if(onChange_) onChange_(dev);
+}
+
+bool Fleet::Current(const DeviceRecord& dev, const CmdObject_t& cmd)
+{
+    const CmdObject_t& devCmd = dev.pCmd ? *dev.pCmd : cmd;
+    for(size_t s = 0; s < slots_.size(); s++)
+    {
+        if(!dev.adapters.empty() && std::find(dev.adapters.begin(), dev.adapters.end(), s) == dev.adapters.end()) continue;
+        AdvertisedImage image;
+        if(slots_[s]->adapter->Scan(dev.id, image) && image.Matches(devCmd)) return true;
+    }
+    return false;
+}
+
+std::chrono::milliseconds Fleet::Backoff(uint32_t attempts) const
+{
+    std::chrono::milliseconds backoff = options_.backoff;
+    for(uint32_t i = 1; i < attempts && backoff < options_.maxBackoff; i++) backoff *= 2;
+    return std::min(backoff, options_.maxBackoff);
+}
+
+std::chrono::steady_clock::time_point Fleet::Dispatch(std::chrono::steady_clock::time_point now)
+{
+    auto next = std::chrono::steady_clock::time_point::max();
+    for(auto it = waiting_.begin(); it != waiting_.end();)
+    {
+        DeviceRecord& dev = devices_[*it];
+        if(dev.retryAt <= now)
+        {
+            ready_.push_back(*it);
+            it = waiting_.erase(it);
+            SetState(dev, DeviceState::kQueued);
+        }
+        else
+        {
+            next = std::min(next, dev.retryAt);
+            ++it;
+        }
+    }
+
+    for(size_t n = ready_.size(); n; n--)
+    {
+        size_t index = ready_.front();
+        ready_.pop_front();
+        DeviceRecord& dev = devices_[index];
+        // the slot with the most room, another adapter than last time if the device failed there.
+        size_t best = kNoSlot;
+        bool bestOther = false;
+        size_t bestFree = 0;
+        for(size_t s = 0; s < slots_.size(); s++)
+        {
+            if(!dev.adapters.empty() && std::find(dev.adapters.begin(), dev.adapters.end(), s) == dev.adapters.end()) continue;
+            size_t capacity = slots_[s]->adapter->Capacity();
+            if(slots_[s]->running >= capacity) continue;
+            size_t free = capacity - slots_[s]->running;
+            bool other = dev.attempts == 0 || s != dev.adapter;
+            if(best == kNoSlot || other > bestOther || (other == bestOther && free > bestFree))
+            {
+                best = s;
+                bestOther = other;
+                bestFree = free;
+            }
+        }
+        if(best == kNoSlot)
+        {
+            ready_.push_back(index); // its adapters are busy, later.
+            continue;
+        }
+        Slot& slot = *slots_[best];
+        slot.running++;
+        slot.work.push_back(index);
+        dev.adapter = best;
+        dev.attempts++;
+        SetState(dev, DeviceState::kRunning);
+        slot.cv.notify_one();
+    }
+    return next;
+}
+
+void Fleet::Worker(size_t index)
+{
+    Slot& slot = *slots_[index];
+    std::unique_lock<std::mutex> lock(mutex_);
+    while(true)
+    {
+        slot.cv.wait(lock, [&] { return stop_ || !slot.work.empty(); });
+        if(slot.work.empty()) return;
+        Completion done{slot.work.front(), false, false, std::string(), ClientStats()};
+        slot.work.pop_front();
+        lock.unlock();
+        Session(index, done.device, done);
+        lock.lock();
+        completions_.push_back(std::move(done));
+        completed_.notify_one();
+    }
+}
+
+void Fleet::Session(size_t slot, size_t device, Completion& done)
+{
+    // the scheduler leaves a running device alone, its id and key can be read without the lock.
+    const DeviceRecord& dev = devices_[device];
+    std::unique_ptr<Transport> transport = slots_[slot]->adapter->Connect(dev.id, done.error);
+    if(!transport)
+    {
+        done.error = "connect: " + done.error;
+        return;
+    }
+    CmdObject_t cmd = cmd_;
+    if(dev.pCmd) cmd = *dev.pCmd;
+    else SignCmdObject(cmd, dev.key);
+    DfuClient client(*transport, options_.client);
+    done.ok = client.Update(cmd, pImage_, size_);
+    done.rejected = client.Rejected();
+    done.error = client.Error();
+    done.stats = client.Stats();
+}
+
+bool Fleet::Complete(const Completion& done, FleetMetrics& metrics)
+{
+    DeviceRecord& dev = devices_[done.device];
+    Slot& slot = *slots_[dev.adapter];
+    auto now = std::chrono::steady_clock::now();
+    slot.running--;
+    slot.stats.sessions++;
+    if(done.ok)
+    {
+        slot.stats.bytes += done.stats.bytes;
+        metrics.done++;
+        metrics.bytes += done.stats.bytes;
+        dev.error.clear();
+        dev.sessionSeconds = done.stats.seconds;
+        dev.doneSeconds = std::chrono::duration<double>(now - start_).count();
+        metrics.sessionSeconds.push_back(dev.sessionSeconds);
+        metrics.doneSeconds.push_back(dev.doneSeconds);
+        SetState(dev, DeviceState::kDone);
+        return true;
+    }
+    slot.stats.failures++;
+    dev.error = done.error;
+    if(done.rejected || dev.attempts >= options_.maxAttempts)
+    {
+        metrics.failed++;
+        dev.doneSeconds = std::chrono::duration<double>(now - start_).count();
+        SetState(dev, DeviceState::kFailed);
+        return true;
+    }
+    dev.retryAt = now + Backoff(dev.attempts);
+    waiting_.push_back(done.device);
+    SetState(dev, DeviceState::kBackoff);
+    return false;
+}
+
+FleetMetrics Fleet::Run(const CmdObject_t& cmd, const uint8_t* pImage, size_t size)
+{
+    FleetMetrics metrics;
+    cmd_ = cmd;
+    pImage_ = pImage;
+    size_ = size;
+    start_ = std::chrono::steady_clock::now();
+    stop_ = false;
+    ready_.clear();
+    waiting_.clear();
+    completions_.clear();
+    for(auto& slot : slots_) slot->stats = AdapterStats();
+
+    size_t left = 0;
+    for(size_t i = 0; i < devices_.size(); i++)
+    {
+        DeviceRecord& dev = devices_[i];
+        dev.attempts = 0;
+        dev.error.clear();
+        bool reachable = false;
+        for(size_t s = 0; s < slots_.size(); s++)
+        {
+            bool listed = dev.adapters.empty() || std::find(dev.adapters.begin(), dev.adapters.end(), s) != dev.adapters.end();
+            reachable |= listed && slots_[s]->adapter->Capacity() > 0;
+        }
+        if(!reachable)
+        {
+            dev.error = "no adapter reaches it";
+            metrics.failed++;
+            SetState(dev, DeviceState::kFailed);
+            continue;
+        }
+        if(options_.skipCurrent && Current(dev, cmd))
+        {
+            metrics.current++;
+            SetState(dev, DeviceState::kCurrent);
+            continue;
+        }
+        ready_.push_back(i);
+        left++;
+        SetState(dev, DeviceState::kQueued);
+    }
+
+    std::vector<std::thread> workers;
+    for(size_t s = 0; s < slots_.size(); s++)
+    {
+        for(size_t n = slots_[s]->adapter->Capacity(); n; n--) workers.emplace_back(&Fleet::Worker, this, s);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while(left)
+    {
+        auto next = Dispatch(std::chrono::steady_clock::now());
+        if(completions_.empty())
+        {
+            if(next == std::chrono::steady_clock::time_point::max()) completed_.wait(lock);
+            else completed_.wait_until(lock, next);
+        }
+        while(!completions_.empty())
+        {
+            if(Complete(completions_.front(), metrics)) left--;
+            completions_.pop_front();
+        }
+    }
+    stop_ = true;
+    for(auto& slot : slots_) slot->cv.notify_all();
+    lock.unlock();
+    for(std::thread& worker : workers) worker.join();
+
+    metrics.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    for(const DeviceRecord& dev : devices_) metrics.attempts += dev.attempts;
+    for(auto& slot : slots_) metrics.adapters.push_back(slot->stats);
+    std::sort(metrics.sessionSeconds.begin(), metrics.sessionSeconds.end());
+    std::sort(metrics.doneSeconds.begin(), metrics.doneSeconds.end());
+    return metrics;
+}
+
+}  // namespace dfu
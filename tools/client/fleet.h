@@ -0,0 +1,186 @@
+// updates many devices at once over several adapters (gateways). every adapter runs up to its capacity of
+// sessions in parallel, each on a worker thread with its own DfuClient. a scheduler thread hands queued
+// devices to free adapter slots, takes the finished sessions back and moves every device through its states:
+//
+//   queued -> running -> done
+//               |  ^
+//               v  |
+//             backoff -> failed, after the last attempt
+//
+// a failed session is retried from the start after an exponential backoff, on another adapter if one is free:
+// the bootloader erases the application region when the data object is selected, so nothing carries over.
+// a device that refused a request, e.g. an init packet for an older version, fails without retries.
+// a device whose scan response already shows the image is current and never connected to.
+
+#ifndef DFU_FLEET_H
+#define DFU_FLEET_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dfu_client.h"
+
+namespace dfu
+{
+
+// a gateway that reaches devices, e.g. a BLE dongle or a serial port.
+class Adapter
+{
+public:
+    virtual ~Adapter() = default;
+
+    virtual const std::string& Name() const = 0;
+    // sessions it can run at once.
+    virtual size_t Capacity() const = 0;
+    // a link to the device, nullptr and the reason in error when it can't be reached.
+    // called from the adapter's worker threads, concurrently up to Capacity().
+    virtual std::unique_ptr<Transport> Connect(const std::string& device, std::string& error) = 0;
+    // the installed image the device advertises, from a passive scan. false when the adapter can't scan
+    // or has not seen it, the device is then updated as usual.
+    virtual bool Scan(const std::string& device, AdvertisedImage& image)
+    {
+        (void)device;
+        (void)image;
+        return false;
+    }
+};
+
+struct FleetOptions
+{
+    ClientOptions client;
+    uint32_t maxAttempts = 3;
+    std::chrono::milliseconds backoff{1000}; // before the second attempt, doubled for every further one.
+    std::chrono::milliseconds maxBackoff{30000};
+    bool skipCurrent = true; // leave devices that advertise the image alone.
+};
+
+enum class DeviceState
+{
+    kQueued,
+    kRunning,
+    kBackoff,
+    kDone,
+    kFailed,
+    kCurrent, // already had the image.
+};
+
+const char* DeviceStateName(DeviceState state);
+
+struct DeviceRecord
+{
+    std::string id;
+    uint8_t key[SIGNATURE_KEY_LEN];
+    const CmdObject_t* pCmd = nullptr; // already signed, e.g. in a bundle (bundle.h). otherwise signed with key.
+    std::vector<size_t> adapters; // the adapters that reach it, all when empty.
+    DeviceState state = DeviceState::kQueued;
+    uint32_t attempts = 0;
+    size_t adapter = 0; // of the last attempt.
+    std::string error; // of the last failed attempt.
+    double sessionSeconds = 0; // of the successful attempt.
+    double doneSeconds = 0; // from the start of the rollout until done or failed.
+    std::chrono::steady_clock::time_point retryAt;
+};
+
+struct AdapterStats
+{
+    uint32_t sessions = 0;
+    uint32_t failures = 0;
+    uint64_t bytes = 0;
+};
+
+struct FleetMetrics
+{
+    uint32_t done = 0;
+    uint32_t failed = 0;
+    uint32_t current = 0;
+    uint32_t attempts = 0;
+    uint64_t bytes = 0; // of the successful sessions.
+    double seconds = 0; // the whole rollout.
+    std::vector<double> sessionSeconds; // successful sessions, sorted.
+    std::vector<double> doneSeconds; // updated devices, sorted.
+    std::vector<AdapterStats> adapters;
+};
+
+// the value at fraction q (0..1) of sorted values, 0 when there are none.
+double Percentile(const std::vector<double>& sorted, double q);
+
+class Fleet
+{
+public:
+    Fleet(std::vector<Adapter*> adapters, const FleetOptions& options = FleetOptions());
+    Fleet(const Fleet&) = delete;
+    Fleet& operator=(const Fleet&) = delete;
+
+    void AddDevice(const std::string& id, const uint8_t (&key)[SIGNATURE_KEY_LEN], std::vector<size_t> adapters = {});
+    // a device with its signed init packet, which must outlive the fleet.
+    void AddDevice(const std::string& id, const CmdObject_t* pCmd, std::vector<size_t> adapters = {});
+
+    // called on the scheduler thread every time a device changes state, e.g. to journal or show progress.
+    void OnChange(std::function<void(const DeviceRecord&)> callback) { onChange_ = std::move(callback); }
+
+    // updates every device with the image, cmd is signed with the key of every device added without its init packet.
+    // returns once all are done or failed.
+    FleetMetrics Run(const CmdObject_t& cmd, const uint8_t* pImage, size_t size);
+
+    const std::vector<DeviceRecord>& Devices() const { return devices_; }
+
+private:
+    struct Slot
+    {
+        Adapter* adapter;
+        size_t running = 0;
+        std::deque<size_t> work; // devices handed to its workers.
+        std::condition_variable cv;
+        AdapterStats stats;
+    };
+    struct Completion
+    {
+        size_t device;
+        bool ok;
+        bool rejected;
+        std::string error;
+        ClientStats stats;
+    };
+
+    void Worker(size_t slot);
+    void Session(size_t slot, size_t device, Completion& done);
+    // hands ready devices to free slots, returns when the next backoff ends.
+    std::chrono::steady_clock::time_point Dispatch(std::chrono::steady_clock::time_point now);
+    // true when the device is done or failed for good.
+    bool Complete(const Completion& done, FleetMetrics& metrics);
+    void SetState(DeviceRecord& dev, DeviceState state);
+    // true when an adapter that reaches the device sees it advertise the image of its init packet.
+    bool Current(const DeviceRecord& dev, const CmdObject_t& cmd);
+    std::chrono::milliseconds Backoff(uint32_t attempts) const;
+
+    FleetOptions options_;
+    std::vector<DeviceRecord> devices_;
+    std::vector<std::unique_ptr<Slot>> slots_;
+    std::function<void(const DeviceRecord&)> onChange_;
+    std::deque<size_t> ready_; // queued devices.
+    std::vector<size_t> waiting_; // devices in backoff.
+
+    // what the workers share with the scheduler, under mutex_.
+    std::mutex mutex_;
+    std::condition_variable completed_;
+    std::deque<Completion> completions_;
+    bool stop_ = false;
+
+    // the rollout being run.
+    CmdObject_t cmd_;
+    const uint8_t* pImage_ = nullptr;
+    size_t size_ = 0;
+    std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace dfu
+
+#endif /* DFU_FLEET_H */
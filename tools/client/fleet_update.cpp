@@ -0,0 +1,276 @@
+// updates many devices at once with the fleet orchestrator (fleet.h), over serial ports or simulated gateways.
+//
+// usage: fleet_update [-k key file] [-K keys] [-V fw version] [-d] [-w window] [-a attempts] [-B backoff ms]
+//                     [-j journal] [-b baud] [-q] (-p serial port ... | -n devices [-g gateways] [-m sessions]
+//                     [-r kB/s] [-C connect ms] [-f connect failure rate] [-l link drop rate]) (-u bundle | <image>)
+//   -k -V -d -w  as for dfu. -k is the key of every device not in -K.
+//   -K  device keys, a "<id> <key in hex>" line per device as for dfu_package.
+//   -u  a bundle from dfu_package instead of an image, with every device's init packet already signed.
+//   -a  attempts per device, a failed session is retried after -B ms, doubled for every further retry.
+//   -j  journal of finished devices. devices it has as done are skipped and every device that finishes is
+//       appended, so an interrupted rollout picks up where it stopped.
+//   -p  a serial port with one device on it, repeat for more.
+//   -n  simulated devices, the first ones of the bundle or of -K, reached by -g gateways of -m sessions each.
+//       -r paces every link to this many kB/s, -C is how long a connect takes, -f and -l are the odds that
+//       a connect fails and that a session drops.
+//   -q  only the summary, no line per device.
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+
+#include "bundle.h"
+#include "fleet.h"
+#include "serial_transport.h"
+#include "sim_transport.h"
+
+namespace
+{
+
+void Usage()
+{
+    std::fprintf(stderr, "usage: fleet_update [-k key file] [-K keys] [-V fw version] [-d] [-w window] [-a attempts] [-B backoff ms]\n"
+                         "                    [-j journal] [-b baud] [-q] (-p serial port ... | -n devices [-g gateways] [-m sessions]\n"
+                         "                    [-r kB/s] [-C connect ms] [-f connect failure rate] [-l link drop rate]) (-u bundle | <image>)\n");
+}
+
+// the devices a journal has as done.
+std::set<std::string> ReadJournal(const std::string& path)
+{
+    std::set<std::string> done;
+    std::ifstream f(path);
+    std::string line;
+    while(std::getline(f, line))
+    {
+        std::istringstream fields(line);
+        std::string id, state;
+        if(!(fields >> id >> state)) continue;
+        // a device found current has the image just as well.
+        if(state == dfu::DeviceStateName(dfu::DeviceState::kDone) || state == dfu::DeviceStateName(dfu::DeviceState::kCurrent))
+        {
+            done.insert(id);
+        }
+    }
+    return done;
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    dfu::DeviceKey key{};
+    dfu::FirmwareInfo info;
+    dfu::FleetOptions options;
+    std::vector<std::string> ports;
+    std::string journalPath;
+    std::string keysPath;
+    std::string bundlePath;
+    uint32_t baud = 1500000;
+    bool quiet = false;
+    uint32_t simDevices = 0;
+    uint32_t gateways = 1;
+    size_t sessions = 4;
+    dfu::SimLinkOptions link;
+    int opt;
+    while((opt = getopt(argc, argv, "k:K:u:V:dw:a:B:j:b:qp:n:g:m:r:C:f:l:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'k':
+            {
+                std::ifstream f(optarg, std::ios::binary);
+                if(!f.read(reinterpret_cast<char*>(key.data()), key.size()))
+                {
+                    std::fprintf(stderr, "cannot read %u key bytes from %s\n", SIGNATURE_KEY_LEN, optarg);
+                    return 2;
+                }
+                break;
+            }
+            case 'K': keysPath = optarg; break;
+            case 'u': bundlePath = optarg; break;
+            case 'V': info.fwVersion = std::strtoul(optarg, nullptr, 0); break;
+            case 'd': info.debug = true; break;
+            case 'w': options.client.window = std::strtoul(optarg, nullptr, 0); break;
+            case 'a': options.maxAttempts = std::strtoul(optarg, nullptr, 0); break;
+            case 'B': options.backoff = std::chrono::milliseconds(std::strtoul(optarg, nullptr, 0)); break;
+            case 'j': journalPath = optarg; break;
+            case 'b': baud = std::strtoul(optarg, nullptr, 0); break;
+            case 'q': quiet = true; break;
+            case 'p': ports.push_back(optarg); break;
+            case 'n': simDevices = std::strtoul(optarg, nullptr, 0); break;
+            case 'g': gateways = std::strtoul(optarg, nullptr, 0); break;
+            case 'm': sessions = std::strtoul(optarg, nullptr, 0); break;
+            case 'r': link.kBytesPerSecond = std::strtod(optarg, nullptr); break;
+            case 'C': link.connectTime = std::chrono::milliseconds(std::strtoul(optarg, nullptr, 0)); break;
+            case 'f': link.connectFailRate = std::strtod(optarg, nullptr); break;
+            case 'l': link.dropRate = std::strtod(optarg, nullptr); break;
+            default: Usage(); return 2;
+        }
+    }
+    bool bundled = !bundlePath.empty();
+    if(optind + !bundled != argc || ports.empty() == (simDevices == 0) || gateways == 0)
+    {
+        Usage();
+        return 2;
+    }
+
+    std::string error;
+    dfu::Bundle bundle;
+    dfu::MappedFile imageFile;
+    const uint8_t* pImage;
+    size_t size;
+    CmdObject_t cmd;
+    if(bundled)
+    {
+        if(!bundle.Open(bundlePath, error))
+        {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        pImage = bundle.Image();
+        size = bundle.ImageSize();
+        cmd = bundle.Header().cmd;
+    }
+    else
+    {
+        if(!imageFile.Open(argv[optind]))
+        {
+            std::fprintf(stderr, "cannot map %s\n", argv[optind]);
+            return 1;
+        }
+        if(imageFile.Size() > APPLICATION_MAX_SIZE)
+        {
+            std::fprintf(stderr, "%s is larger than the application region (%u bytes)\n", argv[optind], APPLICATION_MAX_SIZE);
+            return 1;
+        }
+        pImage = imageFile.Data();
+        size = imageFile.Size();
+        // hashed once, only the signature differs between devices.
+        cmd = dfu::PrepareCmdObject(info, pImage, size);
+    }
+    std::vector<dfu::BundleDevice> keyed;
+    if(!keysPath.empty() && !dfu::ReadKeys(keysPath, keyed, error))
+    {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    std::map<std::string, dfu::DeviceKey> keys;
+    for(const dfu::BundleDevice& dev : keyed) keys[dev.id] = dev.key;
+    auto keyOf = [&](const std::string& id) { return keys.count(id) ? keys[id] : key; };
+
+    std::vector<std::unique_ptr<dfu::Adapter>> adapters;
+    std::vector<std::string> ids;
+    std::map<std::string, dfu::DeviceKey> simKeys;
+    for(const std::string& port : ports)
+    {
+        adapters.push_back(std::make_unique<dfu::SerialAdapter>(port, baud));
+        ids.push_back(port);
+    }
+    for(uint32_t i = 0; i < simDevices; i++)
+    {
+        std::string id;
+        if(bundled)
+        {
+            if(i >= bundle.DeviceCount()) break;
+            id.assign(bundle.Record(i).id, strnlen(bundle.Record(i).id, dfu::kBundleIdLen));
+        }
+        else if(!keyed.empty())
+        {
+            if(i >= keyed.size()) break;
+            id = keyed[i].id;
+        }
+        else
+        {
+            char name[16];
+            std::snprintf(name, sizeof(name), "sim%04u", i);
+            id = name;
+        }
+        ids.push_back(id);
+        simKeys[id] = keyOf(id);
+    }
+    for(uint32_t i = 0; simDevices && i < gateways; i++)
+    {
+        adapters.push_back(std::make_unique<dfu::SimAdapter>("gw" + std::to_string(i), sessions, simKeys, link, i + 1));
+    }
+
+    std::set<std::string> skip;
+    if(!journalPath.empty()) skip = ReadJournal(journalPath);
+    std::ofstream journal;
+    if(!journalPath.empty()) journal.open(journalPath, std::ios::app);
+
+    std::vector<dfu::Adapter*> adapterPtrs;
+    for(auto& adapter : adapters) adapterPtrs.push_back(adapter.get());
+    dfu::Fleet fleet(adapterPtrs, options);
+    for(const std::string& id : ids)
+    {
+        if(skip.count(id)) continue;
+        if(!bundled)
+        {
+            dfu::DeviceKey devKey = keyOf(id);
+            fleet.AddDevice(id, *reinterpret_cast<const uint8_t(*)[SIGNATURE_KEY_LEN]>(devKey.data()));
+            continue;
+        }
+        const dfu::BundleRecord* pRecord = bundle.Find(id);
+        if(!pRecord)
+        {
+            std::fprintf(stderr, "%s is not in %s\n", id.c_str(), bundlePath.c_str());
+            return 1;
+        }
+        fleet.AddDevice(id, &pRecord->cmd);
+    }
+    fleet.OnChange([&](const dfu::DeviceRecord& dev) {
+        if(dev.state != dfu::DeviceState::kDone && dev.state != dfu::DeviceState::kFailed &&
+           dev.state != dfu::DeviceState::kCurrent)
+        {
+            return;
+        }
+        if(journal.is_open()) journal << dev.id << ' ' << dfu::DeviceStateName(dev.state) << ' ' << dev.attempts << std::endl;
+        if(quiet) return;
+        if(dev.state == dfu::DeviceState::kDone)
+        {
+            std::printf("%s done in %.3f s after %u attempts on %s\n", dev.id.c_str(), dev.sessionSeconds, dev.attempts,
+                        adapters[dev.adapter]->Name().c_str());
+        }
+        else if(dev.state == dfu::DeviceState::kCurrent)
+        {
+            std::printf("%s already runs this image\n", dev.id.c_str());
+        }
+        else
+        {
+            std::printf("%s failed after %u attempts: %s\n", dev.id.c_str(), dev.attempts, dev.error.c_str());
+        }
+    });
+    if(!skip.empty()) std::printf("%zu devices already done by the journal\n", skip.size());
+
+    dfu::FleetMetrics m = fleet.Run(cmd, pImage, size);
+
+    std::printf("%zu devices: %u updated, %u already current, %u failed, %u attempts in %.3f s\n",
+                fleet.Devices().size(), m.done, m.current, m.failed, m.attempts, m.seconds);
+    std::printf("aggregate %.1f kB/s, session p50 %.3f s p95 %.3f s max %.3f s, done at p50 %.3f s p95 %.3f s max %.3f s\n",
+                m.seconds > 0 ? m.bytes / m.seconds / 1000 : 0, dfu::Percentile(m.sessionSeconds, 0.5),
+                dfu::Percentile(m.sessionSeconds, 0.95), dfu::Percentile(m.sessionSeconds, 1),
+                dfu::Percentile(m.doneSeconds, 0.5), dfu::Percentile(m.doneSeconds, 0.95), dfu::Percentile(m.doneSeconds, 1));
+    for(size_t i = 0; i < adapters.size(); i++)
+    {
+        std::printf("  %-12s %5u sessions %4u failed %8.1f kB\n", adapters[i]->Name().c_str(), m.adapters[i].sessions,
+                    m.adapters[i].failures, m.adapters[i].bytes / 1000.0);
+    }
+
+    uint32_t simUpdated = 0;
+    for(auto& adapter : adapters)
+    {
+        if(auto sim = dynamic_cast<dfu::SimAdapter*>(adapter.get())) simUpdated += sim->Updated();
+    }
+    if(simDevices && simUpdated != m.done)
+    {
+        std::fprintf(stderr, "%u simulated devices activated the image, the fleet counted %u\n", simUpdated, m.done);
+        return 1;
+    }
+    return m.failed ? 1 : 0;
+}
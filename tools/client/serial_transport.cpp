@@ -0,0 +1,174 @@
+#include "serial_transport.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "OTA_service.h"
+
+namespace dfu
+{
+
+namespace
+{
+
+bool BaudConstant(uint32_t baud, speed_t& speed)
+{
+    switch(baud)
+    {
+        case 115200: speed = B115200; return true;
+        case 230400: speed = B230400; return true;
+        case 460800: speed = B460800; return true;
+        case 921600: speed = B921600; return true;
+        case 1000000: speed = B1000000; return true;
+        case 1500000: speed = B1500000; return true;
+        case 2000000: speed = B2000000; return true;
+        default: return false;
+    }
+}
+
+}  // namespace
+
+SerialTransport::~SerialTransport()
+{
+    if(fd_ >= 0) close(fd_);
+}
+
+bool SerialTransport::Open(const std::string& path, uint32_t baud)
+{
+    speed_t speed;
+    if(!BaudConstant(baud, speed))
+    {
+        error_ = "unsupported baud rate";
+        return false;
+    }
+    fd_ = open(path.c_str(), O_RDWR | O_NOCTTY);
+    if(fd_ < 0)
+    {
+        error_ = path + ": " + std::strerror(errno);
+        return false;
+    }
+    termios tio;
+    if(tcgetattr(fd_, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        cfsetspeed(&tio, speed);
+        tcsetattr(fd_, TCSANOW, &tio);
+    }
+    tcflush(fd_, TCIOFLUSH);
+    // a response is at most the 3 header bytes and the largest content.
+    frame_.resize(3 + OTA_RSP_CONTENT_MAX_LEN);
+    Slip_DecoderInit(&decoder_, frame_.data(), frame_.size());
+    const uint8_t req = OTA_CTRL_POINT_OPCODE_GET_MTU;
+    std::vector<uint8_t> rsp;
+    if(!WriteFrame(&req, 1) || !ReadResponse(rsp, std::chrono::milliseconds(1000))) return false;
+    if(rsp.size() < 3 + sizeof(OTA_CtrlPointRsp_MTU_t) || rsp[1] != req || rsp[2] != OTA_RSP_SUCCESS)
+    {
+        error_ = "bad GET_MTU response";
+        return false;
+    }
+    std::memcpy(&mtu_, &rsp[3], sizeof(mtu_));
+    if(mtu_ < 2)
+    {
+        error_ = "the device reports no room for data";
+        return false;
+    }
+    tx_.resize(SLIP_ENCODED_MAX(mtu_));
+    return true;
+}
+
+bool SerialTransport::WriteFrame(const uint8_t* pFrame, uint16_t len)
+{
+    const size_t encodedMax = SLIP_ENCODED_MAX(len);
+    if(tx_.size() < encodedMax) tx_.resize(encodedMax);
+    const uint8_t* p = tx_.data();
+    size_t left = Slip_Encode(tx_.data(), pFrame, len);
+    while(left)
+    {
+        ssize_t n = write(fd_, p, left);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0)
+        {
+            error_ = std::strerror(errno);
+            return false;
+        }
+        p += n;
+        left -= n;
+    }
+    return true;
+}
+
+bool SerialTransport::WriteCtrlPoint(const uint8_t* pValue, uint16_t len)
+{
+    return WriteFrame(pValue, len);
+}
+
+bool SerialTransport::WritePacket(const uint8_t* pValue, uint16_t len)
+{
+    if(len > PacketSize())
+    {
+        error_ = "packet larger than the MTU";
+        return false;
+    }
+    packet_.resize(len + 1);
+    packet_[0] = OTA_CTRL_POINT_OPCODE_WRITE;
+    std::memcpy(packet_.data() + 1, pValue, len);
+    return WriteFrame(packet_.data(), packet_.size());
+}
+
+bool SerialTransport::ReadResponse(std::vector<uint8_t>& rsp, std::chrono::milliseconds timeout)
+{
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while(true)
+    {
+        while(rxPos_ < rxLen_)
+        {
+            uint16_t len = Slip_Decode(&decoder_, rx_[rxPos_++]);
+            if(len)
+            {
+                rsp.assign(frame_.begin(), frame_.begin() + len);
+                return true;
+            }
+        }
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if(left.count() <= 0)
+        {
+            error_ = "timeout";
+            return false;
+        }
+        pollfd pfd = {fd_, POLLIN, 0};
+        int ready = poll(&pfd, 1, left.count());
+        if(ready < 0 && errno == EINTR) continue;
+        if(ready <= 0) continue;
+        ssize_t n = read(fd_, rx_, sizeof(rx_));
+        if(n <= 0)
+        {
+            error_ = n == 0 ? "port closed" : std::strerror(errno);
+            return false;
+        }
+        rxLen_ = n;
+        rxPos_ = 0;
+    }
+}
+
+std::unique_ptr<Transport> SerialAdapter::Connect(const std::string& device, std::string& error)
+{
+    if(device != path_)
+    {
+        error = "not on " + path_;
+        return nullptr;
+    }
+    auto transport = std::make_unique<SerialTransport>();
+    if(!transport->Open(path_, baud_))
+    {
+        error = transport->Error();
+        return nullptr;
+    }
+    return transport;
+}
+
+}  // namespace dfu
@@ -0,0 +1,63 @@
+// the client's transport over a serial port, for the firmware's UART transport (src/uart_transport.c) or
+// tools/sim/uart_sim. frames are SLIP encoded, object data goes in WRITE requests.
+
+#ifndef DFU_SERIAL_TRANSPORT_H
+#define DFU_SERIAL_TRANSPORT_H
+
+#include <string>
+
+#include "fleet.h"
+#include "slip.h"
+#include "transport.h"
+
+namespace dfu
+{
+
+class SerialTransport : public Transport
+{
+public:
+    SerialTransport() = default;
+    ~SerialTransport() override;
+    SerialTransport(const SerialTransport&) = delete;
+    SerialTransport& operator=(const SerialTransport&) = delete;
+
+    // opens the port in raw mode and asks the device for its MTU.
+    bool Open(const std::string& path, uint32_t baud);
+
+    uint16_t PacketSize() override { return mtu_ - 1; } // the WRITE opcode.
+    bool WriteCtrlPoint(const uint8_t* pValue, uint16_t len) override;
+    bool WritePacket(const uint8_t* pValue, uint16_t len) override;
+    bool ReadResponse(std::vector<uint8_t>& rsp, std::chrono::milliseconds timeout) override;
+
+private:
+    bool WriteFrame(const uint8_t* pFrame, uint16_t len);
+
+    int fd_ = -1;
+    uint16_t mtu_ = 0;
+    std::vector<uint8_t> frame_; // decoder buffer.
+    std::vector<uint8_t> tx_;
+    std::vector<uint8_t> packet_; // a WRITE request being built.
+    uint8_t rx_[256]; // read but not decoded yet.
+    size_t rxLen_ = 0;
+    size_t rxPos_ = 0;
+    Slip_Decoder_t decoder_;
+};
+
+// an adapter for one serial port. it reaches the one device on the port, which goes by the port's path.
+class SerialAdapter : public Adapter
+{
+public:
+    SerialAdapter(const std::string& path, uint32_t baud) : path_(path), baud_(baud) {}
+
+    const std::string& Name() const override { return path_; }
+    size_t Capacity() const override { return 1; }
+    std::unique_ptr<Transport> Connect(const std::string& device, std::string& error) override;
+
+private:
+    std::string path_;
+    uint32_t baud_;
+};
+
+}  // namespace dfu
+
+#endif /* DFU_SERIAL_TRANSPORT_H */
@@ -0,0 +1,160 @@
+#include "sim_transport.h"
+
+#include <thread>
+
+namespace dfu
+{
+
+// a session's link: owns the device it booted and runs its faults and pacing.
+class SimLink : public Transport
+{
+public:
+    SimLink(SimAdapter& adapter, const std::string& device, const DeviceKey& key, uint32_t dropAfter)
+        : adapter_(adapter), device_(device), dev_(*reinterpret_cast<const uint8_t(*)[SIGNATURE_KEY_LEN]>(key.data())), transport_(dev_), dropAfter_(dropAfter),
+          due_(std::chrono::steady_clock::now())
+    {
+        std::lock_guard<std::mutex> lock(adapter_.installedMutex_);
+        auto it = adapter_.installed_.find(device_);
+        if(it != adapter_.installed_.end()) dev_.SetImageInfo(it->second);
+    }
+    ~SimLink() override
+    {
+        if(dev_.Finished()) adapter_.updated_++;
+        // an interrupted session may have erased the application, then the device no longer advertises it.
+        ImageInfo_t info;
+        std::lock_guard<std::mutex> lock(adapter_.installedMutex_);
+        if(dev_.ImageInfo(info)) adapter_.installed_[device_] = info;
+        else adapter_.installed_.erase(device_);
+    }
+
+    uint16_t PacketSize() override { return transport_.PacketSize(); }
+    bool WriteCtrlPoint(const uint8_t* pValue, uint16_t len) override
+    {
+        return Link(len) && Forward(transport_.WriteCtrlPoint(pValue, len));
+    }
+    bool WritePacket(const uint8_t* pValue, uint16_t len) override
+    {
+        return Link(len) && Forward(transport_.WritePacket(pValue, len));
+    }
+    bool ReadResponse(std::vector<uint8_t>& rsp, std::chrono::milliseconds timeout) override
+    {
+        if(dropped_) return Lost();
+        return Forward(transport_.ReadResponse(rsp, timeout));
+    }
+
+private:
+    // false once the link dropped, otherwise waits until it would have carried len bytes.
+    bool Link(uint16_t len)
+    {
+        if(dropped_ || (dropAfter_ && --dropAfter_ == 0))
+        {
+            dropped_ = true;
+            return Lost();
+        }
+        double rate = adapter_.options_.kBytesPerSecond;
+        if(rate > 0)
+        {
+            due_ += std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(len / (rate * 1000)));
+            // a sleep per packet costs more than the packet on a fast link, catch up a millisecond at a time.
+            if(due_ - std::chrono::steady_clock::now() > std::chrono::milliseconds(1)) std::this_thread::sleep_until(due_);
+        }
+        return true;
+    }
+    bool Forward(bool ok)
+    {
+        if(!ok) error_ = transport_.Error();
+        return ok;
+    }
+    bool Lost()
+    {
+        error_ = "link lost";
+        return false;
+    }
+
+    SimAdapter& adapter_;
+    std::string device_;
+    sim::SimDevice dev_;
+    SimTransport transport_;
+    uint32_t dropAfter_; // writes until the link drops, 0 never.
+    bool dropped_ = false;
+    std::chrono::steady_clock::time_point due_; // when the link is done with what was written.
+};
+
+bool SimTransport::WriteCtrlPoint(const uint8_t* pValue, uint16_t len)
+{
+    dev_.WriteCtrlPoint(pValue, len);
+    return true;
+}
+
+bool SimTransport::WritePacket(const uint8_t* pValue, uint16_t len)
+{
+    if(len > PacketSize())
+    {
+        error_ = "packet larger than the MTU";
+        return false;
+    }
+    dev_.WritePacket(pValue, len);
+    return true;
+}
+
+bool SimTransport::ReadResponse(std::vector<uint8_t>& rsp, std::chrono::milliseconds)
+{
+    // a deferred device only answers once its flash job is run, which is what waiting means here.
+    while(!dev_.PopResponse(rsp))
+    {
+        if(!dev_.PollFlash())
+        {
+            error_ = "no response pending";
+            return false;
+        }
+    }
+    return true;
+}
+
+SimAdapter::SimAdapter(const std::string& name, size_t capacity, const std::map<std::string, DeviceKey>& devices,
+                       const SimLinkOptions& options, uint32_t seed)
+    : name_(name), capacity_(capacity), devices_(devices), options_(options), random_(seed)
+{
+}
+
+std::unique_ptr<Transport> SimAdapter::Connect(const std::string& device, std::string& error)
+{
+    auto it = devices_.find(device);
+    if(it == devices_.end())
+    {
+        error = "unknown device";
+        return nullptr;
+    }
+    bool fail;
+    uint32_t dropAfter = 0;
+    {
+        std::lock_guard<std::mutex> lock(randomMutex_);
+        std::uniform_real_distribution<double> chance(0, 1);
+        fail = chance(random_) < options_.connectFailRate;
+        if(chance(random_) < options_.dropRate) dropAfter = std::uniform_int_distribution<uint32_t>(1, 256)(random_);
+    }
+    std::this_thread::sleep_for(options_.connectTime);
+    if(fail)
+    {
+        error = "connection failed";
+        return nullptr;
+    }
+    return std::make_unique<SimLink>(*this, device, it->second, dropAfter);
+}
+
+bool SimAdapter::Scan(const std::string& device, AdvertisedImage& image)
+{
+    ImageInfo_t info;
+    {
+        std::lock_guard<std::mutex> lock(installedMutex_);
+        auto it = installed_.find(device);
+        if(it == installed_.end()) return false;
+        info = it->second;
+    }
+    // the scan response the bootloader would send.
+    uint8_t ad[IMAGE_INFO_AD_LEN];
+    ImageInfo_ServiceData(OTA_SERV_UUID, info.app_version, info.app_digest, ad);
+    return ParseAdvertisedImage(ad, sizeof(ad), image);
+}
+
+}  // namespace dfu
@@ -0,0 +1,77 @@
+// the client's transport to an in-process simulated device (tools/sim/sim_device.h), to test the client
+// and anything built on it without hardware.
+
+#ifndef DFU_SIM_TRANSPORT_H
+#define DFU_SIM_TRANSPORT_H
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+
+#include "fleet.h"
+#include "sim_device.h"
+#include "transport.h"
+
+namespace dfu
+{
+
+class SimTransport : public Transport
+{
+public:
+    explicit SimTransport(sim::SimDevice& dev) : dev_(dev) {}
+
+    uint16_t PacketSize() override { return dev_.GetMTU() - 3; } // ATT write header.
+    bool WriteCtrlPoint(const uint8_t* pValue, uint16_t len) override;
+    bool WritePacket(const uint8_t* pValue, uint16_t len) override;
+    bool ReadResponse(std::vector<uint8_t>& rsp, std::chrono::milliseconds timeout) override;
+
+private:
+    sim::SimDevice& dev_;
+};
+
+// what a simulated link does besides carrying the data.
+struct SimLinkOptions
+{
+    double kBytesPerSecond = 0; // paces what is written like a link of this throughput, 0 is unpaced.
+    std::chrono::milliseconds connectTime{0};
+    double connectFailRate = 0; // of connects.
+    double dropRate = 0; // of sessions, the link goes away after a random number of writes.
+};
+
+// an adapter to simulated devices, for running a fleet without hardware. connecting boots a new device,
+// like the bootloader starting over after a dropped link, so a retry starts from a blank device.
+// the application a device installed is kept though, and advertised to Scan like the bootloader does.
+class SimAdapter : public Adapter
+{
+public:
+    // devices maps the ids it reaches to their keys, and must outlive it.
+    SimAdapter(const std::string& name, size_t capacity, const std::map<std::string, DeviceKey>& devices,
+               const SimLinkOptions& options = SimLinkOptions(), uint32_t seed = 1);
+
+    const std::string& Name() const override { return name_; }
+    size_t Capacity() const override { return capacity_; }
+    std::unique_ptr<Transport> Connect(const std::string& device, std::string& error) override;
+    bool Scan(const std::string& device, AdvertisedImage& image) override;
+
+    // sessions whose device verified and activated the image.
+    uint32_t Updated() const { return updated_; }
+
+private:
+    friend class SimLink;
+
+    std::string name_;
+    size_t capacity_;
+    const std::map<std::string, DeviceKey>& devices_;
+    SimLinkOptions options_;
+    std::mutex randomMutex_;
+    std::mt19937 random_;
+    std::atomic<uint32_t> updated_{0};
+    std::mutex installedMutex_;
+    std::map<std::string, ImageInfo_t> installed_;
+};
+
+}  // namespace dfu
+
+#endif /* DFU_SIM_TRANSPORT_H */
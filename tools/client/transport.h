@@ -0,0 +1,38 @@
+// how the client reaches a device. a transport carries control point requests, object data packets and
+// control point responses, in order, like the GATT service (src/OTA_service.c) or the UART transport.
+
+#ifndef DFU_TRANSPORT_H
+#define DFU_TRANSPORT_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dfu
+{
+
+class Transport
+{
+public:
+    virtual ~Transport() = default;
+
+    // largest object data payload of one packet, what the negotiated MTU leaves after the headers.
+    virtual uint16_t PacketSize() = 0;
+    // a control point request. only sends it, the response is read with ReadResponse.
+    virtual bool WriteCtrlPoint(const uint8_t* pValue, uint16_t len) = 0;
+    // object data, never answered. may block while the link is flow controlled.
+    virtual bool WritePacket(const uint8_t* pValue, uint16_t len) = 0;
+    // the next control point response: 0x60, request opcode, response code, content.
+    // false when nothing came within the timeout or the link is gone.
+    virtual bool ReadResponse(std::vector<uint8_t>& rsp, std::chrono::milliseconds timeout) = 0;
+    // why the last call failed.
+    const std::string& Error() const { return error_; }
+
+protected:
+    std::string error_;
+};
+
+}  // namespace dfu
+
+#endif /* DFU_TRANSPORT_H */
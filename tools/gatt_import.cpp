@@ -0,0 +1,231 @@
+// converts a btsnoop capture (Android's btsnoop_hci.log, or any sniffer trace saved as btsnoop by Wireshark)
+// into a GATT recording (gatt_record.h) that tools/sim/gatt_replay can feed to the engine.
+// only the DFU characteristics are kept: control point writes, packet writes and control point notifications.
+//
+// usage: gatt_import [-c ctrl point handle] [-p packet handle] <btsnoop file> <recording file>
+//   the attribute handles are found from the service discovery in the capture. a phone with a GATT cache
+//   skips discovery, then they are guessed from the traffic or can be given with -c and -p.
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "gatt_record.h"
+#include "slip.h"
+
+namespace
+{
+
+constexpr uint32_t kDatalinkH1 = 1001; // unencapsulated HCI.
+constexpr uint32_t kDatalinkH4 = 1002; // HCI UART, what Android writes.
+constexpr uint8_t kH4Acl = 0x02;
+constexpr uint16_t kAttCid = 0x0004;
+constexpr uint16_t kDefaultMTU = 23;
+
+// ATT opcodes we look at.
+constexpr uint8_t kAttExchangeMtuReq = 0x02;
+constexpr uint8_t kAttExchangeMtuRsp = 0x03;
+constexpr uint8_t kAttReadByTypeRsp = 0x09;
+constexpr uint8_t kAttWriteReq = 0x12;
+constexpr uint8_t kAttWriteCmd = 0x52;
+constexpr uint8_t kAttNotification = 0x1B;
+
+// 8ec9000x-f315-4f60-9fb8-838830daea50, little endian. the same as CONSTRUCT_CHAR_UUID in OTA_service.h.
+const uint8_t kCharUuid[16] = {0x50, 0xea, 0xda, 0x30, 0x88, 0x83, 0xb8, 0x9f, 0x60, 0x4f, 0x15, 0xf3, 0x00, 0x00, 0xc9, 0x8e};
+constexpr uint8_t kCtrlPointUuid = 0x01;
+constexpr uint8_t kPacketUuid = 0x02;
+
+uint32_t Be32(const uint8_t* p) { return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3]; }
+uint16_t Le16(const uint8_t* p) { return p[0] | p[1] << 8; }
+
+struct AttPdu
+{
+    uint64_t timeUs;
+    bool fromPhone;
+    uint16_t connHandle;
+    std::vector<uint8_t> pdu;
+};
+
+// an L2CAP frame being reassembled from ACL fragments.
+struct Reassembly
+{
+    std::vector<uint8_t> data;
+    uint16_t expected = 0;
+};
+
+bool ReadBtsnoop(const char* path, std::vector<AttPdu>& pdus)
+{
+    std::ifstream f(path, std::ios::binary);
+    uint8_t header[16];
+    if(!f.read(reinterpret_cast<char*>(header), sizeof(header)) || std::memcmp(header, "btsnoop\0", 8))
+    {
+        std::fprintf(stderr, "%s is not a btsnoop file\n", path);
+        return false;
+    }
+    uint32_t datalink = Be32(header + 12);
+    if(datalink != kDatalinkH1 && datalink != kDatalinkH4)
+    {
+        std::fprintf(stderr, "unsupported btsnoop datalink %u\n", datalink);
+        return false;
+    }
+    // key is connection handle and direction.
+    std::map<std::pair<uint16_t, bool>, Reassembly> partial;
+    uint8_t rec[24];
+    std::vector<uint8_t> packet;
+    while(f.read(reinterpret_cast<char*>(rec), sizeof(rec)))
+    {
+        uint32_t included = Be32(rec + 4);
+        uint32_t flags = Be32(rec + 8);
+        // microseconds since year 0, only differences are used.
+        uint64_t timeUs = (uint64_t)Be32(rec + 16) << 32 | Be32(rec + 20);
+        packet.resize(included);
+        if(!f.read(reinterpret_cast<char*>(packet.data()), included)) break;
+        bool fromPhone = !(flags & 0x01);
+        const uint8_t* p = packet.data();
+        size_t len = included;
+        if(datalink == kDatalinkH4)
+        {
+            if(len < 1 || p[0] != kH4Acl) continue;
+            p++;
+            len--;
+        }
+        else if(flags & 0x02)
+        {
+            continue; // command or event.
+        }
+        if(len < 4) continue;
+        uint16_t connHandle = Le16(p) & 0x0FFF;
+        uint8_t boundary = (Le16(p) >> 12) & 0x03;
+        uint16_t aclLen = Le16(p + 2);
+        p += 4;
+        len -= 4;
+        if(aclLen > len) continue; // truncated capture.
+        Reassembly& r = partial[{connHandle, fromPhone}];
+        if(boundary != 0x01)
+        {
+            // first fragment, it starts with the L2CAP header.
+            if(aclLen < 4) continue;
+            r.data.assign(p, p + aclLen);
+            r.expected = Le16(p) + 4;
+        }
+        else
+        {
+            if(r.data.empty()) continue;
+            r.data.insert(r.data.end(), p, p + aclLen);
+        }
+        if(r.data.size() < r.expected) continue;
+        if(Le16(r.data.data() + 2) == kAttCid && r.expected > 4)
+        {
+            pdus.push_back({timeUs, fromPhone, connHandle, std::vector<uint8_t>(r.data.begin() + 4, r.data.begin() + r.expected)});
+        }
+        r.data.clear();
+    }
+    return true;
+}
+
+// characteristic declarations from the discovery, matched against the DFU uuids.
+void FindHandles(const std::vector<AttPdu>& pdus, uint16_t& ctrlPoint, uint16_t& packet)
+{
+    for(const AttPdu& a : pdus)
+    {
+        const std::vector<uint8_t>& pdu = a.pdu;
+        if(pdu.size() < 2 || pdu[0] != kAttReadByTypeRsp || pdu[1] != 21) continue;
+        for(size_t i = 2; i + 21 <= pdu.size(); i += 21)
+        {
+            const uint8_t* uuid = &pdu[i + 5];
+            if(std::memcmp(uuid, kCharUuid, 12) || std::memcmp(uuid + 14, kCharUuid + 14, 2) || uuid[13]) continue;
+            uint16_t valueHandle = Le16(&pdu[i + 3]);
+            if(uuid[12] == kCtrlPointUuid && !ctrlPoint) ctrlPoint = valueHandle;
+            if(uuid[12] == kPacketUuid && !packet) packet = valueHandle;
+        }
+    }
+    // without discovery: the packet characteristic gets the write commands and the control point
+    // sends the 0x60 notifications.
+    for(const AttPdu& a : pdus)
+    {
+        const std::vector<uint8_t>& pdu = a.pdu;
+        if(pdu.size() < 3) continue;
+        if(!packet && a.fromPhone && pdu[0] == kAttWriteCmd) packet = Le16(&pdu[1]);
+        if(!ctrlPoint && !a.fromPhone && pdu[0] == kAttNotification && pdu.size() > 3 && pdu[3] == 0x60) ctrlPoint = Le16(&pdu[1]);
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    uint16_t ctrlPoint = 0;
+    uint16_t packet = 0;
+    int opt;
+    while((opt = getopt(argc, argv, "c:p:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'c': ctrlPoint = std::strtoul(optarg, nullptr, 0); break;
+            case 'p': packet = std::strtoul(optarg, nullptr, 0); break;
+            default: optind = argc + 1; break;
+        }
+    }
+    if(optind + 2 != argc)
+    {
+        std::fprintf(stderr, "usage: gatt_import [-c ctrl point handle] [-p packet handle] <btsnoop file> <recording file>\n");
+        return 2;
+    }
+
+    std::vector<AttPdu> pdus;
+    if(!ReadBtsnoop(argv[optind], pdus)) return 1;
+    FindHandles(pdus, ctrlPoint, packet);
+    if(!ctrlPoint || !packet)
+    {
+        std::fprintf(stderr, "could not find the DFU characteristics, give their value handles with -c and -p\n");
+        return 1;
+    }
+    std::fprintf(stderr, "control point handle 0x%04X, packet handle 0x%04X\n", ctrlPoint, packet);
+
+    std::ofstream out(argv[optind + 1], std::ios::binary);
+    std::map<uint16_t, std::pair<uint16_t, uint16_t>> exchange; // client and server MTU per connection.
+    uint16_t seq = 0;
+    uint32_t counts[4] = {};
+    std::vector<uint8_t> frame;
+    std::vector<uint8_t> encoded;
+    for(const AttPdu& a : pdus)
+    {
+        const std::vector<uint8_t>& pdu = a.pdu;
+        if(pdu.size() >= 3 && (pdu[0] == kAttExchangeMtuReq || pdu[0] == kAttExchangeMtuRsp))
+        {
+            auto& mtus = exchange[a.connHandle];
+            (pdu[0] == kAttExchangeMtuReq ? mtus.first : mtus.second) = Le16(&pdu[1]);
+            continue;
+        }
+        if(pdu.size() < 3) continue;
+        uint16_t handle = Le16(&pdu[1]);
+        uint8_t kind;
+        if(a.fromPhone && (pdu[0] == kAttWriteReq || pdu[0] == kAttWriteCmd) && handle == ctrlPoint) kind = GATT_RECORD_KIND_CTRL_POINT;
+        else if(a.fromPhone && (pdu[0] == kAttWriteReq || pdu[0] == kAttWriteCmd) && handle == packet) kind = GATT_RECORD_KIND_PACKET;
+        else if(!a.fromPhone && pdu[0] == kAttNotification && handle == ctrlPoint) kind = GATT_RECORD_KIND_RSP;
+        else continue;
+
+        GattRecordHeader_t header{};
+        header.time = (uint32_t)a.timeUs;
+        header.seq = seq++;
+        header.connHandle = a.connHandle;
+        auto mtus = exchange[a.connHandle];
+        header.mtu = mtus.first && mtus.second ? std::min(mtus.first, mtus.second) : kDefaultMTU;
+        header.kind = kind;
+        frame.assign(reinterpret_cast<uint8_t*>(&header), reinterpret_cast<uint8_t*>(&header) + sizeof(header));
+        frame.insert(frame.end(), pdu.begin() + 3, pdu.end());
+        encoded.resize(SLIP_ENCODED_MAX(frame.size()));
+        out.write(reinterpret_cast<char*>(encoded.data()), Slip_Encode(encoded.data(), frame.data(), frame.size()));
+        counts[kind]++;
+    }
+    std::fprintf(stderr, "%u control point writes, %u packet writes, %u responses\n",
+                 counts[GATT_RECORD_KIND_CTRL_POINT], counts[GATT_RECORD_KIND_PACKET], counts[GATT_RECORD_KIND_RSP]);
+    return out ? 0 : 1;
+}
@@ -0,0 +1,83 @@
+#include "coc_channel.h"
+
+namespace sim
+{
+
+CocChannel::CocChannel(SimDevice& dev, uint16_t mps)
+    : dev_(dev), mps_(mps)
+{
+}
+
+bool CocChannel::Send(const uint8_t* pSdu, uint16_t len)
+{
+    if(len > L2CAP_TRANSPORT_MTU) return false;
+    // the first frame starts with the SDU length.
+    std::vector<uint8_t> frame = {static_cast<uint8_t>(len), static_cast<uint8_t>(len >> 8)};
+    uint16_t offset = 0;
+    do
+    {
+        uint16_t room = mps_ - frame.size();
+        uint16_t n = len - offset < room ? len - offset : room;
+        frame.insert(frame.end(), pSdu + offset, pSdu + offset + n);
+        offset += n;
+        queue_.push_back(std::move(frame));
+        frame.clear();
+    } while(offset < len);
+    return true;
+}
+
+bool CocChannel::Pump()
+{
+    while(!queue_.empty())
+    {
+        if(!credits_)
+        {
+            stalls_++;
+            return false;
+        }
+        credits_--;
+        frames_++;
+        airBytes_ += kHeaderSize + queue_.front().size();
+        Deliver(queue_.front());
+        queue_.pop_front();
+        // the stack reports the threshold as soon as the peer reaches it.
+        if(credits_ == L2CAP_TRANSPORT_CREDIT_THRESHOLD) TopUp();
+    }
+    return true;
+}
+
+void CocChannel::Service()
+{
+    if(owed_) TopUp();
+}
+
+void CocChannel::Deliver(const std::vector<uint8_t>& frame)
+{
+    auto payload = frame.begin();
+    if(sdu_.empty() && !sduLen_)
+    {
+        sduLen_ = frame[0] | frame[1] << 8;
+        payload += kSduHeaderSize;
+    }
+    sdu_.insert(sdu_.end(), payload, frame.end());
+    if(sdu_.size() >= sduLen_)
+    {
+        dev_.WritePacket(sdu_.data(), sdu_.size());
+        sdu_.clear();
+        sduLen_ = 0;
+    }
+}
+
+void CocChannel::TopUp()
+{
+    // same rule as L2capTransport_TopUp: no new credits while a flash job owns the object buffer.
+    if(dev_.Busy())
+    {
+        owed_ = true;
+        return;
+    }
+    credits_ += L2CAP_TRANSPORT_CREDITS - L2CAP_TRANSPORT_CREDIT_THRESHOLD;
+    owed_ = false;
+}
+
+}  // namespace sim
@@ -0,0 +1,56 @@
+// stands in for the L2CAP credit based channel of src/l2cap_transport.c.
+// SDUs are segmented into LE frames of at most MPS bytes, every frame costs the sender one credit,
+// and the device side returns credits with the same threshold and hold rules as the firmware.
+
+#ifndef COC_CHANNEL_H
+#define COC_CHANNEL_H
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "l2cap_transport.h"
+#include "sim_device.h"
+
+namespace sim
+{
+
+class CocChannel
+{
+public:
+    static constexpr uint16_t kHeaderSize = 4; // L2CAP basic header of every frame.
+    static constexpr uint16_t kSduHeaderSize = 2; // SDU length, in the first frame of an SDU.
+
+    CocChannel(SimDevice& dev, uint16_t mps);
+
+    // queue an SDU. false if it is larger than the device accepts.
+    bool Send(const uint8_t* pSdu, uint16_t len);
+    // send queued frames while there are credits. returns true when the queue is empty.
+    bool Pump();
+    // the device side: give back owed credits once its flash job is done.
+    void Service();
+
+    uint16_t Credits() const { return credits_; }
+    uint64_t Frames() const { return frames_; }
+    uint64_t AirBytes() const { return airBytes_; }
+    uint64_t Stalls() const { return stalls_; }
+
+private:
+    void Deliver(const std::vector<uint8_t>& frame);
+    void TopUp();
+
+    SimDevice& dev_;
+    uint16_t mps_;
+    uint16_t credits_ = L2CAP_TRANSPORT_CREDITS;
+    bool owed_ = false;
+    std::deque<std::vector<uint8_t>> queue_;
+    std::vector<uint8_t> sdu_; // reassembly on the device side.
+    uint16_t sduLen_ = 0;
+    uint64_t frames_ = 0;
+    uint64_t airBytes_ = 0;
+    uint64_t stalls_ = 0;
+};
+
+}  // namespace sim
+
+#endif /* COC_CHANNEL_H */
@@ -0,0 +1,53 @@
+#ifndef SIM_CONFIG_H
+#define SIM_CONFIG_H
+
+
+// stands in for the SDK's config.h when the firmware sources are built on Linux.
+// only what the engine, crc, signature, trace and perf counter sources need is here, with the SDK's values.
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint8_t bStatus_t;
+typedef uint8_t BOOL;
+
+#ifndef TRUE
+#define TRUE                         1
+#endif
+#ifndef FALSE
+#define FALSE                        0
+#endif
+#define SUCCESS                      0x00
+#define FAILURE                      0x01
+#define bleIncorrectMode             0x12
+
+#define ID_CH571                     0x71
+#define EEPROM_PAGE_SIZE             256
+#define EEPROM_BLOCK_SIZE            4096
+#define FLASH_MIN_WR_SIZE            4
+#define FLASH_ROM_MAX_SIZE           0x070000
+#define LIB_FLASH_BASE_ADDRESSS      0x00040000
+#define LIB_FLASH_MAX_SIZE           0x00030000
+#define BLE_MEMHEAP_SIZE             (1024*6)
+#define SYSTEM_TIME_MICROSEN         625
+
+#define LO_UINT16(a)                 ((a) & 0xFF)
+#define HI_UINT16(a)                 (((a) >> 8) & 0xFF)
+
+// tmos_memcmp returns TRUE when both buffers are equal, not 0 like memcmp.
+static inline void tmos_memcpy(void *dst, const void *src, uint32_t len) { memcpy(dst, src, len); }
+static inline void tmos_memset(void *dst, uint8_t value, uint32_t len) { memset(dst, value, len); }
+static inline BOOL tmos_memcmp(const void *a, const void *b, uint32_t len) { return memcmp(a, b, len) == 0; }
+
+// the simulated TMOS clock, in 625us ticks. owned by the simulation.
+uint32_t TMOS_GetSystemClock(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM_CONFIG_H */
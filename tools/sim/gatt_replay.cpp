@@ -0,0 +1,312 @@
+// replays a GATT recording (gatt_record.h) into the firmware's protocol engine and reports its timing and outcome.
+// the engine runs on the recorded timeline: flash jobs take the flash scheduler's estimates from the moment
+// they are started, so a packet the phone sent before the device could take it is dropped like on the chip.
+// the speed only paces the replay against the wall clock, the outcome is the same at any speed.
+//
+// usage: gatt_replay [-k key file] [-x speed] [-v] <recording>
+//   -k  signing key the recorded init packet was signed with, SIGNATURE_KEY_LEN raw bytes. all zeros otherwise.
+//   -x  1 replays at the recorded speed, 10 ten times faster. 0, the default, does not wait at all.
+//   -v  print every record.
+// exits with 1 when the engine's responses differ from the recorded ones, so recordings can be kept as
+// regression cases. a recording without responses passes when the update completes.
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <thread>
+#include <vector>
+
+#include "flash_sched.h"
+#include "gatt_record.h"
+#include "sim_device.h"
+#include "slip.h"
+
+namespace
+{
+
+struct Record
+{
+    GattRecordHeader_t header;
+    std::vector<uint8_t> value;
+    uint64_t timeUs; // from the first record, with the wraps undone.
+};
+
+bool ReadRecording(const char* path, std::vector<Record>& records, uint32_t& lost)
+{
+    std::ifstream f(path, std::ios::binary);
+    if(!f)
+    {
+        std::fprintf(stderr, "cannot open %s\n", path);
+        return false;
+    }
+    // a record carries at most one attribute value.
+    std::vector<uint8_t> frame(sizeof(GattRecordHeader_t) + 512);
+    Slip_Decoder_t decoder;
+    Slip_DecoderInit(&decoder, frame.data(), frame.size());
+    uint64_t time = 0;
+    char byte;
+    while(f.get(byte))
+    {
+        uint16_t len = Slip_Decode(&decoder, (uint8_t)byte);
+        // a capture may start in the middle of a frame, anything too short or unknown is skipped.
+        if(len < sizeof(GattRecordHeader_t)) continue;
+        Record r;
+        std::memcpy(&r.header, frame.data(), sizeof(r.header));
+        if(r.header.kind < GATT_RECORD_KIND_CTRL_POINT || r.header.kind > GATT_RECORD_KIND_RSP) continue;
+        r.value.assign(frame.begin() + sizeof(r.header), frame.begin() + len);
+        if(!records.empty())
+        {
+            const GattRecordHeader_t& prev = records.back().header;
+            time += (uint32_t)(r.header.time - prev.time);
+            lost += (uint16_t)(r.header.seq - prev.seq - 1);
+        }
+        r.timeUs = time;
+        records.push_back(std::move(r));
+    }
+    return true;
+}
+
+// the flash scheduler's estimate for a job, without the waits for connection gaps.
+uint64_t FlashJobUs(const sim::SimDevice& dev)
+{
+    if(dev.PendingErase()) return (uint64_t)dev.PendingLen() / EEPROM_BLOCK_SIZE * FLASH_SCHED_ERASE_BLOCK_US;
+    return (uint64_t)(dev.PendingLen() + FLASH_MIN_WR_SIZE - 1) / FLASH_MIN_WR_SIZE * FLASH_SCHED_PROGRAM_WORD_US;
+}
+
+const char* KindName(uint8_t kind)
+{
+    switch(kind)
+    {
+        case GATT_RECORD_KIND_CTRL_POINT: return "CTRL";
+        case GATT_RECORD_KIND_PACKET: return "PACKET";
+        case GATT_RECORD_KIND_RSP: return "RSP";
+        default: return "?";
+    }
+}
+
+// time from a request to its response, per opcode.
+struct Latency
+{
+    uint32_t count = 0;
+    uint64_t totalUs = 0;
+    uint64_t maxUs = 0;
+    void Add(uint64_t us)
+    {
+        count++;
+        totalUs += us;
+        maxUs = std::max(maxUs, us);
+    }
+};
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    uint8_t key[SIGNATURE_KEY_LEN] = {};
+    double speed = 0;
+    bool verbose = false;
+    int opt;
+    while((opt = getopt(argc, argv, "k:x:v")) != -1)
+    {
+        switch(opt)
+        {
+            case 'k':
+            {
+                std::ifstream f(optarg, std::ios::binary);
+                if(!f.read(reinterpret_cast<char*>(key), sizeof(key)))
+                {
+                    std::fprintf(stderr, "cannot read %u key bytes from %s\n", SIGNATURE_KEY_LEN, optarg);
+                    return 2;
+                }
+                break;
+            }
+            case 'x': speed = std::atof(optarg); break;
+            case 'v': verbose = true; break;
+            default: optind = argc + 1; break;
+        }
+    }
+    if(optind + 1 != argc || speed < 0)
+    {
+        std::fprintf(stderr, "usage: gatt_replay [-k key file] [-x speed] [-v] <recording>\n");
+        return 2;
+    }
+
+    std::vector<Record> records;
+    uint32_t lost = 0;
+    if(!ReadRecording(argv[optind], records, lost)) return 1;
+    if(records.empty())
+    {
+        std::fprintf(stderr, "no records in %s\n", argv[optind]);
+        return 1;
+    }
+
+    sim::SimDevice dev(key, records.front().header.mtu);
+    dev.SetFlashDeferred(true);
+    uint64_t flashDoneUs = 0;
+    uint32_t counts[4] = {};
+    uint64_t packetBytes = 0;
+    uint32_t dropped = 0; // packets that arrived while the engine waited for flash.
+    uint32_t mismatches = 0;
+    uint32_t unanswered = 0; // recorded responses the engine had nothing for.
+    uint32_t extra = 0; // engine responses that were never recorded.
+    std::map<uint8_t, Latency> recordedLatency;
+    std::map<uint8_t, Latency> replayLatency;
+    std::map<uint8_t, uint64_t> requestUs; // time of the pending request per opcode.
+    std::vector<std::vector<uint8_t>> pending;
+    uint64_t largestGapUs = 0;
+    uint64_t largestGapAt = 0;
+    double engineSeconds = 0;
+    bool anyRecordedRsp = false;
+
+    // engine responses become visible when they are sent, which is after the flash job for deferred requests.
+    auto collect = [&](uint64_t nowUs)
+    {
+        std::vector<uint8_t> rsp;
+        while(dev.PopResponse(rsp))
+        {
+            if(rsp.size() >= 2 && requestUs.count(rsp[1])) replayLatency[rsp[1]].Add(nowUs - requestUs[rsp[1]]);
+            if(verbose)
+            {
+                std::printf("%10.3f ms  engine", nowUs / 1e3);
+                for(size_t b = 0; b < rsp.size() && b < 8; b++) std::printf(" %02X", rsp[b]);
+                std::printf("\n");
+            }
+            pending.push_back(std::move(rsp));
+        }
+    };
+    auto settleFlash = [&](uint64_t nowUs)
+    {
+        if(dev.FlashPending() && flashDoneUs <= nowUs)
+        {
+            dev.PollFlash();
+            collect(flashDoneUs);
+        }
+    };
+
+    auto wallStart = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < records.size(); i++)
+    {
+        const Record& r = records[i];
+        if(speed > 0)
+        {
+            std::this_thread::sleep_until(wallStart + std::chrono::microseconds((uint64_t)(r.timeUs / speed)));
+        }
+        if(i && r.timeUs - records[i - 1].timeUs > largestGapUs)
+        {
+            largestGapUs = r.timeUs - records[i - 1].timeUs;
+            largestGapAt = i;
+        }
+        if(verbose)
+        {
+            std::printf("%10.3f ms  %-6s conn 0x%04X mtu %3u len %3zu", r.timeUs / 1e3, KindName(r.header.kind),
+                        r.header.connHandle, r.header.mtu, r.value.size());
+            if(r.header.kind != GATT_RECORD_KIND_PACKET)
+            {
+                for(size_t b = 0; b < r.value.size() && b < 8; b++) std::printf(" %02X", r.value[b]);
+            }
+            std::printf("\n");
+        }
+        counts[r.header.kind]++;
+        settleFlash(r.timeUs);
+        dev.SetMTU(r.header.mtu);
+        auto engineStart = std::chrono::steady_clock::now();
+        switch(r.header.kind)
+        {
+            case GATT_RECORD_KIND_CTRL_POINT:
+                if(!r.value.empty()) requestUs[r.value[0]] = r.timeUs;
+                dev.WriteCtrlPoint(r.value.data(), r.value.size());
+                break;
+            case GATT_RECORD_KIND_PACKET:
+                packetBytes += r.value.size();
+                if(dev.Busy())
+                {
+                    dropped++;
+                    if(verbose) std::printf("%10.3f ms  dropped, waiting for flash\n", r.timeUs / 1e3);
+                }
+                dev.WritePacket(r.value.data(), r.value.size());
+                break;
+            case GATT_RECORD_KIND_RSP:
+            {
+                anyRecordedRsp = true;
+                if(r.value.size() >= 2 && requestUs.count(r.value[1])) recordedLatency[r.value[1]].Add(r.timeUs - requestUs[r.value[1]]);
+                // the device answered, so its flash job was done whatever our estimate says.
+                if(pending.empty() && dev.FlashPending())
+                {
+                    dev.PollFlash();
+                    collect(r.timeUs);
+                }
+                if(pending.empty())
+                {
+                    unanswered++;
+                    break;
+                }
+                std::vector<uint8_t> rsp = std::move(pending.front());
+                pending.erase(pending.begin());
+                if(rsp != r.value)
+                {
+                    if(!mismatches)
+                    {
+                        std::printf("first mismatch at record %zu (%.3f ms): recorded", i, r.timeUs / 1e3);
+                        for(uint8_t b : r.value) std::printf(" %02X", b);
+                        std::printf(", engine");
+                        for(uint8_t b : rsp) std::printf(" %02X", b);
+                        std::printf("\n");
+                    }
+                    mismatches++;
+                }
+                break;
+            }
+        }
+        engineSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - engineStart).count();
+        if(dev.FlashPending() && flashDoneUs <= r.timeUs) flashDoneUs = r.timeUs + FlashJobUs(dev);
+        collect(r.timeUs);
+    }
+    uint64_t endUs = records.back().timeUs;
+    if(dev.FlashPending())
+    {
+        dev.PollFlash();
+        collect(std::max(endUs, flashDoneUs));
+    }
+    if(anyRecordedRsp) extra = pending.size();
+
+    double seconds = endUs / 1e6;
+    std::printf("%zu records over %.3f s: %u control point writes, %u packet writes, %u responses\n",
+                records.size(), seconds, counts[GATT_RECORD_KIND_CTRL_POINT], counts[GATT_RECORD_KIND_PACKET],
+                counts[GATT_RECORD_KIND_RSP]);
+    if(lost) std::printf("%u records were lost while recording, the outcome may differ\n", lost);
+    std::printf("packet data %llu bytes, %.2f kB/s\n", (unsigned long long)packetBytes,
+                seconds > 0 ? packetBytes / seconds / 1000 : 0.0);
+    if(largestGapUs)
+    {
+        std::printf("largest gap %.3f ms before record %zu (%s)\n", largestGapUs / 1e3, largestGapAt,
+                    KindName(records[largestGapAt].header.kind));
+    }
+    std::printf("engine time %.3f ms, %u packets dropped while busy\n", engineSeconds * 1e3, dropped);
+    std::printf("%-8s %8s %12s %12s %12s %12s\n", "opcode", "count", "rec mean ms", "rec max ms", "sim mean ms", "sim max ms");
+    for(const auto& [opcode, rec] : recordedLatency)
+    {
+        const Latency& rep = replayLatency[opcode];
+        std::printf("0x%02X     %8u %12.3f %12.3f %12.3f %12.3f\n", opcode, rec.count, rec.totalUs / 1e3 / rec.count,
+                    rec.maxUs / 1e3, rep.count ? rep.totalUs / 1e3 / rep.count : 0.0, rep.maxUs / 1e3);
+    }
+
+    bool ok;
+    if(anyRecordedRsp)
+    {
+        ok = !mismatches && !unanswered && !extra;
+        std::printf("responses: %u mismatched, %u not answered by the engine, %u not in the recording\n",
+                    mismatches, unanswered, extra);
+    }
+    else
+    {
+        ok = dev.Finished();
+    }
+    std::printf("update %s, replay %s\n", dev.Finished() ? "completed" : "not completed", ok ? "passed" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,354 @@
+// times the kernels the DFU path spends its cycles in, one by one, built from the same sources as the firmware:
+// the CRC of src/crc.c, SHA-256, HMAC and CMAC from CycloneCRYPTO, the write queue of src/write_queue.c, and the
+// tmos_memcpy/tmos_memcmp of the simulated SDK (sim/config.h), which stand in for the ROM routines on the chip.
+// every kernel runs at the sizes of a packet (20, 244), an object (512) and an erase block (4096), from an aligned
+// buffer and from one a byte off, since packets land in the object buffer at any offset.
+//
+// usage: kernel_bench [-k kernel] [-T ms] [-r rounds] [-m MHz] [-w baseline] [-b baseline] [-t percent]
+//   -k  only the kernels whose name starts with this.
+//   -T  a sample runs a case for at least this long, 5 ms by default.
+//   -r  rounds, 15 by default. a round takes one sample of every case, the fastest sample of a case is kept
+//       and how far the fastest fifth of them spread tells how noisy it was.
+//   -m  core clock to turn ns into cycles. without it the TSC is read on x86, which ticks at the nominal clock.
+//   -w  write the results as a baseline, with their spread.
+//   -b  compare with a baseline. a case slower by more than -t percent (10 by default), and by more than twice
+//       the larger spread of both, is sampled again for as many rounds, twice at most. if it still is, it is a
+//       regression and makes the exit status 1.
+
+#include <sched.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define KERNEL_BENCH_TSC 1
+#endif
+
+#include "crc.h"
+#include "signature.h"
+#include "write_queue.h"
+
+namespace
+{
+
+constexpr size_t kSizes[] = {20, 244, 512, 4096};
+constexpr size_t kAligns[] = {0, 1};
+// a change within this many times the spread of the samples is noise.
+constexpr double kSpreadFactor = 2;
+// times a case that looks slower is sampled again before it counts as a regression.
+constexpr int kRetries = 2;
+
+constexpr size_t kPage = 4096;
+
+// keeps the compiler from dropping a kernel whose result is never used.
+volatile uint32_t sink;
+
+struct Kernel
+{
+    const char* name;
+    // dst has room for len bytes, src holds len bytes. both start at the case's alignment.
+    std::function<void(uint8_t* dst, const uint8_t* src, size_t len)> run;
+};
+
+std::vector<Kernel> Kernels()
+{
+    static const uint8_t key[SIGNATURE_KEY_LEN] = {1, 2, 3, 4};
+    static const uint8_t aesKey[AES_BLOCK_SIZE] = {1, 2, 3, 4};
+    return {
+        {"crc32", [](uint8_t*, const uint8_t* src, size_t len) {
+             sink = update_CRC32(CRC_INITIAL_VALUE, const_cast<uint8_t*>(src), len);
+         }},
+        // the packet path copies into the object buffer and updates the crc in the same pass.
+        {"crc32_copy", [](uint8_t* dst, const uint8_t* src, size_t len) {
+             sink = update_CRC32_copy(CRC_INITIAL_VALUE, dst, const_cast<uint8_t*>(src), len);
+         }},
+        {"sha256", [](uint8_t*, const uint8_t* src, size_t len) {
+             static Sha256Context context;
+             // the firmware hashes a whole image in one context, so only the update is timed.
+             static bool started = (sha256Init(&context), true);
+             (void)started;
+             sha256Update(&context, src, len);
+             sink = context.h[0];
+         }},
+        {"hmac_sha256", [](uint8_t*, const uint8_t* src, size_t len) {
+             uint8_t mac[SHA256_DIGEST_SIZE];
+             hmacCompute(SHA256_HASH_ALGO, key, sizeof(key), src, len, mac);
+             sink = mac[0];
+         }},
+        {"cmac_aes", [](uint8_t*, const uint8_t* src, size_t len) {
+             uint8_t mac[AES_BLOCK_SIZE];
+             cmacCompute(AES_CIPHER_ALGO, aesKey, sizeof(aesKey), src, len, mac, sizeof(mac));
+             sink = mac[0];
+         }},
+        {"memcpy", [](uint8_t* dst, const uint8_t* src, size_t len) {
+             tmos_memcpy(dst, src, len);
+             sink = dst[len - 1];
+         }},
+        // equal buffers, the worst case of a signature or hash compare.
+        {"memcmp", [](uint8_t* dst, const uint8_t* src, size_t len) { sink = tmos_memcmp(dst, src, len); }},
+        // all a GATT write callback does with WRITE_QUEUE, and the task taking the write out again.
+        {"write_queue", [](uint8_t*, const uint8_t* src, size_t len) {
+             WriteQueue_Push(WRITE_QUEUE_PACKET, 0, 0, 0, src, len);
+             sink = WriteQueue_Peek()->len;
+             WriteQueue_Pop();
+         }},
+    };
+}
+
+// one kernel at one size and alignment, with its buffers and what was measured so far.
+struct Case
+{
+    const Kernel* kernel;
+    size_t size;
+    size_t align;
+    std::vector<uint8_t> store;
+    uint8_t* src;
+    uint8_t* dst;
+    uint64_t iterations = 1; // calls per sample.
+    std::vector<double> nsPerByte; // one per sample.
+    double ticksPerByte = -1; // of the fastest sample. < 0 when there is no way to count cycles.
+};
+
+std::string CaseKey(const char* kernel, size_t size, size_t align)
+{
+    return std::string(kernel) + " " + std::to_string(size) + " " + (align ? "unaligned" : "aligned");
+}
+
+uint64_t Ticks()
+{
+#ifdef KERNEL_BENCH_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+Case MakeCase(const Kernel& kernel, size_t size, size_t align)
+{
+    // the buffers sit at the same offsets into their pages in every run, half a page apart, then moved by
+    // the case's alignment. left to the heap, a copy between them can be twice as slow in one run as in the next.
+    size_t dstOffset = (size + kPage - 1) / kPage * kPage + kPage / 2;
+    Case c{&kernel, size, align, std::vector<uint8_t>(kPage + dstOffset + size + 1)};
+    uint8_t* page = c.store.data() + (kPage - reinterpret_cast<uintptr_t>(c.store.data()) % kPage);
+    c.src = page + align;
+    c.dst = page + dstOffset + align;
+    for(size_t i = 0; i < size; i++) c.src[i] = c.dst[i] = uint8_t(i * 31 + 7);
+    return c;
+}
+
+// find how many calls fill a sample. this also warms up the caches and the branch predictors.
+void Calibrate(Case& c, std::chrono::milliseconds sampleTime)
+{
+    for(;;)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for(uint64_t i = 0; i < c.iterations; i++) c.kernel->run(c.dst, c.src, c.size);
+        if(std::chrono::steady_clock::now() - start >= sampleTime) break;
+        c.iterations *= 2;
+    }
+}
+
+// the fastest sample, the one the host disturbed least.
+double Best(const Case& c)
+{
+    return *std::min_element(c.nsPerByte.begin(), c.nsPerByte.end());
+}
+
+// how much slower the fastest fifth of the samples gets than the fastest one, relative: how well the best
+// sample repeats, which is the noise a comparison of best samples has to allow for.
+double Spread(const Case& c)
+{
+    std::vector<double> sorted = c.nsPerByte;
+    std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 5, sorted.end());
+    return sorted[sorted.size() / 5] / Best(c) - 1;
+}
+
+void Sample(Case& c)
+{
+    uint64_t ticks = Ticks();
+    auto start = std::chrono::steady_clock::now();
+    for(uint64_t i = 0; i < c.iterations; i++) c.kernel->run(c.dst, c.src, c.size);
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    ticks = Ticks() - ticks;
+    double bytes = double(c.iterations) * c.size;
+    if(c.nsPerByte.empty() || ns / bytes < Best(c)) c.ticksPerByte = ticks / bytes;
+    c.nsPerByte.push_back(ns / bytes);
+}
+
+// a round samples every case once, so a noisy stretch of the host spreads over all of them
+// instead of hitting one case's samples together.
+void Round(std::vector<Case*>& cases)
+{
+    for(Case* c : cases) Sample(*c);
+}
+
+struct BaselineEntry
+{
+    double nsPerByte;
+    double spread; // 0 in baselines written before it was recorded.
+};
+
+bool ReadBaseline(const std::string& path, std::map<std::string, BaselineEntry>& baseline)
+{
+    std::ifstream f(path);
+    if(!f) return false;
+    std::string line;
+    while(std::getline(f, line))
+    {
+        if(line.empty() || line[0] == '#') continue;
+        std::istringstream fields(line);
+        std::string kernel, align;
+        size_t size;
+        BaselineEntry entry{0, 0};
+        if(!(fields >> kernel >> size >> align >> entry.nsPerByte)) continue;
+        fields >> entry.spread;
+        baseline[kernel + " " + std::to_string(size) + " " + align] = entry;
+    }
+    return true;
+}
+
+void Usage()
+{
+    std::fprintf(stderr, "usage: kernel_bench [-k kernel] [-T ms] [-r rounds] [-m MHz] [-w baseline] [-b baseline] [-t percent]\n");
+}
+
+// the change from the baseline and what the noise of both allows, in percent.
+double Change(const Case& c, const BaselineEntry& base)
+{
+    return (Best(c) / base.nsPerByte - 1) * 100;
+}
+
+double Allowed(const Case& c, const BaselineEntry& base, double threshold)
+{
+    return std::max(threshold, kSpreadFactor * std::max(Spread(c), base.spread) * 100);
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    std::string only;
+    std::chrono::milliseconds sampleTime{5};
+    int rounds = 15;
+    double mhz = 0;
+    std::string writePath;
+    std::string basePath;
+    double threshold = 10;
+    int opt;
+    while((opt = getopt(argc, argv, "k:T:r:m:w:b:t:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'k': only = optarg; break;
+            case 'T': sampleTime = std::chrono::milliseconds(std::strtoul(optarg, nullptr, 0)); break;
+            case 'r': rounds = std::max(1, std::atoi(optarg)); break;
+            case 'm': mhz = std::strtod(optarg, nullptr); break;
+            case 'w': writePath = optarg; break;
+            case 'b': basePath = optarg; break;
+            case 't': threshold = std::strtod(optarg, nullptr); break;
+            default: Usage(); return 2;
+        }
+    }
+    if(optind != argc)
+    {
+        Usage();
+        return 2;
+    }
+    std::map<std::string, BaselineEntry> baseline;
+    if(!basePath.empty() && !ReadBaseline(basePath, baseline))
+    {
+        std::fprintf(stderr, "cannot read %s\n", basePath.c_str());
+        return 1;
+    }
+    std::ofstream out;
+    if(!writePath.empty())
+    {
+        out.open(writePath);
+        if(!out)
+        {
+            std::fprintf(stderr, "cannot write %s\n", writePath.c_str());
+            return 1;
+        }
+        out << "# kernel size alignment ns/byte spread, from kernel_bench\n";
+    }
+
+    // stay on one core, a migration in the middle of a sample costs it its caches.
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(sched_getcpu(), &cpus);
+    sched_setaffinity(0, sizeof(cpus), &cpus);
+
+    const std::vector<Kernel> kernels = Kernels();
+    std::vector<Case> cases;
+    for(const Kernel& kernel : kernels)
+    {
+        if(std::strncmp(kernel.name, only.c_str(), only.size())) continue;
+        for(size_t size : kSizes)
+        {
+            for(size_t align : kAligns) cases.push_back(MakeCase(kernel, size, align));
+        }
+    }
+    std::vector<Case*> all;
+    for(Case& c : cases)
+    {
+        Calibrate(c, sampleTime);
+        all.push_back(&c);
+    }
+    for(int round = 0; round < rounds; round++) Round(all);
+
+    // a case over its allowance is sampled again before it counts, a burst of noise rarely lasts that long.
+    std::vector<Case*> suspects;
+    for(int retry = 0; retry <= kRetries; retry++)
+    {
+        suspects.clear();
+        for(Case* c : all)
+        {
+            auto base = baseline.find(CaseKey(c->kernel->name, c->size, c->align));
+            if(base != baseline.end() && Change(*c, base->second) > Allowed(*c, base->second, threshold)) suspects.push_back(c);
+        }
+        if(suspects.empty() || retry == kRetries) break;
+        for(int round = 0; round < rounds; round++) Round(suspects);
+    }
+
+    std::printf("%-12s %5s %-9s %9s %11s %9s %7s", "kernel", "size", "alignment", "ns/byte", "cycles/byte", "MB/s", "spread");
+    if(!baseline.empty()) std::printf(" %9s %8s %8s", "baseline", "change", "allowed");
+    std::printf("\n");
+    for(Case* c : all)
+    {
+        std::string key = CaseKey(c->kernel->name, c->size, c->align);
+        double best = Best(*c);
+        double cycles = mhz > 0 ? best * mhz / 1000 : c->ticksPerByte;
+#ifndef KERNEL_BENCH_TSC
+        if(mhz <= 0) cycles = -1;
+#endif
+        std::printf("%-12s %5zu %-9s %9.3f", c->kernel->name, c->size, c->align ? "unaligned" : "aligned", best);
+        if(cycles >= 0) std::printf(" %11.3f", cycles);
+        else std::printf(" %11s", "-");
+        std::printf(" %9.1f %6.1f%%", 1000 / best, Spread(*c) * 100);
+        auto base = baseline.find(key);
+        if(base != baseline.end())
+        {
+            double change = Change(*c, base->second);
+            double allowed = Allowed(*c, base->second, threshold);
+            std::printf(" %9.3f %+7.1f%% %7.1f%%%s", base->second.nsPerByte, change, allowed, change > allowed ? " REGRESSION" : "");
+        }
+        std::printf("\n");
+        if(out.is_open()) out << key << ' ' << best << ' ' << Spread(*c) << '\n';
+    }
+    if(!baseline.empty())
+    {
+        std::printf("%zu regressions over %.1f%% or %.0fx the spread\n", suspects.size(), threshold, kSpreadFactor);
+    }
+    return suspects.empty() ? 0 : 1;
+}
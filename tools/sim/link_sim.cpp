@@ -0,0 +1,291 @@
+#include "link_sim.h"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <utility>
+
+#include "flash_sched.h"
+
+namespace sim
+{
+
+namespace
+{
+
+constexpr uint32_t kIfsUs = 150; // inter frame space.
+constexpr uint16_t kL2capHeader = 4;
+constexpr uint16_t kAttHeader = 3;
+constexpr uint64_t kMaxEvents = 20000000; // about 40 hours at 7.5ms, a session that long is stuck.
+
+// time on air of one link layer PDU, preamble, access address, header, payload and crc.
+uint32_t AirUs(uint32_t payload, bool phy2M)
+{
+    uint32_t bytes = (phy2M ? 2 : 1) + 4 + 2 + payload + 3;
+    return phy2M ? bytes * 4 : bytes * 8;
+}
+
+struct Pdu
+{
+    bool ctrl; // control point write, otherwise packet write.
+    std::vector<uint8_t> bytes;
+    uint64_t readyAt;
+    uint32_t costUs; // device cpu time to handle it.
+};
+
+struct Notification
+{
+    std::vector<uint8_t> bytes;
+    uint64_t readyAt;
+};
+
+// what the client does, in order. a request blocks until it is answered, packets don't.
+struct Action
+{
+    bool request;
+    std::vector<uint8_t> bytes;
+    uint32_t costUs;
+};
+
+/**
+ * the flash scheduler's steps for one job, with the same gap rules as FlashSched_ProcessEvent.
+ * connection events during a job carry no data because the client is waiting for the answer.
+ */
+class FlashModel
+{
+public:
+    FlashModel(uint64_t intervalUs, uint32_t eventUs) : interval_(intervalUs), eventUs_(eventUs) {}
+
+    // returns when the job is committed. every step is added to stalls, the radio is dead during them.
+    uint64_t Run(uint64_t start, bool erase, uint32_t len, std::vector<std::pair<uint64_t, uint64_t>>& stalls) const
+    {
+        uint64_t time = start;
+        uint32_t done = 0;
+        int deferrals = 0;
+        while(done < len)
+        {
+            uint64_t nextEvent = (time / interval_ + 1) * interval_;
+            uint64_t remaining = nextEvent - time;
+            uint64_t gap = remaining <= FLASH_SCHED_GUARD_US + SYSTEM_TIME_MICROSEN ? 0 : remaining - FLASH_SCHED_GUARD_US - SYSTEM_TIME_MICROSEN;
+            uint32_t step = len - done;
+            uint64_t cost;
+            if(erase)
+            {
+                step = EEPROM_BLOCK_SIZE;
+                cost = FLASH_SCHED_ERASE_BLOCK_US;
+            }
+            else
+            {
+                uint64_t fit = gap / FLASH_SCHED_PROGRAM_WORD_US * FLASH_MIN_WR_SIZE;
+                if(fit >= FLASH_SCHED_MIN_CHUNK && fit < step) step = fit;
+                cost = (step + FLASH_MIN_WR_SIZE - 1) / FLASH_MIN_WR_SIZE * FLASH_SCHED_PROGRAM_WORD_US;
+            }
+            if(cost > gap && deferrals < FLASH_SCHED_MAX_DEFERRALS)
+            {
+                deferrals++;
+                time = nextEvent + eventUs_;
+                continue;
+            }
+            deferrals = 0;
+            stalls.push_back({time, time + cost});
+            time += cost;
+            done += step;
+        }
+        return time;
+    }
+
+private:
+    uint64_t interval_;
+    uint32_t eventUs_;
+};
+
+std::vector<Action> ClientActions(const LinkParams& params, const CmdObject_t& cmd, const std::vector<uint8_t>& image)
+{
+    std::vector<Action> actions;
+    auto request = [&](std::vector<uint8_t> bytes, uint32_t costUs) { actions.push_back({true, std::move(bytes), costUs}); };
+    auto object = [&](uint8_t type, const uint8_t* pData, uint32_t size, uint32_t executeUs)
+    {
+        std::vector<uint8_t> create = {OTA_CTRL_POINT_OPCODE_CREATE, type};
+        create.insert(create.end(), reinterpret_cast<uint8_t*>(&size), reinterpret_cast<uint8_t*>(&size) + sizeof(size));
+        request(create, 0);
+        uint32_t payload = params.mtu - kAttHeader;
+        uint32_t count = 0;
+        for(uint32_t offset = 0; offset < size; offset += payload)
+        {
+            uint32_t len = std::min(payload, size - offset);
+            actions.push_back({false, std::vector<uint8_t>(pData + offset, pData + offset + len), uint32_t(len * params.crcNsPerByte / 1000)});
+            if(params.prn && ++count % params.prn == 0 && offset + len < size) request({OTA_CTRL_POINT_OPCODE_CRC}, 0);
+        }
+        request({OTA_CTRL_POINT_OPCODE_CRC}, 0);
+        request({OTA_CTRL_POINT_OPCODE_EXECUTE}, executeUs);
+    };
+    request({OTA_CTRL_POINT_OPCODE_SELECT, OTA_CONTROL_POINT_OBJ_TYPE_CMD}, 0);
+    object(OTA_CONTROL_POINT_OBJ_TYPE_CMD, reinterpret_cast<const uint8_t*>(&cmd), sizeof(cmd), params.signatureUs);
+    request({OTA_CTRL_POINT_OPCODE_SELECT, OTA_CONTROL_POINT_OBJ_TYPE_DATA}, 0);
+    uint32_t objectSize = std::min<uint32_t>(params.objectSize, OTA_OBJECT_BUFFER_SIZE);
+    for(uint32_t offset = 0; offset < image.size(); offset += objectSize)
+    {
+        uint32_t size = std::min<uint32_t>(objectSize, image.size() - offset);
+        object(OTA_CONTROL_POINT_OBJ_TYPE_DATA, image.data() + offset, size, uint32_t(size * params.hashNsPerByte / 1000));
+    }
+    return actions;
+}
+
+}  // namespace
+
+const char* LinkResult::Bottleneck() const
+{
+    const std::pair<double, const char*> stages[] = {
+        {radio, "radio"}, {flash, "flash"}, {cpu, "cpu"}, {roundTrip, "round trip"}};
+    return std::max_element(std::begin(stages), std::end(stages))->second;
+}
+
+LinkResult SimulateLink(const LinkParams& params, const uint8_t (&key)[SIGNATURE_KEY_LEN],
+                        const CmdObject_t& cmd, const std::vector<uint8_t>& image)
+{
+    LinkResult result;
+    SimDevice dev(key, params.mtu);
+    dev.SetFlashDeferred(true);
+    std::mt19937 rng(params.seed);
+    std::bernoulli_distribution lost(params.loss);
+    const uint64_t interval = params.connInterval * 1250ull;
+    const uint32_t emptyExchange = 2 * (AirUs(0, params.phy2M) + kIfsUs);
+    const double intervalSeconds = interval / 1e6;
+    FlashModel flashModel(interval, emptyExchange);
+
+    // central side.
+    std::vector<Action> actions = ClientActions(params, cmd, image);
+    size_t next = 0;
+    bool waiting = false;
+    uint8_t waitOpcode = 0;
+    bool failed = false;
+    uint64_t finishedAt = 0;
+    std::deque<Pdu> tx;
+    auto advance = [&](uint64_t now)
+    {
+        while(!waiting && next < actions.size())
+        {
+            const Action& a = actions[next++];
+            tx.push_back({a.request, a.bytes, now, a.costUs});
+            if(a.request)
+            {
+                waiting = true;
+                waitOpcode = a.bytes[0];
+            }
+        }
+    };
+
+    // device side.
+    std::deque<Notification> notifications;
+    uint64_t cpuBusyUntil = 0;
+    bool flashRunning = false;
+    uint64_t flashDoneAt = 0;
+    std::vector<std::pair<uint64_t, uint64_t>> stalls;
+    size_t stall = 0;
+    auto collect = [&](uint64_t readyAt)
+    {
+        std::vector<uint8_t> rsp;
+        while(dev.PopResponse(rsp)) notifications.push_back({rsp, readyAt});
+    };
+    auto deliver = [&](const Pdu& pdu, uint64_t at)
+    {
+        uint64_t start = std::max(at, cpuBusyUntil);
+        cpuBusyUntil = start + pdu.costUs;
+        if(pdu.ctrl) dev.WriteCtrlPoint(pdu.bytes.data(), pdu.bytes.size());
+        else dev.WritePacket(pdu.bytes.data(), pdu.bytes.size());
+        if(dev.FlashPending() && !flashRunning)
+        {
+            flashRunning = true;
+            flashDoneAt = flashModel.Run(cpuBusyUntil, dev.PendingErase(), dev.PendingLen(), stalls);
+        }
+        collect(cpuBusyUntil);
+    };
+    auto receive = [&](const std::vector<uint8_t>& rsp, uint64_t at)
+    {
+        if(!waiting || rsp.size() < 3 || rsp[1] != waitOpcode || rsp[2] != OTA_RSP_SUCCESS)
+        {
+            failed = true;
+            return;
+        }
+        waiting = false;
+        finishedAt = at;
+        advance(at + params.hostLatencyUs);
+    };
+
+    advance(0);
+    for(uint64_t e = 0; e < kMaxEvents && !failed; e++)
+    {
+        if(!waiting && next == actions.size() && tx.empty()) break;
+        uint64_t t = e * interval;
+        SetSystemClock(t / SYSTEM_TIME_MICROSEN);
+        // a committed flash job answers its request.
+        if(flashRunning && flashDoneAt <= t)
+        {
+            flashRunning = false;
+            dev.PollFlash();
+            collect(flashDoneAt);
+        }
+        result.events++;
+        if(flashRunning) result.flash += intervalSeconds;
+        else if(cpuBusyUntil > t) result.cpu += intervalSeconds;
+        else if(!tx.empty() && !tx.front().ctrl) result.radio += intervalSeconds;
+        else result.roundTrip += intervalSeconds;
+        // the radio can't run while flash stalls the cpu.
+        while(stall < stalls.size() && stalls[stall].second <= t) stall++;
+        if(stall < stalls.size() && stalls[stall].first <= t)
+        {
+            result.missedEvents++;
+            continue;
+        }
+        // one exchange is a central PDU and the peripheral's answer, either may be empty.
+        uint64_t used = 0;
+        for(uint8_t exchanges = 0; exchanges < params.maxPdusPerEvent; exchanges++)
+        {
+            bool m = !tx.empty() && tx.front().readyAt <= t;
+            // notifications are sent from the TMOS task, so never in the event that triggered them.
+            bool s = !notifications.empty() && notifications.front().readyAt < t;
+            if(!m && !s) break;
+            uint32_t mLen = m ? kL2capHeader + kAttHeader + tx.front().bytes.size() : 0;
+            uint32_t sLen = s ? kL2capHeader + kAttHeader + notifications.front().bytes.size() : 0;
+            uint64_t duration = AirUs(mLen, params.phy2M) + kIfsUs + AirUs(sLen, params.phy2M) + kIfsUs;
+            if(used + duration > interval - kIfsUs) break;
+            used += duration;
+            if(m)
+            {
+                result.pdus++;
+                if(lost(rng))
+                {
+                    result.retransmissions++;
+                }
+                else
+                {
+                    Pdu pdu = std::move(tx.front());
+                    tx.pop_front();
+                    deliver(pdu, t + used);
+                }
+            }
+            if(s)
+            {
+                result.pdus++;
+                if(lost(rng))
+                {
+                    result.retransmissions++;
+                }
+                else
+                {
+                    Notification n = std::move(notifications.front());
+                    notifications.pop_front();
+                    receive(n.bytes, t + used);
+                }
+            }
+        }
+    }
+
+    result.seconds = finishedAt / 1e6;
+    result.ok = !failed && dev.Finished() && next == actions.size() && !waiting &&
+                !std::memcmp(dev.Flash().data() + APPLICATION_START_ADDR, image.data(), image.size());
+    return result;
+}
+
+}  // namespace sim
@@ -0,0 +1,54 @@
+// a deterministic discrete event model of a DFU over a BLE connection, driving the firmware's protocol engine.
+// the radio is modelled per connection event (packets per event, airtime, loss), the flash per scheduler step
+// (the same gap rules as src/flash_sched.c), and the device cpu with per byte cost estimates.
+
+#ifndef LINK_SIM_H
+#define LINK_SIM_H
+
+#include <cstdint>
+#include <vector>
+
+#include "sim_device.h"
+
+namespace sim
+{
+
+struct LinkParams
+{
+    uint16_t connInterval = 12; // units of 1.25ms, like DEFAULT_DESIRED_MAX_CONN_INTERVAL.
+    uint16_t mtu = 247;
+    uint32_t objectSize = OTA_OBJECT_BUFFER_SIZE; // data object size the client creates, at most what SELECT reports.
+    uint16_t prn = 0; // the client checks the CRC every prn packets. 0 only checks once per object.
+    uint8_t maxPdusPerEvent = 6; // what the central's controller sends per event at most.
+    double loss = 0.0; // probability that a PDU has to be retransmitted.
+    bool phy2M = false;
+    uint32_t hostLatencyUs = 0; // central app time from a notification to its next request.
+    // device cpu costs. estimates, replace them with the perf counters (0x80) of a real device.
+    double crcNsPerByte = 150;
+    double hashNsPerByte = 500;
+    uint32_t signatureUs = 4000;
+    uint32_t seed = 1;
+};
+
+struct LinkResult
+{
+    bool ok = false;
+    double seconds = 0;
+    // where the time went, in seconds. classified once per connection interval.
+    double radio = 0; // the central had packets queued.
+    double flash = 0; // a flash job was running.
+    double cpu = 0; // the device was still processing a request.
+    double roundTrip = 0; // waiting for a response or for the central app.
+    uint64_t events = 0;
+    uint64_t pdus = 0;
+    uint64_t retransmissions = 0;
+    uint64_t missedEvents = 0; // events the radio missed because a flash step stalled the cpu.
+    const char* Bottleneck() const;
+};
+
+LinkResult SimulateLink(const LinkParams& params, const uint8_t (&key)[SIGNATURE_KEY_LEN],
+                        const CmdObject_t& cmd, const std::vector<uint8_t>& image);
+
+}  // namespace sim
+
+#endif /* LINK_SIM_H */
@@ -0,0 +1,151 @@
+// sweeps connection parameters over the BLE link model (link_sim.h) and prints the DFU time of each combination
+// with where the time went, so parameter changes can be judged before touching a real device.
+//
+// usage: link_sweep [-s image size] [-i intervals] [-m mtus] [-o object sizes] [-p prns]
+//                   [-e pdus per event] [-l loss] [-L host latency ms] [-2] [-r seed]
+//   -i, -m, -o and -p take comma separated lists, every combination is simulated.
+//   -i  connection intervals in units of 1.25ms.
+//   -2  use the 2M PHY.
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "link_sim.h"
+
+namespace
+{
+
+std::vector<uint32_t> ParseList(const char* arg)
+{
+    std::vector<uint32_t> values;
+    std::stringstream ss(arg);
+    std::string item;
+    while(std::getline(ss, item, ',')) values.push_back(std::strtoul(item.c_str(), nullptr, 0));
+    return values;
+}
+
+void Usage()
+{
+    std::fprintf(stderr, "usage: link_sweep [-s image size <= %u] [-i intervals] [-m mtus] [-o object sizes <= %u] [-p prns]\n"
+                         "                  [-e pdus per event] [-l loss] [-L host latency ms] [-2] [-r seed]\n",
+                 APPLICATION_MAX_SIZE, OTA_OBJECT_BUFFER_SIZE);
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    uint32_t imageSize = APPLICATION_MAX_SIZE;
+    std::vector<uint32_t> intervals = {6, 12, 24, 48};
+    std::vector<uint32_t> mtus = {23, 185, 247};
+    std::vector<uint32_t> objectSizes = {EEPROM_PAGE_SIZE, OTA_OBJECT_BUFFER_SIZE};
+    std::vector<uint32_t> prns = {0};
+    sim::LinkParams base;
+    int opt;
+    while((opt = getopt(argc, argv, "s:i:m:o:p:e:l:L:2r:")) != -1)
+    {
+        switch(opt)
+        {
+            case 's': imageSize = std::strtoul(optarg, nullptr, 0); break;
+            case 'i': intervals = ParseList(optarg); break;
+            case 'm': mtus = ParseList(optarg); break;
+            case 'o': objectSizes = ParseList(optarg); break;
+            case 'p': prns = ParseList(optarg); break;
+            case 'e': base.maxPdusPerEvent = std::atoi(optarg); break;
+            case 'l': base.loss = std::atof(optarg); break;
+            case 'L': base.hostLatencyUs = std::atof(optarg) * 1000; break;
+            case '2': base.phy2M = true; break;
+            case 'r': base.seed = std::strtoul(optarg, nullptr, 0); break;
+            default: Usage(); return 2;
+        }
+    }
+    if(imageSize == 0 || imageSize > APPLICATION_MAX_SIZE || base.maxPdusPerEvent == 0 || base.loss < 0 || base.loss >= 1)
+    {
+        Usage();
+        return 2;
+    }
+    for(uint32_t size : objectSizes)
+    {
+        if(size == 0 || size > OTA_OBJECT_BUFFER_SIZE)
+        {
+            Usage();
+            return 2;
+        }
+    }
+    for(uint32_t mtu : mtus)
+    {
+        // the model sends every ATT PDU in one link layer packet.
+        if(mtu < 23 || mtu > BLE_BUFF_MAX_LEN - 4)
+        {
+            Usage();
+            return 2;
+        }
+    }
+    for(uint32_t interval : intervals)
+    {
+        // 7.5ms to 4s is what the spec allows.
+        if(interval < 6 || interval > 3200)
+        {
+            Usage();
+            return 2;
+        }
+    }
+
+    std::mt19937 rng(1);
+    uint8_t key[SIGNATURE_KEY_LEN];
+    for(auto& b : key) b = rng();
+    std::vector<uint8_t> image(imageSize);
+    for(auto& b : image) b = rng();
+
+    CmdObject_t cmd{};
+    cmd.type = OTA_FW_TYPE_APPLICATION;
+    cmd.is_debug = TRUE;
+    cmd.fw_version = 1;
+    cmd.hw_version = HARDWARE_VERSION;
+    cmd.lib_version = 0;
+    cmd.bin_size = imageSize;
+    sha256Compute(image.data(), image.size(), cmd.fw_hash);
+    hmacCompute(SHA256_HASH_ALGO, key, sizeof(key), &cmd, sizeof(cmd) - SIGNATURE_LEN, cmd.obj_signature);
+
+    std::printf("image %u bytes, %s PHY, %u PDUs per event, loss %.1f%%, host latency %.1f ms\n",
+                imageSize, base.phy2M ? "2M" : "1M", base.maxPdusPerEvent, base.loss * 100, base.hostLatencyUs / 1000.0);
+    std::printf("%8s %5s %6s %5s %9s %7s %6s %6s %6s %6s %7s  %s\n",
+                "interval", "mtu", "object", "prn", "time s", "kB/s", "radio", "flash", "cpu", "rtt", "missed", "bottleneck");
+    for(uint32_t interval : intervals)
+    {
+        for(uint32_t mtu : mtus)
+        {
+            for(uint32_t objectSize : objectSizes)
+            {
+                for(uint32_t prn : prns)
+                {
+                    sim::LinkParams params = base;
+                    params.connInterval = interval;
+                    params.mtu = mtu;
+                    params.objectSize = objectSize;
+                    params.prn = prn;
+                    sim::LinkResult r = sim::SimulateLink(params, key, cmd, image);
+                    std::printf("%6.2fms %5u %6u %5u ", interval * 1.25, mtu, objectSize, prn);
+                    if(!r.ok)
+                    {
+                        // e.g. an MTU too small for the largest response, which the engine rejects.
+                        std::printf("%9s\n", "failed");
+                        continue;
+                    }
+                    double total = r.radio + r.flash + r.cpu + r.roundTrip;
+                    std::printf("%9.2f %7.2f %5.1f%% %5.1f%% %5.1f%% %5.1f%% %7llu  %s\n",
+                                r.seconds, imageSize / r.seconds / 1000,
+                                r.radio * 100 / total, r.flash * 100 / total, r.cpu * 100 / total, r.roundTrip * 100 / total,
+                                (unsigned long long)r.missedEvents, r.Bottleneck());
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,191 @@
+// runs complete DFU sessions against the firmware's protocol engine on Linux and reports its throughput.
+// the engine is the same source as on the chip, only the port is simulated, so this measures the protocol
+// handling cost (copy, crc, hash, signature) without any radio or flash time.
+//
+// ota_bench_stream is the same with STREAM_WRITE, packets are then programmed as they arrive.
+//
+// usage: ota_bench [-s image size] [-n iterations] [-c]
+//   -c  send data objects over the L2CAP channel stand-in instead of packet writes.
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "coc_channel.h"
+#include "sim_device.h"
+
+namespace
+{
+
+constexpr uint16_t kMTU = 247;
+constexpr uint16_t kPacketSize = kMTU - 3; // ATT write header.
+constexpr uint16_t kMPS = 247; // an LE frame filling a 251 bytes link layer packet.
+#if STREAM_WRITE
+constexpr const char* kWriteMode = "streamed to flash";
+#else
+constexpr const char* kWriteMode = "object buffer";
+#endif
+
+struct Session
+{
+    sim::SimDevice& dev;
+    sim::CocChannel* coc = nullptr;
+    bool ok = true;
+    uint64_t airBytes = 0; // L2CAP payload spent on object data.
+
+    // send a control point request and expect a successful response, returns its content.
+    std::vector<uint8_t> Request(std::vector<uint8_t> req)
+    {
+        dev.WriteCtrlPoint(req.data(), req.size());
+        std::vector<uint8_t> rsp;
+        // deferred requests are answered once the flash job is done.
+        while(!dev.PopResponse(rsp))
+        {
+            if(!dev.PollFlash())
+            {
+                std::fprintf(stderr, "no response to opcode 0x%02X\n", req[0]);
+                ok = false;
+                return {};
+            }
+        }
+        if(rsp.size() < 3 || rsp[1] != req[0] || rsp[2] != OTA_RSP_SUCCESS)
+        {
+            std::fprintf(stderr, "opcode 0x%02X failed with 0x%02X\n", req[0], rsp.size() < 3 ? 0 : rsp[2]);
+            ok = false;
+            return {};
+        }
+        return std::vector<uint8_t>(rsp.begin() + 3, rsp.end());
+    }
+
+    void SendData(const uint8_t* pData, uint32_t size)
+    {
+        if(coc)
+        {
+            // an object always fits in one SDU.
+            uint64_t before = coc->AirBytes();
+            coc->Send(pData, size);
+            while(!coc->Pump())
+            {
+                if(!dev.PollFlash())
+                {
+                    std::fprintf(stderr, "channel stalled without credits\n");
+                    ok = false;
+                    return;
+                }
+                coc->Service();
+            }
+            airBytes += coc->AirBytes() - before;
+            return;
+        }
+        for(uint32_t offset = 0; offset < size; offset += kPacketSize)
+        {
+            uint32_t len = size - offset < kPacketSize ? size - offset : kPacketSize;
+            dev.WritePacket(pData + offset, len);
+            airBytes += 4 + 3 + len; // L2CAP and ATT headers.
+        }
+    }
+
+    // CREATE, stream, check CRC and EXECUTE one object.
+    void SendObject(uint8_t type, const uint8_t* pData, uint32_t size)
+    {
+        std::vector<uint8_t> create = {OTA_CTRL_POINT_OPCODE_CREATE, type};
+        create.insert(create.end(), reinterpret_cast<uint8_t*>(&size), reinterpret_cast<uint8_t*>(&size) + sizeof(size));
+        Request(create);
+        if(ok) SendData(pData, size);
+        if(ok) Request({OTA_CTRL_POINT_OPCODE_CRC});
+        if(ok) Request({OTA_CTRL_POINT_OPCODE_EXECUTE});
+    }
+
+    void Run(const CmdObject_t& cmd, const std::vector<uint8_t>& image)
+    {
+        Request({OTA_CTRL_POINT_OPCODE_SELECT, OTA_CONTROL_POINT_OBJ_TYPE_CMD});
+        if(ok) SendObject(OTA_CONTROL_POINT_OBJ_TYPE_CMD, reinterpret_cast<const uint8_t*>(&cmd), sizeof(cmd));
+        if(ok) Request({OTA_CTRL_POINT_OPCODE_SELECT, OTA_CONTROL_POINT_OBJ_TYPE_DATA});
+        for(uint32_t offset = 0; ok && offset < image.size(); offset += OTA_OBJECT_BUFFER_SIZE)
+        {
+            uint32_t size = image.size() - offset < OTA_OBJECT_BUFFER_SIZE ? image.size() - offset : OTA_OBJECT_BUFFER_SIZE;
+            SendObject(OTA_CONTROL_POINT_OBJ_TYPE_DATA, image.data() + offset, size);
+        }
+    }
+};
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    uint32_t imageSize = APPLICATION_MAX_SIZE;
+    int iterations = 20;
+    bool useCoc = false;
+    int opt;
+    while((opt = getopt(argc, argv, "s:n:c")) != -1)
+    {
+        switch(opt)
+        {
+            case 's': imageSize = std::strtoul(optarg, nullptr, 0); break;
+            case 'n': iterations = std::atoi(optarg); break;
+            case 'c': useCoc = true; break;
+            default: iterations = 0; break;
+        }
+    }
+    if(imageSize == 0 || imageSize > APPLICATION_MAX_SIZE || iterations <= 0)
+    {
+        std::fprintf(stderr, "usage: ota_bench [-s image size <= %u] [-n iterations] [-c]\n", APPLICATION_MAX_SIZE);
+        return 2;
+    }
+
+    std::mt19937 rng(1);
+    uint8_t key[SIGNATURE_KEY_LEN];
+    for(auto& b : key) b = rng();
+    std::vector<uint8_t> image(imageSize);
+    for(auto& b : image) b = rng();
+
+    CmdObject_t cmd{};
+    cmd.type = OTA_FW_TYPE_APPLICATION;
+    cmd.is_debug = TRUE;
+    cmd.fw_version = 1;
+    cmd.hw_version = HARDWARE_VERSION;
+    cmd.lib_version = 0;
+    cmd.bin_size = imageSize;
+    sha256Compute(image.data(), image.size(), cmd.fw_hash);
+    hmacCompute(SHA256_HASH_ALGO, key, sizeof(key), &cmd, sizeof(cmd) - SIGNATURE_LEN, cmd.obj_signature);
+
+    double best = 0;
+    double total = 0;
+    uint64_t airBytes = 0;
+    for(int i = 0; i < iterations; i++)
+    {
+        sim::SimDevice dev(key, kMTU);
+        sim::CocChannel coc(dev, kMPS);
+        Session session{dev, useCoc ? &coc : nullptr};
+        auto start = std::chrono::steady_clock::now();
+        session.Run(cmd, image);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if(!session.ok || !dev.Finished())
+        {
+            std::fprintf(stderr, "session %d did not complete\n", i);
+            return 1;
+        }
+        if(std::memcmp(dev.Flash().data() + APPLICATION_START_ADDR, image.data(), image.size()))
+        {
+            std::fprintf(stderr, "session %d: flash content does not match the image\n", i);
+            return 1;
+        }
+        total += seconds;
+        if(i == 0 || seconds < best) best = seconds;
+        airBytes = session.airBytes;
+    }
+
+    std::printf("image %u bytes, object %u bytes, %s, %s, %d sessions\n", imageSize, OTA_OBJECT_BUFFER_SIZE,
+                useCoc ? "L2CAP channel" : "packet writes", kWriteMode, iterations);
+    std::printf("best %.3f ms (%.1f ns/byte, %.1f MB/s), mean %.3f ms\n",
+                best * 1e3, best * 1e9 / imageSize, imageSize / best / 1e6, total / iterations * 1e3);
+    uint64_t payload = imageSize + sizeof(CmdObject_t);
+    std::printf("object data on air %llu bytes, %.1f%% overhead\n",
+                (unsigned long long)airBytes, (airBytes - payload) * 100.0 / payload);
+    return 0;
+}
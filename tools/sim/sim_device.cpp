@@ -0,0 +1,308 @@
+#include "sim_device.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "gatt_record.h"
+#include "mem_watermark.h"
+#include "slip.h"
+
+namespace sim
+{
+
+namespace
+{
+
+// flash erases to all ones and programming can only clear bits.
+constexpr uint8_t kErased = 0xFF;
+constexpr uint32_t kLibVersion = 0x00010000;
+
+uint32_t g_systemClock = 0;
+// big enough for the host's frames, which are larger than the chip's.
+constexpr size_t kStackWords = 16 * 1024;
+// the device whose engine runs on this thread right now, for the MemWatermark_ functions.
+thread_local SimDevice* g_running = nullptr;
+
+SimDevice* Device(OTA_Engine_t* eng)
+{
+    return static_cast<SimDevice*>(eng->port);
+}
+
+}  // namespace
+
+SimDevice::SimDevice(const uint8_t (&key)[SIGNATURE_KEY_LEN], uint16_t mtu)
+    : mtu_(mtu), flash_(APPLICATION_START_ADDR + APPLICATION_MAX_SIZE, kErased)
+{
+    std::memcpy(key_, key, sizeof(key_));
+    OTA_Engine_Init(&engine_, this);
+}
+
+void SimDevice::WriteCtrlPoint(const uint8_t* pValue, uint16_t len)
+{
+    Record(GATT_RECORD_KIND_CTRL_POINT, pValue, len);
+    if(queueOverflow_ && len && pValue[0] == OTA_CTRL_POINT_OPCODE_PING)
+    {
+        queueOverflow_ = false;
+    }
+    else if(queueOverflow_ && len)
+    {
+        Run([&] { OTA_Engine_Dropped(&engine_, pValue[0]); });
+        return;
+    }
+    // the engine does not modify the request, the stack just doesn't declare it const.
+    Run([&] { OTA_Engine_CtrlPoint(&engine_, const_cast<uint8_t*>(pValue), len); });
+}
+
+void SimDevice::WritePacket(const uint8_t* pValue, uint16_t len)
+{
+    Record(GATT_RECORD_KIND_PACKET, pValue, len);
+    if(queueDrops_ && ++queuePackets_ % queueDrops_ == 0) queueOverflow_ = true;
+    if(queueOverflow_) return;
+    Run([&] { OTA_Engine_Packet(&engine_, const_cast<uint8_t*>(pValue), len); });
+}
+
+void SimDevice::SetMemWatermark(bool on)
+{
+    // the sim is linked with -z now, the C++ runtime is not: its first allocation binds malloc and free lazily,
+    // which takes kilobytes of stack. that happens here instead of on the engine's stack.
+    ::operator delete(::operator new(1), 1);
+    stack_.assign(on ? kStackWords : 0, MEM_PAINT_PATTERN);
+}
+
+uint32_t SimDevice::StackUsed() const
+{
+    size_t i = 0;
+    while(i < stack_.size() && stack_[i] == MEM_PAINT_PATTERN) i++;
+    return (stack_.size() - i) * sizeof(uint32_t);
+}
+
+void SimDevice::Run(const std::function<void()>& call)
+{
+    SimDevice* outer = g_running;
+    g_running = this;
+    // a flash job completed from within a request is already on the engine's stack.
+    if(stack_.empty() || call_)
+    {
+        call();
+    }
+    else
+    {
+        call_ = &call;
+        getcontext(&callee_);
+        callee_.uc_stack.ss_sp = stack_.data();
+        callee_.uc_stack.ss_size = StackSize();
+        callee_.uc_link = &caller_;
+        makecontext(&callee_, &SimDevice::RunEntry, 0);
+        swapcontext(&caller_, &callee_);
+        call_ = nullptr;
+    }
+    g_running = outer;
+}
+
+void SimDevice::RunEntry()
+{
+    (*g_running->call_)();
+}
+
+void SimDevice::SetRecording(std::ostream* out)
+{
+    recording_ = out;
+    recordStart_ = std::chrono::steady_clock::now();
+    recordSeq_ = 0;
+}
+
+void SimDevice::Record(uint8_t kind, const uint8_t* pValue, uint16_t len)
+{
+    if(!recording_) return;
+    GattRecordHeader_t header{};
+    header.time = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - recordStart_).count();
+    header.seq = recordSeq_++;
+    header.mtu = mtu_;
+    header.kind = kind;
+    // one frame like GattRecord_Write, the header and the value escaped together.
+    std::vector<uint8_t> frame(sizeof(header) + len);
+    std::memcpy(frame.data(), &header, sizeof(header));
+    std::memcpy(frame.data() + sizeof(header), pValue, len);
+    std::vector<uint8_t> encoded(SLIP_ENCODED_MAX(frame.size()));
+    encoded.resize(Slip_Encode(encoded.data(), frame.data(), frame.size()));
+    recording_->write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+}
+
+bool SimDevice::PopResponse(std::vector<uint8_t>& rsp)
+{
+    if(responses_.empty()) return false;
+    rsp = std::move(responses_.front());
+    responses_.pop_front();
+    return true;
+}
+
+void SimDevice::SendRsp(uint8_t opcode, OTA_CtrlPointRsp_t* rsp, OtaRspCode_t rspCode)
+{
+    uint8_t* pContent;
+    uint16_t len = OTA_GetRspContent(opcode, rspCode, rsp, &pContent);
+    std::vector<uint8_t> bytes = {OTA_CTRL_POINT_OPCODE_RSP, opcode, rspCode};
+    if(len) bytes.insert(bytes.end(), pContent, pContent + len);
+    heapUsed_ = std::max<uint32_t>(heapUsed_, bytes.size());
+    Record(GATT_RECORD_KIND_RSP, bytes.data(), bytes.size());
+    responses_.push_back(std::move(bytes));
+}
+
+bStatus_t SimDevice::FlashErase(uint32_t addr, uint32_t len)
+{
+    if(addr % EEPROM_BLOCK_SIZE || len % EEPROM_BLOCK_SIZE) return FAILURE;
+    // like OTA_StayInDfu, the record goes before the application it describes.
+    hasImage_ = false;
+    return StartJob({FlashOp::kErase, addr, len, nullptr});
+}
+
+bStatus_t SimDevice::FlashProgram(uint32_t addr, const uint8_t* pBuf, uint32_t len)
+{
+    return StartJob({FlashOp::kProgram, addr, len, pBuf});
+}
+
+bStatus_t SimDevice::FlashWrite(uint32_t addr, const uint8_t* pBuf, uint32_t len)
+{
+    // like FLASH_ROM_WRITE, right away and whole words only.
+    if(addr % FLASH_MIN_WR_SIZE || len % FLASH_MIN_WR_SIZE || addr + len > flash_.size()) return FAILURE;
+    return RunJob({FlashOp::kProgram, addr, len, pBuf});
+}
+
+void SimDevice::ReadKey(uint8_t* pKey) const
+{
+    std::memcpy(pKey, key_, sizeof(key_));
+}
+
+bStatus_t SimDevice::StartJob(const FlashJob& job)
+{
+    if(job_.op != FlashOp::kNone) return bleIncorrectMode;
+    if(job.addr + job.len > flash_.size()) return FAILURE;
+    if(flashDeferred_)
+    {
+        job_ = job;
+        return SUCCESS;
+    }
+    // the engine allows the job to complete from within the request.
+    uint8_t status = RunJob(job);
+    Run([&] { OTA_Engine_FlashDone(&engine_, status); });
+    return SUCCESS;
+}
+
+void SimDevice::Finish(const CmdObject_t& cmd)
+{
+    finished_ = true;
+    // like the bootloader, an application is recorded for the version query and the scan response.
+    if(cmd.type != OTA_FW_TYPE_APPLICATION) return;
+    image_.app_version = cmd.fw_version;
+    std::memcpy(image_.app_digest, cmd.fw_hash, sizeof(image_.app_digest));
+    hasImage_ = true;
+}
+
+bool SimDevice::PollFlash()
+{
+    if(job_.op == FlashOp::kNone) return false;
+    FlashJob job = job_;
+    job_ = FlashJob();
+    uint8_t status = RunJob(job);
+    Run([&] { OTA_Engine_FlashDone(&engine_, status); });
+    return true;
+}
+
+uint8_t SimDevice::RunJob(const FlashJob& job)
+{
+    uint8_t* pFlash = flash_.data() + job.addr;
+    if(job.op == FlashOp::kErase)
+    {
+        std::memset(pFlash, kErased, job.len);
+        eraseCount_++;
+    }
+    else
+    {
+        for(uint32_t i = 0; i < job.len; i++) pFlash[i] &= job.pBuf[i];
+        programCount_++;
+    }
+    return SUCCESS;
+}
+
+void SetSystemClock(uint32_t ticks)
+{
+    g_systemClock = ticks;
+}
+
+}  // namespace sim
+
+extern "C" {
+
+uint32_t TMOS_GetSystemClock(void)
+{
+    return sim::g_systemClock;
+}
+
+uint16_t OTA_Port_GetMTU(OTA_Engine_t* eng)
+{
+    return sim::Device(eng)->GetMTU();
+}
+
+void OTA_Port_SendRsp(OTA_Engine_t* eng, uint8_t opcode, OTA_CtrlPointRsp_t* rsp, OtaRspCode_t rspCode)
+{
+    sim::Device(eng)->SendRsp(opcode, rsp, rspCode);
+}
+
+bStatus_t OTA_Port_FlashErase(OTA_Engine_t* eng, uint32_t addr, uint32_t len)
+{
+    return sim::Device(eng)->FlashErase(addr, len);
+}
+
+bStatus_t OTA_Port_FlashProgram(OTA_Engine_t* eng, uint32_t addr, uint8_t* pBuf, uint32_t len)
+{
+    return sim::Device(eng)->FlashProgram(addr, pBuf, len);
+}
+
+#if STREAM_WRITE
+bStatus_t OTA_Port_FlashWrite(OTA_Engine_t* eng, uint32_t addr, uint8_t* pBuf, uint32_t len)
+{
+    return sim::Device(eng)->FlashWrite(addr, pBuf, len);
+}
+#endif
+
+void OTA_Port_ReadKey(OTA_Engine_t* eng, uint8_t* pKey)
+{
+    sim::Device(eng)->ReadKey(pKey);
+}
+
+void OTA_Port_ReadData(OTA_Engine_t* eng, EEPROM_Data_t* pData)
+{
+    sim::Device(eng)->ReadData(pData);
+}
+
+uint32_t OTA_Port_LibVersion(OTA_Engine_t* eng)
+{
+    return sim::kLibVersion;
+}
+
+uint8_t OTA_Port_ReadImageInfo(OTA_Engine_t* eng, ImageInfo_t* pInfo)
+{
+    return sim::Device(eng)->ImageInfo(*pInfo) ? SUCCESS : FAILURE;
+}
+
+void OTA_Port_Finish(OTA_Engine_t* eng)
+{
+    sim::Device(eng)->Finish(eng->cmdObj);
+}
+
+// only called by the engine, so from within SimDevice::Run.
+uint32_t MemWatermark_StackSize()
+{
+    return sim::g_running->StackSize();
+}
+
+uint32_t MemWatermark_StackUsed()
+{
+    return sim::g_running->StackUsed();
+}
+
+uint32_t MemWatermark_HeapUsed()
+{
+    return sim::g_running->HeapUsed();
+}
+
+}  // extern "C"
@@ -0,0 +1,131 @@
+// a DFU target on Linux: the firmware's protocol engine (src/OTA_engine.c) bound to a simulated port.
+// flash is a byte array with NOR semantics, responses are queued instead of notified.
+
+#ifndef SIM_DEVICE_H
+#define SIM_DEVICE_H
+
+#include <ucontext.h>
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <ostream>
+#include <vector>
+
+#include "OTA_engine.h"
+
+namespace sim
+{
+
+// the TMOS clock seen by the firmware sources, in 625us ticks.
+void SetSystemClock(uint32_t ticks);
+
+class SimDevice
+{
+public:
+    explicit SimDevice(const uint8_t (&key)[SIGNATURE_KEY_LEN], uint16_t mtu = 247);
+    SimDevice(const SimDevice&) = delete;
+    SimDevice& operator=(const SimDevice&) = delete;
+
+    // what the transport delivers, same as a control point and a packet characteristic write.
+    void WriteCtrlPoint(const uint8_t* pValue, uint16_t len);
+    void WritePacket(const uint8_t* pValue, uint16_t len);
+
+    // responses as they would go on the air: 0x60, request opcode, response code, content.
+    bool PopResponse(std::vector<uint8_t>& rsp);
+
+    // when deferred, flash jobs wait for PollFlash like they wait for a connection gap on the chip.
+    // otherwise they complete within the request.
+    void SetFlashDeferred(bool deferred) { flashDeferred_ = deferred; }
+    bool PollFlash();
+    bool FlashPending() const { return job_.op != FlashOp::kNone; }
+    // what the pending job is, for timing models.
+    bool PendingErase() const { return job_.op == FlashOp::kErase; }
+    uint32_t PendingLen() const { return job_.len; }
+    // a request is waiting for its flash job, packets are dropped until it is answered.
+    bool Busy() const { return engine_.busy; }
+
+    // run the engine on a stack of its own painted like MemWatermark_Init does, so MEM_USAGE reports how deep
+    // it went. the marks are the host's frames, not the chip's, only good for comparing builds and requests.
+    // the heap mark is the largest response, which the chip allocates from the BLE heap to notify it.
+    void SetMemWatermark(bool on);
+    uint32_t StackSize() const { return stack_.size() * sizeof(uint32_t); }
+    uint32_t StackUsed() const;
+    uint32_t HeapUsed() const { return heapUsed_; }
+
+    // drop every n-th packet like a full write queue on the chip (WRITE_QUEUE in src/peripheral.c), with what
+    // follows there: the packets after it are dropped too and requests are answered with OTA_EXT_DATA_DROPPED,
+    // until a PING. 0 drops nothing.
+    void SetQueueDrops(uint32_t every) { queueDrops_ = every; }
+
+    // write the writes and the responses to out as a GATT recording (gatt_record.h), like the firmware built
+    // with GATT_RECORD, so a session can be replayed with gatt_replay. the times are the host's. nullptr stops.
+    void SetRecording(std::ostream* out);
+
+    void SetMTU(uint16_t mtu) { mtu_ = mtu; }
+    void SetData(const EEPROM_Data_t& data) { data_ = data; }
+    // the installed application, as recorded by a finished update or by SetImageInfo.
+    void SetImageInfo(const ImageInfo_t& info) { image_ = info; hasImage_ = true; }
+    bool ImageInfo(ImageInfo_t& info) const { info = image_; return hasImage_; }
+    const std::vector<uint8_t>& Flash() const { return flash_; }
+    bool Finished() const { return finished_; }
+    uint32_t EraseCount() const { return eraseCount_; }
+    uint32_t ProgramCount() const { return programCount_; }
+
+    // -- port, called back by the engine -- //
+    uint16_t GetMTU() const { return mtu_; }
+    void SendRsp(uint8_t opcode, OTA_CtrlPointRsp_t* rsp, OtaRspCode_t rspCode);
+    bStatus_t FlashErase(uint32_t addr, uint32_t len);
+    bStatus_t FlashProgram(uint32_t addr, const uint8_t* pBuf, uint32_t len);
+    bStatus_t FlashWrite(uint32_t addr, const uint8_t* pBuf, uint32_t len);
+    void ReadKey(uint8_t* pKey) const;
+    void ReadData(EEPROM_Data_t* pData) const { *pData = data_; }
+    void Finish(const CmdObject_t& cmd);
+
+private:
+    enum class FlashOp { kNone, kErase, kProgram };
+    struct FlashJob
+    {
+        FlashOp op = FlashOp::kNone;
+        uint32_t addr = 0;
+        uint32_t len = 0;
+        const uint8_t* pBuf = nullptr;
+    };
+
+    // calls into the engine, on its own stack with SetMemWatermark.
+    void Run(const std::function<void()>& call);
+    static void RunEntry();
+    bStatus_t StartJob(const FlashJob& job);
+    uint8_t RunJob(const FlashJob& job);
+    void Record(uint8_t kind, const uint8_t* pValue, uint16_t len);
+
+    OTA_Engine_t engine_;
+    uint8_t key_[SIGNATURE_KEY_LEN];
+    uint16_t mtu_;
+    EEPROM_Data_t data_{};
+    ImageInfo_t image_{};
+    bool hasImage_ = false;
+    std::vector<uint8_t> flash_;
+    std::deque<std::vector<uint8_t>> responses_;
+    bool flashDeferred_ = false;
+    FlashJob job_;
+    bool finished_ = false;
+    uint32_t eraseCount_ = 0;
+    uint32_t programCount_ = 0;
+    std::vector<uint32_t> stack_;
+    ucontext_t caller_;
+    ucontext_t callee_;
+    const std::function<void()>* call_ = nullptr;
+    uint32_t heapUsed_ = 0;
+    uint32_t queueDrops_ = 0;
+    uint32_t queuePackets_ = 0;
+    bool queueOverflow_ = false;
+    std::ostream* recording_ = nullptr;
+    std::chrono::steady_clock::time_point recordStart_;
+    uint16_t recordSeq_ = 0;
+};
+
+}  // namespace sim
+
+#endif /* SIM_DEVICE_H */
@@ -0,0 +1,125 @@
+// checks the SLIP codec (src/slip.c): random frames thick with END and ESC bytes are encoded back to back and
+// fed to the decoder one byte at a time, each must come out as it went in. a frame longer than the decoder's
+// buffer must be dropped at its END without disturbing the frame after it.
+//
+// usage: slip_test [-n frames] [-S seed]
+// exits with 1 on the first difference.
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "slip.h"
+
+namespace
+{
+
+constexpr uint16_t kBufferSize = 64;
+
+class Checker
+{
+public:
+    explicit Checker(uint32_t seed) : random_(seed) { Slip_DecoderInit(&decoder_, buffer_, sizeof(buffer_)); }
+
+    // half of the bytes are END or ESC, the rest also hit ESC_END and ESC_ESC now and then.
+    std::vector<uint8_t> Frame(uint16_t len)
+    {
+        static const uint8_t kSpecial[] = {SLIP_END, SLIP_ESC, SLIP_ESC_END, SLIP_ESC_ESC};
+        std::vector<uint8_t> frame(len);
+        for(uint8_t& b : frame) b = random_() & 1 ? kSpecial[random_() % sizeof(kSpecial)] : uint8_t(random_());
+        return frame;
+    }
+
+    // encodes the frame and feeds it to the decoder, which must return it only at the closing END.
+    bool RoundTrip(const std::vector<uint8_t>& frame, bool fits)
+    {
+        std::vector<uint8_t> encoded(SLIP_ENCODED_MAX(frame.size()));
+        uint16_t n = Slip_Encode(encoded.data(), frame.data(), frame.size());
+        if(n > encoded.size()) return Report("an encoded frame is longer than SLIP_ENCODED_MAX");
+        if(encoded[0] != SLIP_END || encoded[n - 1] != SLIP_END) return Report("an encoded frame is not delimited");
+        for(uint16_t i = 1; i < n - 1; i++)
+        {
+            if(encoded[i] == SLIP_END) return Report("an END byte inside an encoded frame");
+        }
+        for(uint16_t i = 0; i < n; i++)
+        {
+            uint16_t len = Slip_Decode(&decoder_, encoded[i]);
+            if(i < n - 1 && len) return Report("a frame came out before its END");
+            if(i == n - 1)
+            {
+                if(!fits)
+                {
+                    if(len) return Report("an oversized frame came out");
+                    break;
+                }
+                if(len != frame.size()) return Report("a frame came out with another length");
+                for(uint16_t j = 0; j < len; j++)
+                {
+                    if(buffer_[j] != frame[j]) return Report("a frame came out with another content");
+                }
+            }
+        }
+        frames_++;
+        return true;
+    }
+
+    uint16_t Len(uint16_t max) { return std::uniform_int_distribution<uint16_t>(1, max)(random_); }
+    bool Chance(double p) { return std::uniform_real_distribution<double>(0, 1)(random_) < p; }
+
+    bool Report(const char* what)
+    {
+        std::printf("FAILED after %u frames: %s\n", frames_, what);
+        return false;
+    }
+
+private:
+    std::mt19937 random_;
+    uint8_t buffer_[kBufferSize];
+    Slip_Decoder_t decoder_;
+    uint32_t frames_ = 0;
+};
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    uint32_t frames = 20000;
+    uint32_t seed = 1;
+    int opt;
+    while((opt = getopt(argc, argv, "n:S:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'n': frames = std::strtoul(optarg, nullptr, 0); break;
+            case 'S': seed = std::strtoul(optarg, nullptr, 0); break;
+            default:
+                std::fprintf(stderr, "usage: slip_test [-n frames] [-S seed]\n");
+                return 2;
+        }
+    }
+
+    Checker c(seed);
+    // the edges first: a frame filling the buffer exactly, one byte over, and frames of only END or only ESC.
+    if(!c.RoundTrip(std::vector<uint8_t>(kBufferSize, SLIP_END), true)
+       || !c.RoundTrip(std::vector<uint8_t>(kBufferSize + 1, SLIP_ESC), false)
+       || !c.RoundTrip(std::vector<uint8_t>(1, SLIP_ESC), true) || !c.RoundTrip(c.Frame(kBufferSize + 1), false)
+       || !c.RoundTrip(c.Frame(kBufferSize), true))
+    {
+        return 1;
+    }
+    uint32_t dropped = 0;
+    for(uint32_t i = 0; i < frames; i++)
+    {
+        // one frame in ten does not fit, the next must decode as if it had never been sent.
+        bool fits = !c.Chance(0.1);
+        uint16_t len = fits ? c.Len(kBufferSize) : kBufferSize + c.Len(2 * kBufferSize);
+        if(!c.RoundTrip(c.Frame(len), fits)) return 1;
+        dropped += !fits;
+    }
+    std::printf("%u frames through a %u byte decoder, %u oversized dropped\n", frames, kBufferSize, dropped);
+    std::printf("passed\n");
+    return 0;
+}
@@ -0,0 +1,162 @@
+// stands in for a device on the UART transport: a pseudo terminal with the simulated device behind it.
+// the framing is the firmware's own (src/slip.c), so a host talking to the pty talks to the chip the same way.
+//
+// usage: uart_sim [-k key file] [-l link path] [-o image file] [-1]
+//   -k  signing key, SIGNATURE_KEY_LEN raw bytes. all zeros otherwise.
+//   -l  also make the pty reachable at this path.
+//   -o  write the application region here every time an update completes.
+//   -1  exit after the first completed update instead of starting over like the chip after its reset.
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "sim_device.h"
+#include "slip.h"
+#include "uart_transport.h"
+
+namespace
+{
+
+bool WriteAll(int fd, const uint8_t* p, size_t len)
+{
+    while(len)
+    {
+        ssize_t n = write(fd, p, len);
+        if(n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+int OpenPty(std::string& slavePath, int& slaveFd)
+{
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if(master < 0 || grantpt(master) || unlockpt(master)) return -1;
+    slavePath = ptsname(master);
+    // keep the slave open ourselves, so the master does not see a hangup every time a host closes it.
+    slaveFd = open(slavePath.c_str(), O_RDWR | O_NOCTTY);
+    if(slaveFd < 0) return -1;
+    termios tio;
+    tcgetattr(slaveFd, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slaveFd, TCSANOW, &tio);
+    return master;
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    uint8_t key[SIGNATURE_KEY_LEN] = {};
+    std::string linkPath;
+    std::string imagePath;
+    bool once = false;
+    int opt;
+    while((opt = getopt(argc, argv, "k:l:o:1")) != -1)
+    {
+        switch(opt)
+        {
+            case 'k':
+            {
+                std::ifstream f(optarg, std::ios::binary);
+                if(!f.read(reinterpret_cast<char*>(key), sizeof(key)))
+                {
+                    std::fprintf(stderr, "cannot read %u key bytes from %s\n", SIGNATURE_KEY_LEN, optarg);
+                    return 2;
+                }
+                break;
+            }
+            case 'l': linkPath = optarg; break;
+            case 'o': imagePath = optarg; break;
+            case '1': once = true; break;
+            default:
+                std::fprintf(stderr, "usage: uart_sim [-k key file] [-l link path] [-o image file] [-1]\n");
+                return 2;
+        }
+    }
+
+    std::string slavePath;
+    int slave;
+    int master = OpenPty(slavePath, slave);
+    if(master < 0)
+    {
+        std::perror("pty");
+        return 1;
+    }
+    if(!linkPath.empty())
+    {
+        unlink(linkPath.c_str());
+        if(symlink(slavePath.c_str(), linkPath.c_str()))
+        {
+            std::perror("symlink");
+            return 1;
+        }
+    }
+    std::printf("%s\n", slavePath.c_str());
+    std::fflush(stdout);
+
+    auto dev = std::make_unique<sim::SimDevice>(key, UART_TRANSPORT_MTU);
+    uint8_t frame[UART_TRANSPORT_MTU];
+    Slip_Decoder_t decoder;
+    Slip_DecoderInit(&decoder, frame, sizeof(frame));
+    std::vector<uint8_t> rsp;
+    uint8_t tx[SLIP_ENCODED_MAX(3 + OTA_RSP_CONTENT_MAX_LEN)];
+    uint8_t rx[4096];
+    bool done = false;
+    while(true)
+    {
+        ssize_t n = read(master, rx, sizeof(rx));
+        if(n <= 0)
+        {
+            // after the update the host hanging up is how the session ends.
+            if(done) break;
+            std::perror("read");
+            return 1;
+        }
+        for(ssize_t i = 0; i < n; i++)
+        {
+            uint16_t len = Slip_Decode(&decoder, rx[i]);
+            if(!len) continue;
+            dev->WriteCtrlPoint(frame, len);
+            while(dev->PopResponse(rsp))
+            {
+                WriteAll(master, tx, Slip_Encode(tx, rsp.data(), rsp.size()));
+            }
+        }
+        if(dev->Finished() && !done)
+        {
+            const auto& flash = dev->Flash();
+            std::printf("update complete\n");
+            std::fflush(stdout);
+            if(!imagePath.empty())
+            {
+                std::ofstream f(imagePath, std::ios::binary);
+                f.write(reinterpret_cast<const char*>(flash.data()) + APPLICATION_START_ADDR, APPLICATION_MAX_SIZE);
+            }
+            if(once)
+            {
+                // closing the master now would discard the last response, so wait for the host to let go instead.
+                close(slave);
+                slave = -1;
+                done = true;
+                continue;
+            }
+            // the chip resets into the new application, the next session starts from scratch.
+            dev = std::make_unique<sim::SimDevice>(key, UART_TRANSPORT_MTU);
+        }
+    }
+    if(!linkPath.empty()) unlink(linkPath.c_str());
+    if(slave >= 0) close(slave);
+    close(master);
+    return 0;
+}
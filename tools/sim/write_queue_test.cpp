@@ -0,0 +1,166 @@
+// checks the write queue (src/write_queue.c) against a plain FIFO: packets and control point writes of mixed
+// sizes are pushed and popped at random on a small ring, so it wraps many times with entries left behind.
+// every entry must come out in order with its header and payload intact, an entry of at most half the ring must
+// fit an empty queue, and once packets have filled the ring a control point write must still find room.
+//
+// usage: write_queue_test [-n operations] [-S seed]
+// exits with 1 on the first difference.
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <random>
+#include <vector>
+
+#include "write_queue.h"
+
+namespace
+{
+
+struct Expected
+{
+    uint8_t kind;
+    uint8_t flags;
+    uint16_t connHandle;
+    uint16_t attrHandle;
+    std::vector<uint8_t> value;
+};
+
+constexpr uint16_t kHeader = sizeof(WriteQueue_Entry_t);
+// the largest control point write the reserve guarantees room for.
+constexpr uint16_t kCtrlMax = WRITE_QUEUE_CTRL_RESERVE - kHeader;
+
+class Checker
+{
+public:
+    explicit Checker(uint32_t seed) : random_(seed) { WriteQueue_Init(); }
+
+    bool Push(uint8_t kind, uint16_t len)
+    {
+        Expected e{kind, uint8_t(random_() & WRITE_QUEUE_FLAG_OVERFLOW), uint16_t(random_()), uint16_t(random_()),
+                   std::vector<uint8_t>(len)};
+        for(uint8_t& b : e.value) b = random_();
+        if(WriteQueue_Push(e.kind, e.flags, e.connHandle, e.attrHandle, e.value.data(), len) != SUCCESS) return false;
+        fifo_.push_back(std::move(e));
+        return true;
+    }
+
+    // false when the entry at the front is not the one expected.
+    bool Pop()
+    {
+        WriteQueue_Entry_t* pEntry = WriteQueue_Peek();
+        if(fifo_.empty())
+        {
+            if(pEntry) return Report("an entry came out of an empty queue");
+            return true;
+        }
+        if(!pEntry) return Report("the queue is empty with entries left");
+        const Expected& e = fifo_.front();
+        if(pEntry->kind != e.kind || pEntry->flags != e.flags || pEntry->connHandle != e.connHandle
+           || pEntry->attrHandle != e.attrHandle || pEntry->len != e.value.size())
+        {
+            return Report("an entry came out with another header");
+        }
+        const uint8_t* pValue = reinterpret_cast<const uint8_t*>(pEntry + 1);
+        if(!std::equal(e.value.begin(), e.value.end(), pValue)) return Report("an entry came out with another payload");
+        if(reinterpret_cast<uintptr_t>(pValue) % 4) return Report("a payload is not dword aligned");
+        if(last_ && pEntry < last_) wraps_++;
+        last_ = pEntry;
+        WriteQueue_Pop();
+        fifo_.pop_front();
+        popped_++;
+        return true;
+    }
+
+    bool Drain()
+    {
+        while(!fifo_.empty())
+        {
+            if(!Pop()) return false;
+        }
+        return Pop();
+    }
+
+    bool Empty() const { return fifo_.empty(); }
+    uint32_t Wraps() const { return wraps_; }
+    uint32_t Popped() const { return popped_; }
+    uint16_t Len(uint16_t max) { return std::uniform_int_distribution<uint16_t>(1, max)(random_); }
+    bool Chance(double p) { return std::uniform_real_distribution<double>(0, 1)(random_) < p; }
+
+    bool Report(const char* what)
+    {
+        std::printf("FAILED after %u entries: %s\n", popped_, what);
+        return false;
+    }
+
+private:
+    std::mt19937 random_;
+    std::deque<Expected> fifo_;
+    const WriteQueue_Entry_t* last_ = nullptr;
+    uint32_t wraps_ = 0;
+    uint32_t popped_ = 0;
+};
+
+// packets until the ring is full, then a control point write, which the reserve must have room for.
+bool FillWithPackets(Checker& c)
+{
+    uint32_t packets = 0;
+    while(c.Push(WRITE_QUEUE_PACKET, c.Len(WRITE_QUEUE_SIZE / 4))) packets++;
+    if(!packets) return true; // a large packet found no room, nothing was reserved for.
+    if(!c.Push(WRITE_QUEUE_CTRL_POINT, c.Len(kCtrlMax))) return c.Report("no room for a control point write behind packets");
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    uint32_t operations = 200000;
+    uint32_t seed = 1;
+    int opt;
+    while((opt = getopt(argc, argv, "n:S:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'n': operations = std::strtoul(optarg, nullptr, 0); break;
+            case 'S': seed = std::strtoul(optarg, nullptr, 0); break;
+            default:
+                std::fprintf(stderr, "usage: write_queue_test [-n operations] [-S seed]\n");
+                return 2;
+        }
+    }
+
+    Checker c(seed);
+    uint32_t fills = 0;
+    for(uint32_t i = 0; i < operations; i++)
+    {
+        if(c.Chance(0.001))
+        {
+            if(!FillWithPackets(c) || !c.Drain()) return 1;
+            fills++;
+        }
+        else if(c.Chance(0.5))
+        {
+            // mostly packets, up to a quarter of the ring, and short control point writes in between.
+            bool ctrl = c.Chance(0.2);
+            uint8_t kind = ctrl ? WRITE_QUEUE_CTRL_POINT : WRITE_QUEUE_PACKET;
+            uint16_t len = c.Len(ctrl ? kCtrlMax : WRITE_QUEUE_SIZE / 4);
+            bool empty = c.Empty();
+            uint32_t room = kHeader + ((len + 3) & ~3) + (ctrl ? 0 : WRITE_QUEUE_CTRL_RESERVE);
+            if(!c.Push(kind, len) && empty && room <= WRITE_QUEUE_SIZE / 2) return c.Report("no room in an empty queue");
+        }
+        else if(!c.Pop())
+        {
+            return 1;
+        }
+    }
+    if(!c.Drain()) return 1;
+    std::printf("%u entries through a %u byte ring, %u wraps, %u fills\n", c.Popped(), WRITE_QUEUE_SIZE, c.Wraps(), fills);
+    if(c.Wraps() < 100 || fills < 10) return c.Report("too few wraps or fills to mean anything");
+    std::printf("passed\n");
+    return 0;
+}
@@ -0,0 +1,208 @@
+// decodes a trace ring dump (OTA_CTRL_POINT_OPCODE_TRACE_DUMP records, concatenated in sequence order)
+// and renders per-phase latency histograms.
+//
+// usage: trace_decode [-v] <dump.bin>
+//   -v  also print every record.
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "trace.h"
+
+namespace
+{
+
+constexpr double kTickMs = 0.625; // TMOS ticks are 625us.
+
+const char* EventName(uint8_t event)
+{
+    switch(event)
+    {
+        case TRACE_EV_CTRL_POINT: return "CTRL_POINT";
+        case TRACE_EV_CTRL_RSP: return "CTRL_RSP";
+        case TRACE_EV_NOTIFY: return "NOTIFY";
+        case TRACE_EV_OBJECT_START: return "OBJECT_START";
+        case TRACE_EV_OBJECT_FULL: return "OBJECT_FULL";
+        case TRACE_EV_PACKET_DROP: return "PACKET_DROP";
+        case TRACE_EV_GAP_STATE: return "GAP_STATE";
+        case TRACE_EV_TASK: return "TASK";
+        case TRACE_EV_FLASH_DONE: return "FLASH_DONE";
+        case TRACE_EV_QUEUE_FULL: return "QUEUE_FULL";
+        default: return "?";
+    }
+}
+
+const char* OpcodeName(uint8_t opcode)
+{
+    switch(opcode)
+    {
+        case 0x00: return "VERSION";
+        case 0x01: return "CREATE";
+        case 0x02: return "SET_PRN";
+        case 0x03: return "CRC";
+        case 0x04: return "EXECUTE";
+        case 0x06: return "SELECT";
+        case 0x07: return "GET_MTU";
+        case 0x08: return "WRITE";
+        case 0x09: return "PING";
+        case 0x0A: return "HW_VERSION";
+        case 0x0B: return "FW_VERSION";
+        case 0x0C: return "ABORT";
+        case 0x80: return "PERF_STATS";
+        default: return "VENDOR";
+    }
+}
+
+// log2 buckets over ticks: [0], [1], [2,3], [4,7], ...
+class Histogram
+{
+public:
+    void Add(uint32_t ticks)
+    {
+        size_t bucket = 0;
+        while(ticks >> bucket) bucket++;
+        if(buckets_.size() <= bucket) buckets_.resize(bucket + 1);
+        buckets_[bucket]++;
+        total_ += ticks;
+        count_++;
+        if(ticks > max_) max_ = ticks;
+    }
+
+    void Print(const std::string& name) const
+    {
+        if(!count_) return;
+        std::printf("%s: n=%u avg=%.2fms max=%.2fms\n", name.c_str(), count_, total_ * kTickMs / count_, max_ * kTickMs);
+        uint32_t peak = 0;
+        for(uint32_t n : buckets_) peak = n > peak ? n : peak;
+        for(size_t i = 0; i < buckets_.size(); i++)
+        {
+            if(!buckets_[i]) continue;
+            uint32_t lo = i ? 1u << (i - 1) : 0;
+            uint32_t hi = i ? (1u << i) - 1 : 0;
+            std::printf("  %8.2f - %8.2f ms | %-40s %u\n", lo * kTickMs, hi * kTickMs,
+                        std::string(buckets_[i] * 40 / peak, '#').c_str(), buckets_[i]);
+        }
+    }
+
+private:
+    std::vector<uint32_t> buckets_;
+    uint64_t total_ = 0;
+    uint32_t count_ = 0;
+    uint32_t max_ = 0;
+};
+
+bool Load(const char* path, std::vector<TraceRecord_t>& records)
+{
+    std::ifstream in(path, std::ios::binary);
+    if(!in) return false;
+    uint8_t raw[sizeof(TraceRecord_t)];
+    while(in.read(reinterpret_cast<char*>(raw), sizeof(raw)))
+    {
+        TraceRecord_t r;
+        r.time = raw[0] | raw[1] << 8 | raw[2] << 16 | static_cast<uint32_t>(raw[3]) << 24;
+        r.event = raw[4];
+        r.arg8 = raw[5];
+        r.arg16 = static_cast<uint16_t>(raw[6] | raw[7] << 8);
+        records.push_back(r);
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    bool verbose = false;
+    const char* path = nullptr;
+    for(int i = 1; i < argc; i++)
+    {
+        if(!std::strcmp(argv[i], "-v")) verbose = true;
+        else path = argv[i];
+    }
+    if(!path)
+    {
+        std::fprintf(stderr, "usage: %s [-v] <dump.bin>\n", argv[0]);
+        return 2;
+    }
+    std::vector<TraceRecord_t> records;
+    if(!Load(path, records))
+    {
+        std::fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+
+    std::map<std::string, Histogram> phases;
+    // pending starts of each phase.
+    bool requestOpen = false, responseOpen = false, notifyOpen = false;
+    uint8_t requestOpcode = 0;
+    uint32_t requestTime = 0, responseTime = 0, notifyTime = 0;
+    std::map<uint8_t, uint32_t> objectStart;
+    uint32_t drops = 0;
+
+    for(const TraceRecord_t& r : records)
+    {
+        if(verbose)
+        {
+            std::printf("%10.2f ms  %-12s arg8=0x%02x arg16=0x%04x\n", r.time * kTickMs, EventName(r.event), r.arg8, r.arg16);
+        }
+        switch(r.event)
+        {
+            case TRACE_EV_CTRL_POINT:
+                if(notifyOpen) phases["host turnaround (notify -> next request)"].Add(r.time - notifyTime);
+                notifyOpen = false;
+                requestOpen = true;
+                requestOpcode = r.arg8;
+                requestTime = r.time;
+                break;
+            case TRACE_EV_CTRL_RSP:
+                if(requestOpen && requestOpcode == r.arg8)
+                {
+                    phases[std::string("request -> response ") + OpcodeName(r.arg8)].Add(r.time - requestTime);
+                }
+                requestOpen = false;
+                responseOpen = true;
+                responseTime = r.time;
+                break;
+            case TRACE_EV_NOTIFY:
+                if(responseOpen) phases["response -> notification sent"].Add(r.time - responseTime);
+                if(r.arg8) phases["notification failures"].Add(0);
+                responseOpen = false;
+                notifyOpen = true;
+                notifyTime = r.time;
+                break;
+            case TRACE_EV_OBJECT_START:
+                objectStart[r.arg8] = r.time;
+                break;
+            case TRACE_EV_OBJECT_FULL:
+                if(objectStart.count(r.arg8))
+                {
+                    phases[r.arg8 == 1 ? "command object transfer" : "data object transfer"].Add(r.time - objectStart[r.arg8]);
+                    objectStart.erase(r.arg8);
+                }
+                break;
+            case TRACE_EV_PACKET_DROP:
+                drops++;
+                break;
+            case TRACE_EV_QUEUE_FULL:
+                phases["write queue full, write dropped"].Add(0);
+                break;
+            case TRACE_EV_FLASH_DONE:
+                if(requestOpen) phases[std::string("flash commit ") + OpcodeName(r.arg16)].Add(r.time - requestTime);
+                break;
+            default:
+                break;
+        }
+    }
+
+    std::printf("%zu records, %.2f ms span, %u dropped packets\n\n", records.size(),
+                records.empty() ? 0.0 : (records.back().time - records.front().time) * kTickMs, drops);
+    for(const auto& [name, histogram] : phases)
+    {
+        histogram.Print(name);
+    }
+    return 0;
+}